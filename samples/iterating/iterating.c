@@ -22,27 +22,27 @@ int main(int argc, char **argv)
     // Key names and values are stored in parrallel arrays and can be
     // iterated over trivially:
     printf("\nKEY NAMES:\n");
-    for (int i = 0; i < ini->key_count; ++i)
+    for (SirIndex i = 0; i < ini->key_count; ++i)
         printf("%s\n", ini->key_names[i]);
 
     printf("\nKEY VALUES:\n");
-    for (int i = 0; i < ini->key_count; ++i)
+    for (SirIndex i = 0; i < ini->key_count; ++i)
         printf("%s\n", ini->key_values[i]);
 
     // You can also get arrays containing the key names and values from
     // a specific section. Note that these functions use malloc due
     // to how the keys and sections are stored internally.
-    int size;
+    SirIndex size;
     const char **names = sir_section_key_names(ini, "section1", &size);
 
     printf("\nSECTION 1 KEY NAMES\n");
-    for (int i = 0; i < size; ++i)
+    for (SirIndex i = 0; i < size; ++i)
         printf("%s\n", names[i]);
 
     const char **values = sir_section_key_values(ini, "section2", &size);
 
     printf("\nSECTION 2 KEY VALUES\n");
-    for (int i = 0; i < size; ++i)
+    for (SirIndex i = 0; i < size; ++i)
         printf("%s\n", values[i]);
 
     // Don't forget to free them!
@@ -11,28 +11,40 @@
 //  - Reading values as string
 //  - Converting values to long, unsigned long, double or bool.
 //  - Converting values to an array of strings, splitting by comma (,).
-//  - Optional case-insensitivity
+//  - Optional case-insensitivity, with optional Unicode case folding
 //  - Options to ignore or override keys with duplicated names
 //  - Optional warnings to detect probable mistakes in an INI
 //  - Optional errors
 //  - Customizable malloc, realloc, free
+//  - Writing an INI as JSON or NDJSON (newline-delimited JSON)
+//  - Writing new INI files with a buffered SirWriter
+//  - Editing an INI and saving it without losing comments or formatting
+//  - Overlaying INIs so that later ones override earlier ones
+//  - Loading and merging a directory of INIs, e.g. conf.d
+//  - Optional '!include' and '@include' directives
+//  - Optional '${section:key}' and '${ENV:VARIABLE}' interpolation
+//  - Optional section inheritance with '[child : parent]'
+//  - Collecting the values of a key from every section as a column
+//  - Querying sections by value, with an optional sorted index of values
+//  - Finding every key with a given value
+//  - Validating keys and storing them in a struct from a schema
+//  - Choosing the comment, assignment, section and quote characters per load
+//  - Optional '\' escapes, continuation lines and '"""' multi-line values
+//  - Skipping a UTF-8 byte order mark, and optional UTF-8 validation
+//  - Loading UTF-16LE files with a byte order mark, which are read as UTF-8
+//  - Files bigger than 2GB. Sizes and offsets are size_t/ptrdiff_t, and
+//    sections and keys are counted in SirIndex (see below)
 //
 // Currently NOT Supported:
-//  - Ignoring newlines with '\'
 //  - Programmatic interpretation of sub-sections/nested sections. You
 //    can make the illusion of sub-sections by indenting with white-
 //    space or using a name like [A.B.C] but the parser interprets all
 //    sections as being on the same level.
 //
 // UNTESTED, but might work:
-//  - Unicode
 //  - Thread-safety. Loading different files in seperate threads should 
 //    be okay in theory, because none of these functions are meant to
 //    touch any outside state other than their ini pointer parameter.
-//  - Files bigger than 2GB. Currently we use the 'fseek(END), ftell()' 
-//    trick to get the file size and we use ints to store array sizes most of
-//    the time. But if you have an INI file bigger than 2GB you might want
-//    to think about choosing a more appropriate file format.
 //
 // Terminology
 // ===========
@@ -100,11 +112,218 @@
 //
 // There is also a function that tries to split a string by commas:
 //
-//      int *csv_size;
+//      SirIndex csv_size;
 //      const char **csv = sir_csv(ini,  "key_name", &csv_size);
 //
 //      sir_free_csv(csv);
 //
+// An INI can be exported as JSON, either as one object that maps each section
+// name to an object of keys, or as NDJSON with one object per key:
+//
+//      sir_write_json(ini, stdout);
+//      sir_write_ndjson(ini, stdout);
+//
+// Writing INI Files
+// =================
+//
+// A SirWriter writes sections and keys to a FILE through a large buffer:
+//
+//      SirWriter writer = sir_writer_create(file, 0);
+//
+//      sir_writer_section(writer, "graphics");
+//      sir_writer_long(writer, "window_width", 1920);
+//      sir_writer_key(writer, "title", "  padded  ");
+//
+//      sir_writer_flush(writer);
+//
+//      if (sir_writer_has_error(writer))
+//          printf("%s\n", writer->error);
+//
+//      sir_free_writer(writer);
+//
+// Editing INI Files
+// =================
+//
+// Keys can be changed, added and removed in memory. Lookups see the changes
+// straight away:
+//
+//      sir_set(ini, "graphics", "window_width", "2560");
+//      sir_delete(ini, "graphics", "window_height");
+//
+// If an INI is loaded with SIR_OPTION_PRESERVE_SOURCE, it can be saved with
+// only the edited bytes changed, keeping comments and formatting:
+//
+//      SirIni ini = sir_load_from_file("foo.ini", 
+//              SIR_OPTION_PRESERVE_SOURCE, 0);
+//
+//      sir_set(ini, "graphics", "window_width", "2560");
+//
+//      sir_save(ini, "foo.ini");
+//
+// Overlays
+// ========
+//
+// INIs can be stacked so that each one overrides the ones below it, e.g.
+// defaults, then site, then host settings:
+//
+//      SirIni layers[] = { site, host };
+//      SirOverlay overlay = sir_overlay(defaults, layers, 2);
+//
+//      str = sir_overlay_str(overlay, "section_name", "key_name");
+//
+//      sir_free_overlay(overlay);
+//
+// A directory of INIs can be loaded as one INI, with later files (by name)
+// overriding earlier ones. Reloading only parses the files that changed:
+//
+//      SirDirectory dir = sir_load_directory("conf.d", "*.ini", 0, 0);
+//
+//      str = sir_section_str(dir->ini, "section_name", "key_name");
+//
+//      if (sir_reload_directory(dir))
+//          str = sir_section_str(dir->ini, "section_name", "key_name");
+//
+//      sir_free_directory(dir);
+//
+// Columns
+// =======
+//
+// The value of one key in every section that has it can be collected at 
+// once, optionally converted to doubles:
+//
+//      SirColumn column;
+//      SirIndex count = sir_column(ini, "key_name", &column);
+//
+//      const double *numbers = sir_column_numbers(ini, &column);
+//
+//      for (SirIndex i = 0; i < count; ++i)
+//          printf("%s: %s\n", ini->section_names[column.entries[i].section],
+//                  column.entries[i].value);
+//
+//      sir_free_column(ini, &column);
+//
+// Sections can also be found by the value of a key. Loading with
+// SIR_OPTION_INDEX_VALUES sorts the values so that queries don't have to
+// look at every key with the right name:
+//
+//      SirQuery query = { SIR_QUERY_EQUAL, "bPlaceable", "True", 0, 0 };
+//      count = sir_query(ini, &query, &column);
+//
+//      query.type = SIR_QUERY_RANGE;
+//      query.key_name = "HP";
+//      query.min = 5;
+//      query.max = 10;
+//      count = sir_query(ini, &query, &column);
+//
+//      sir_free_column(ini, &column);
+//
+// Every key with a given value, in any section, can be found through a 
+// table of values that is built by the first call:
+//
+//      count = sir_find_by_value(ini, "eItem_ArmorKevlar", &column);
+//
+//      sir_free_column(ini, &column);
+//
+// Binding to a Struct
+// ===================
+//
+// A schema describes where keys go in a struct, their type, their range
+// and whether they are required or have a default. sir_bind() checks and 
+// stores every key in one pass over the INI:
+//
+//      typedef struct Config { long width; double scale; const char *title; }
+//          Config;
+//
+//      static const SirField fields[] = {
+//          SIR_FIELD(Config, width, SIR_FIELD_LONG, "graphics", "width",
+//                  1, 640, 7680, 0),
+//          SIR_FIELD(Config, scale, SIR_FIELD_DOUBLE, "graphics", "scale",
+//                  0, 0, 0, "1.0"),
+//          SIR_FIELD(Config, title, SIR_FIELD_STR, "window", "title",
+//                  0, 0, 0, "Untitled"),
+//      };
+//
+//      SirSchema schema = SIR_SCHEMA(fields);
+//      Config config;
+//
+//      if (!sir_bind(ini, schema, &config))
+//          printf("%s\n", ini->error);
+//
+// Section Inheritance
+// ===================
+//
+// With SIR_OPTION_ENABLE_INHERITANCE, a section can be based on another one.
+// It has every key of its parent that it doesn't set itself:
+//
+//      [ unit ]
+//      hp = 10
+//      speed = 12
+//
+//      [ soldier : unit ]
+//      hp = 5                          ; speed is 12
+//
+// The keys of every section, inherited or not, are put in a table when the
+// INI is loaded, so an inherited key is found as quickly as any other.
+// sir_section_key_names() and sir_section_key_values() only return the keys
+// written in the section itself.
+//
+// Interpolation
+// =============
+//
+// With SIR_OPTION_ENABLE_INTERPOLATION, values can use the values of other
+// keys and environment variables:
+//
+//      [ paths ]
+//      root = /opt/app
+//      bin  = ${root}/bin              ; a key in the same section
+//      logs = ${global:log_dir}/app    ; a key in another section
+//      home = ${ENV:HOME}              ; an environment variable
+//      cost = $${price}                ; '$${' is a literal '${'
+//
+// A value is expanded the first time it is read and kept until it, or a key
+// it uses, is changed with sir_set() or sir_delete(). Reading a value whose
+// references can't be found or refer back to it returns 0 with an error.
+// sir_save() writes values as they were written, not expanded.
+//
+// Dialects
+// ========
+//
+// The characters used for comments, assignments, section names, quotes and
+// whitespace can be chosen when an INI is loaded, so one program can read
+// several dialects. A SirDialect gives the class of every byte:
+//
+//      SirDialect dialect;
+//      sir_dialect_init(&dialect, SIR_OPTION_NONE);
+//
+//      dialect.classes['#'] = SIR_CHAR_NONE;           // not a comment
+//      dialect.classes['|'] = SIR_CHAR_ASSIGNMENT;     // key | value
+//
+//      SirIni ini = sir_load_from_file_dialect("foo.ini", SIR_OPTION_NONE,
+//              &dialect, 0);
+//
+// Without a dialect, one is made from the options, e.g. 
+// SIR_OPTION_DISABLE_HASH_COMMENTS takes SIR_CHAR_COMMENT away from '#'.
+//
+// Escapes and Multi-line Values
+// =============================
+//
+// With SIR_OPTION_ENABLE_ESCAPES, values can use escapes and span lines:
+//
+//      greeting = "say \"hi\"\tthen leave\n"
+//      hash     = \#1                     ; '#1', not a comment
+//      message  = """
+//      Dear user,
+//          your order has shipped.
+//      """
+//
+// '\n', '\t', '\r', '\\' and '\' before a quote or comment character are 
+// replaced, and any other '\' is kept, so 'C:\dir' still reads as written.
+// A '\' at the end of a line continues the value on the next line, without 
+// that line's leading whitespace.
+//
+// Values are still not copied when the INI is loaded: a value with a '\' is 
+// decoded the first time it's read. sir_save() escapes values that need it.
+//
 // Custom Memory Management
 // ========================
 //
@@ -126,16 +345,46 @@
 //
 // By default the malloc, realloc and free macros above expand to the
 // stdlib functions and thus ignore the mem_ctx. It is purely optional.
+//
+// Section and Key Indices
+// =======================
+//
+// Sections and keys are counted and indexed with SirIndex, which is 
+// ptrdiff_t unless SIR_INDEX is defined before including this header. 
+// Defining it as int saves memory when no INI will have more than INT_MAX 
+// sections or keys; loading one that does then fails with an error.
+//
+// The sizes returned by sir_section_csv(), sir_section_key_names() and 
+// sir_section_key_values() are stored through a SirIndex pointer. These were
+// int pointers before SirIndex was added, so code that still passes an int
+// pointer should either switch to SirIndex or define SIR_INDEX as int.
 
 #ifndef SIMPLE_INI_READER_HEADER
 #define SIMPLE_INI_READER_HEADER
 
+// The implementation lists directories and stats files through POSIX where
+// it's available. Strict ISO C modes (e.g. -std=c99) hide those declarations
+// unless a feature-test macro is defined before the first system header, so
+// the implementation should be included before any other header.
+#if defined(SIMPLE_INI_READER_IMPLEMENTATION) && !defined(_WIN32) && \
+    defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE) && \
+    !defined(_XOPEN_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <math.h>
+#include <stddef.h>
+
+#ifndef SIR_INDEX
+#define SIR_INDEX ptrdiff_t
+#endif
+
+typedef SIR_INDEX SirIndex;
 
 typedef enum SirOptions
 {
@@ -159,7 +408,8 @@ typedef enum SirOptions
     // A line will only be a comment if '\n' is directly before the comment
     SIR_OPTION_DISABLE_COMMENT_ANYWHERE = 0x020,
 
-    // Both section names and key names and values will be case-insensitive
+    // Both section names and key names and values will be case-insensitive.
+    // Only ASCII letters are folded unless SIR_OPTION_FOLD_UNICODE is set.
     SIR_OPTION_DISABLE_CASE_SENSITIVITY = 0x040,
 
     // Will save a small amount of memory and may improve performance
@@ -169,23 +419,285 @@ typedef enum SirOptions
     // the string is done to detect warnings, and each warning string is
     // 512 bytes by default
     SIR_OPTION_DISABLE_WARNINGS         = 0x100,
+
+    // Keeps an unmodified copy of the INI so that changes made with sir_set()
+    // and sir_delete() can be written back with sir_save() without losing
+    // comments or formatting
+    SIR_OPTION_PRESERVE_SOURCE          = 0x200,
+
+    // Lines of the form '!include path' or '@include path' load another INI
+    // and merge its keys in as if they had been written there
+    SIR_OPTION_ENABLE_INCLUDES          = 0x400,
+
+    // Values can refer to other keys with '${section:key}' or '${key}', and
+    // to environment variables with '${ENV:VARIABLE}'. References are 
+    // expanded when a value is first read.
+    SIR_OPTION_ENABLE_INTERPOLATION     = 0x800,
+
+    // A section header of the form '[child : parent]' makes the section
+    // inherit every key of 'parent' that it doesn't have itself
+    SIR_OPTION_ENABLE_INHERITANCE       = 0x1000,
+
+    // Sorts every value when the INI is loaded so that sir_query() can use
+    // binary searches instead of looking at every key with the right name
+    SIR_OPTION_INDEX_VALUES             = 0x2000,
+
+    // Values can use '\' escapes, end a line with '\' to continue on the 
+    // next line, and span several lines in '"""'
+    SIR_OPTION_ENABLE_ESCAPES           = 0x4000,
+
+    // Adds a warning for every sequence of bytes that isn't valid UTF-8.
+    // Does nothing if warnings are disabled.
+    SIR_OPTION_VALIDATE_UTF8            = 0x8000,
+
+    // With SIR_OPTION_DISABLE_CASE_SENSITIVITY, UTF-8 letters outside ASCII
+    // are folded too, with Unicode simple case folding, so 'ÄRGER' matches
+    // 'ärger'. ASCII is still folded a byte at a time.
+    SIR_OPTION_FOLD_UNICODE             = 0x10000,
 }
 SirOptions;
 
+// The classes a character can have in a SirDialect. A character can be in 
+// more than one class.
+typedef enum SirCharClass
+{
+    SIR_CHAR_NONE          = 0x00,
+    SIR_CHAR_COMMENT       = 0x01,
+    SIR_CHAR_ASSIGNMENT    = 0x02,
+    SIR_CHAR_SECTION_OPEN  = 0x04,
+    SIR_CHAR_SECTION_CLOSE = 0x08,
+    SIR_CHAR_QUOTE         = 0x10,
+    SIR_CHAR_WHITESPACE    = 0x20,
+}
+SirCharClass;
+
+// The class of every byte, which decides how the parser treats it. Set up
+// with sir_dialect_init() and changed by writing to 'classes', e.g.
+// dialect.classes['|'] |= SIR_CHAR_ASSIGNMENT. '\0' always ends the data and
+// '\n' is always whitespace that ends a line, whatever their classes.
+typedef struct SirDialect
+{
+    unsigned char classes[256];
+}
+SirDialect;
+
 typedef struct SirSectionRange
 {
-    int start;
-    int end;
+    SirIndex start;
+    SirIndex end;
+
+    // Offset in ini->source of the end of the line containing the section
+    // header that started this range (SIR_OPTION_PRESERVE_SOURCE only), or -1
+    // if the range was added by sir_set()
+    ptrdiff_t header_end;
 }
 SirSectionRange;
 
 typedef struct SirSection
 {
     SirSectionRange *ranges;
-    int ranges_count;
+    SirIndex ranges_count;
 }
 SirSection;
 
+// Offsets in ini->source of a key's value and of the line containing it.
+// value_start is -1 if the key has no value (i.e. no '=')
+typedef struct SirKeySpan
+{
+    ptrdiff_t value_start;
+    ptrdiff_t value_end;
+    ptrdiff_t line_start;
+    ptrdiff_t line_end;
+}
+SirKeySpan;
+
+// An edit made by sir_set() or sir_delete(): the bytes [start, end) of 
+// ini->source are replaced by 'text' when the INI is saved
+typedef struct SirPatch
+{
+    ptrdiff_t start;
+    ptrdiff_t end;
+    char *text;
+    size_t text_size;
+}
+SirPatch;
+
+// Block of memory that strings added by sir_set() are stored in. The strings
+// follow the header.
+typedef struct SirArenaBlock
+{
+    struct SirArenaBlock *next;
+    size_t used;
+    size_t size;
+}
+SirArenaBlock;
+
+// An include directive found while parsing (SIR_OPTION_ENABLE_INCLUDES)
+typedef struct SirInclude
+{
+    char *path;
+    ptrdiff_t offset;
+
+    // How many keys had been parsed before the directive, and the section 
+    // it is in
+    SirIndex key_index;
+    SirIndex section;
+}
+SirInclude;
+
+// Slot of an open-addressing hash table. 'index' is an index into an array
+// owned by the table's user, or -1 if the slot is empty.
+typedef struct SirHashSlot
+{
+    unsigned int hash;
+    SirIndex index;
+}
+SirHashSlot;
+
+// A section that has the key asked for by sir_column(), and the key's value
+typedef struct SirColumnEntry
+{
+    SirIndex section;
+    SirIndex key;
+    const char *value;
+    size_t value_size;
+}
+SirColumnEntry;
+
+// Every value of one key, in the order the keys appear. 'numbers' is 0 until
+// sir_column_numbers() is called.
+typedef struct SirColumn
+{
+    SirColumnEntry *entries;
+    SirIndex count;
+    double *numbers;
+}
+SirColumn;
+
+// A key in the value index (SIR_OPTION_INDEX_VALUES)
+typedef struct SirValueEntry
+{
+    const char *name;
+    const char *value;
+    double number;
+    SirIndex key;
+}
+SirValueEntry;
+
+typedef enum SirQueryType
+{
+    // Values equal to 'value'
+    SIR_QUERY_EQUAL,
+
+    // Values that are numbers between 'min' and 'max', inclusive
+    SIR_QUERY_RANGE,
+
+    // Values that start with 'value'
+    SIR_QUERY_PREFIX,
+}
+SirQueryType;
+
+// Which values of the key 'key_name' sir_query() looks for
+typedef struct SirQuery
+{
+    SirQueryType type;
+    const char *key_name;
+    const char *value;
+    double min;
+    double max;
+}
+SirQuery;
+
+// The C type that a field of a schema is stored as
+typedef enum SirFieldType
+{
+    SIR_FIELD_STR,              // const char *, pointing into the INI
+    SIR_FIELD_LONG,             // long
+    SIR_FIELD_UNSIGNED_LONG,    // unsigned long
+    SIR_FIELD_DOUBLE,           // double
+    SIR_FIELD_BOOL,             // char
+}
+SirFieldType;
+
+// A key that sir_bind() stores in a struct, at 'offset' bytes from its 
+// start. Numbers outside ['min', 'max'] are errors, unless 'min' isn't less
+// than 'max'. If the key is missing, 'default_value' is converted instead, 
+// or it is an error if there is no default and the key is 'required'.
+typedef struct SirField
+{
+    const char *section_name;
+    const char *key_name;
+    SirFieldType type;
+    size_t offset;
+    char required;
+    double min;
+    double max;
+    const char *default_value;
+}
+SirField;
+
+typedef struct SirSchema
+{
+    const SirField *fields;
+    int fields_count;
+}
+SirSchema;
+
+// Fills in a SirField for the member 'member' of 'struct_type'
+#define SIR_FIELD(struct_type, member, type, section_name, key_name, \
+        required, min, max, default_value) \
+    { section_name, key_name, type, offsetof(struct_type, member), \
+        required, min, max, default_value }
+
+// Makes a SirSchema from an array of SirFields
+#define SIR_SCHEMA(fields) \
+    { fields, (int)(sizeof(fields) / sizeof(*(fields))) }
+
+// How far a section's key table has been built 
+// (SIR_OPTION_ENABLE_INHERITANCE)
+typedef enum SirInheritanceState
+{
+    SIR_INHERITANCE_NONE,
+    SIR_INHERITANCE_BUILDING,
+    SIR_INHERITANCE_BUILT,
+}
+SirInheritanceState;
+
+// The parent of a section and a table of every key the section has,
+// including the keys it inherits. The table holds key indices, so looking
+// up an inherited key doesn't walk up the parents.
+typedef struct SirInheritance
+{
+    const char *parent_name;
+    SirIndex parent;
+    SirHashSlot *slots;
+    size_t mask;
+    SirIndex keys_count;
+    SirInheritanceState state;
+}
+SirInheritance;
+
+// How far a value has been expanded (SIR_OPTION_ENABLE_INTERPOLATION)
+typedef enum SirInterpolationState
+{
+    SIR_INTERPOLATION_UNRESOLVED,
+    SIR_INTERPOLATION_RESOLVING,
+    SIR_INTERPOLATION_RESOLVED,
+}
+SirInterpolationState;
+
+// A key's value before its references were expanded, and the keys whose
+// expanded values used it, which have to be expanded again if it changes
+typedef struct SirInterpolation
+{
+    const char *raw_value;
+    SirIndex *dependents;
+    SirIndex dependents_count;
+    SirIndex dependents_size;
+    SirInterpolationState state;
+}
+SirInterpolation;
+
 typedef struct SirIniStruct
 {
     void *mem_ctx;
@@ -198,17 +710,191 @@ typedef struct SirIniStruct
     char *error;
     char *error_msg;
     const char **warnings;
-    int section_count;
-    int key_count;
+    SirIndex section_count;
+    SirIndex key_count;
     SirOptions options;
     int error_size;
     int warnings_count;
     int warnings_size;
+
+    // Allocated sizes of the section and key arrays, which grow when sir_set()
+    // adds sections and keys
+    SirIndex sections_size;
+    SirIndex keys_size;
+
+    // Names and values added by sir_set()
+    SirArenaBlock *arena;
+
+    // Built by the first sir_column() and thrown away when keys are added or
+    // removed: the section of every key, and the keys with each name chained
+    // together from a hash table
+    SirIndex *key_sections;
+    SirIndex *key_name_next;
+    SirHashSlot *key_name_slots;
+    size_t key_name_mask;
+
+    // Only used with SIR_OPTION_INDEX_VALUES: every key sorted by name and
+    // value, and the keys whose values are numbers sorted by name and
+    // number. Thrown away when the INI is edited and sorted again by the 
+    // next query.
+    SirValueEntry *sorted_values;
+    SirIndex sorted_values_count;
+    SirValueEntry *sorted_numbers;
+    SirIndex sorted_numbers_count;
+
+    // Built by the first sir_find_by_value() and thrown away when the INI is
+    // edited: the keys with each value chained together from a hash table
+    SirHashSlot *value_slots;
+    size_t value_mask;
+    SirIndex *value_next;
+
+    // Only used with SIR_OPTION_ENABLE_INHERITANCE. One per section.
+    SirInheritance *inheritance;
+
+    // Only used with SIR_OPTION_ENABLE_INTERPOLATION. One per key, created
+    // the first time a value is read.
+    SirInterpolation *interpolations;
+
+    // Only used while loading
+    SirInclude *includes;
+    int includes_count;
+    int includes_size;
+
+    // Only used with SIR_OPTION_PRESERVE_SOURCE. Patches are sorted by 
+    // their position in the source.
+    char *source;
+    ptrdiff_t source_size;
+    SirKeySpan *key_spans;
+    SirIndex source_key_count;
+    SirPatch *patches;
+    SirIndex patches_count;
+    SirIndex patches_size;
+
+    // How each character is treated by the parser
+    SirDialect dialect;
+
+    // Only used with SIR_OPTION_ENABLE_ESCAPES. 1 for each key whose value
+    // still has its escapes in it. They are decoded into the arena the first
+    // time the value is read.
+    char *escaped;
 }
 SirIniStruct;
 
 typedef SirIniStruct * SirIni;
 
+// Output buffer used by the functions that write to a FILE
+typedef struct SirBuffer
+{
+    FILE *file;
+    char *data;
+    size_t used;
+    size_t size;
+    char failed;
+}
+SirBuffer;
+
+typedef struct SirWriterStruct
+{
+    void *mem_ctx;
+    SirBuffer buffer;
+    const char *error;
+    char wrote_anything;
+}
+SirWriterStruct;
+
+typedef SirWriterStruct * SirWriter;
+
+// The layer whose key wins in an overlay, and where the key is in that layer
+typedef struct SirOverlayKey
+{
+    int layer;
+    SirIndex section;
+    SirIndex key;
+}
+SirOverlayKey;
+
+typedef struct SirOverlayStruct
+{
+    void *mem_ctx;
+    SirIni *layers;
+    int layers_count;
+    char case_insensitive;
+
+    // Winning keys by section and key name, and by key name only. Both 
+    // tables have the same power of two number of slots, minus 1 in 'mask'.
+    SirOverlayKey *section_keys;
+    SirHashSlot *section_key_slots;
+    SirOverlayKey *keys;
+    SirHashSlot *key_slots;
+    SirIndex section_keys_count;
+    SirIndex keys_count;
+    size_t mask;
+}
+SirOverlayStruct;
+
+typedef SirOverlayStruct * SirOverlay;
+
+// A file loaded by sir_load_directory(), and what it was like when it was 
+// parsed
+typedef struct SirDirectoryFile
+{
+    char *filename;
+    long long mtime;
+    long long size;
+    unsigned int hash;
+    SirIni ini;
+}
+SirDirectoryFile;
+
+typedef struct SirDirectoryStruct
+{
+    void *mem_ctx;
+    char *path;
+    char *pattern;
+    SirOptions options;
+
+    // Files sorted by name
+    SirDirectoryFile *files;
+    int files_count;
+
+    // Every file merged together
+    SirIni ini;
+
+    const char *error;
+}
+SirDirectoryStruct;
+
+typedef SirDirectoryStruct * SirDirectory;
+
+// A file in an include cache. 'device' and 'inode' identify the file if the
+// platform has inodes, otherwise the file is identified by 'path'. The same
+// file included with different options or a different dialect parses 
+// differently, so it has an entry for each.
+typedef struct SirCachedFile
+{
+    char *path;
+    long long device;
+    long long inode;
+    SirOptions options;
+    SirDialect dialect;
+    SirIni ini;
+
+    // Set while the file is being parsed, to detect include cycles
+    char loading;
+}
+SirCachedFile;
+
+typedef struct SirIncludeCacheStruct
+{
+    void *mem_ctx;
+    SirCachedFile *files;
+    int files_count;
+    int files_size;
+}
+SirIncludeCacheStruct;
+
+typedef SirIncludeCacheStruct * SirIncludeCache;
+
 #ifdef SIR_STATIC
 #define SIRDEF static
 #else
@@ -232,6 +918,36 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
 SIRDEF SirIni sir_load_from_file(const char *filename, SirOptions options, 
         void *mem_ctx);
 
+// Same as sir_load_from_file(), except that files included with 
+// SIR_OPTION_ENABLE_INCLUDES are parsed once and kept in 'cache', so loading
+// many INIs that include the same files only parses those files once. A file
+// included with different options or a different dialect is parsed again.
+SIRDEF SirIni sir_load_from_file_cached(const char *filename, 
+        SirOptions options, SirIncludeCache cache, void *mem_ctx);
+
+// Same as sir_load_from_str() and sir_load_from_file(), except that the 
+// characters used for comments, assignments, section names, quotes and 
+// whitespace are taken from 'dialect' instead of 'options'. Included files
+// are parsed with the same dialect.
+SIRDEF SirIni sir_load_from_str_dialect(char *s, SirOptions options, 
+        const SirDialect *dialect, const char *name, void *mem_ctx);
+SIRDEF SirIni sir_load_from_file_dialect(const char *filename, 
+        SirOptions options, const SirDialect *dialect, void *mem_ctx);
+
+// Sets up 'dialect' to parse the same way as loading with 'options' does:
+// ';' and '#' start comments, '=' and ':' are assignments, '"' is a quote
+// and every control character and space is whitespace, unless one of the
+// options disables them.
+SIRDEF void sir_dialect_init(SirDialect *dialect, SirOptions options);
+
+// Creates an empty cache for sir_load_from_file_cached(). Returns 0 if it
+// could not be allocated.
+SIRDEF SirIncludeCache sir_include_cache_create(void *mem_ctx);
+
+// Frees the cache and the INIs in it. INIs loaded with the cache don't 
+// depend on it and can still be used.
+SIRDEF void sir_free_include_cache(SirIncludeCache cache);
+
 // Frees the given ini.
 SIRDEF void sir_free_ini(SirIni ini);
 
@@ -268,7 +984,7 @@ SIRDEF char sir_section_bool(SirIni ini, const char *section_name,
 // pointed to by 'csv_size_ret'. Note that this function performs a memory
 // allocation.
 SIRDEF const char **sir_section_csv(const SirIni ini, 
-        const char *section_name, const char *key_name, int *csv_size_ret);
+        const char *section_name, const char *key_name, SirIndex *csv_size_ret);
 
 // Frees a CSV that was returned by the above function.
 SIRDEF void sir_free_csv(SirIni ini, const char **csv);
@@ -278,24 +994,186 @@ SIRDEF void sir_free_csv(SirIni ini, const char **csv);
 // pointed to by 'values_size_ret'. Note that this function performs a 
 // memory allocation.
 SIRDEF const char **sir_section_key_names(SirIni ini, 
-        const char *section_name, int *names_size_ret);
+        const char *section_name, SirIndex *names_size_ret);
 
 // Returns an array of all the key values that belong in the section 
 // 'section_name'. The size of the resulting array is stored in the location
 // pointed to by 'values_size_ret'. Note that this function performs a 
 // memory allocation.
 SIRDEF const char **sir_section_key_values(SirIni ini, 
-        const char *section_name, int *values_size_ret);
+        const char *section_name, SirIndex *values_size_ret);
 
 // Used to free the arrays given by sir_section_key_names() and 
 // sir_section_key_values(). This is simply wrapper for the SIR_FREE()
 // macro, but is required to give the macro the memory context.
 SIRDEF void sir_free(SirIni ini, void *mem);
 
+// Finds every section that has a key named 'key_name' and stores the 
+// sections and values in 'column', in the order the keys appear. Returns the
+// number of entries, which is 0 if no section has the key. Keys are found 
+// through a table of key names that is built by the first call, so each call
+// only costs as much as the number of keys it finds. The column must be 
+// freed with sir_free_column().
+SIRDEF SirIndex sir_column(SirIni ini, const char *key_name, SirColumn *column);
+
+// Converts every value in the column with strtod() and returns the numbers,
+// which are also kept in column->numbers. Values that can't be converted 
+// are NAN.
+SIRDEF const double *sir_column_numbers(SirIni ini, SirColumn *column);
+
+// Frees the arrays in a column filled in by sir_column().
+SIRDEF void sir_free_column(SirIni ini, SirColumn *column);
+
+// Finds the sections whose key 'query->key_name' has a value equal to 
+// 'query->value', starting with 'query->value', or that is a number in the
+// range ['query->min', 'query->max'], depending on 'query->type'. The 
+// results are stored in 'result' like sir_column() does, and the number of
+// them is returned. With SIR_OPTION_INDEX_VALUES, the results are found with
+// a binary search of the values, which are sorted when the INI is loaded. 
+// Otherwise only the keys named 'query->key_name' are looked at. The result
+// must be freed with sir_free_column().
+SIRDEF SirIndex sir_query(SirIni ini, const SirQuery *query, SirColumn *result);
+
+// Finds every key whose value is 'value', in any section, and stores them in
+// 'result' like sir_column() does. Returns the number of keys found. The 
+// first call builds a table of every value, so later calls only cost as much
+// as the number of keys they find. The result must be freed with 
+// sir_free_column().
+SIRDEF SirIndex sir_find_by_value(SirIni ini, const char *value, 
+        SirColumn *result);
+
+// Converts every key described by 'schema' and stores it in the struct 
+// 'out', in one pass over the keys of the INI. Keys that aren't in the 
+// schema are ignored, and fields whose keys are missing and have no default 
+// are left alone. Returns 1 on success. Stops at the first key that can't be
+// converted, is out of range, or is required but missing, and returns 0 with
+// an error.
+SIRDEF char sir_bind(SirIni ini, SirSchema schema, void *out);
+
 // Returns 1 if there is an error. SIR Functions will always clear the error
 // on success.
 SIRDEF char sir_has_error(SirIni ini);
 
+// Sets the value of the key 'key_name' in the section 'section_name' to 
+// 'value', adding the key (and the section) if it doesn't exist. The new value
+// is copied and is returned by lookups straight away. Copies are kept in an
+// arena that is only freed by sir_free_ini(), so setting the same key many
+// times keeps using more memory.
+SIRDEF void sir_set(SirIni ini, const char *section_name, 
+        const char *key_name, const char *value);
+
+// Removes the key 'key_name' from the section 'section_name'.
+SIRDEF void sir_delete(SirIni ini, const char *section_name, 
+        const char *key_name);
+
+// Writes the INI, with every change made by sir_set() and sir_delete(), to 
+// the file 'filename'. If the INI was loaded with SIR_OPTION_PRESERVE_SOURCE,
+// the original text is copied and only the edited bytes change. Otherwise
+// every section and key is written out, and comments are lost.
+SIRDEF void sir_save(SirIni ini, const char *filename);
+
+// Writes 'ini' to 'file' as a JSON object that maps each section name to an
+// object of key names and values. The global section is only written if it
+// contains keys. Sets an error if 'file' could not be written to.
+SIRDEF void sir_write_json(SirIni ini, FILE *file);
+
+// Writes 'ini' to 'file' as NDJSON (newline-delimited JSON), with one object
+// per line of the form {"section":"...","key":"...","value":"..."}. Sets an
+// error if 'file' could not be written to.
+SIRDEF void sir_write_ndjson(SirIni ini, FILE *file);
+
+// Creates a writer that writes an INI to 'file'. Output is collected in a
+// buffer of SIR_WRITE_BUFFER_SIZE bytes, so nothing is guaranteed to reach
+// 'file' until sir_writer_flush() or sir_free_writer() is called. Returns 0
+// if the writer could not be allocated.
+SIRDEF SirWriter sir_writer_create(FILE *file, void *mem_ctx);
+
+// Flushes and frees the given writer. This does not close the FILE.
+SIRDEF void sir_free_writer(SirWriter writer);
+
+// Writes everything in the writer's buffer to its FILE.
+SIRDEF void sir_writer_flush(SirWriter writer);
+
+// Writes the header of a section named 'section_name'. Any keys written 
+// afterwards belong to this section.
+SIRDEF void sir_writer_section(SirWriter writer, const char *section_name);
+
+// Writes a key named 'key_name' with the value 'value'. The value is only
+// surrounded by double-quotes if it has leading or trailing whitespace.
+SIRDEF void sir_writer_key(SirWriter writer, const char *key_name, 
+        const char *value);
+
+// Write a key whose value is converted from the given type. Integers are
+// converted without printf(), as are doubles that have a short decimal
+// representation. Other doubles are written with enough digits to be read
+// back exactly.
+SIRDEF void sir_writer_long(SirWriter writer, const char *key_name, 
+        long value);
+SIRDEF void sir_writer_unsigned_long(SirWriter writer, const char *key_name, 
+        unsigned long value);
+SIRDEF void sir_writer_double(SirWriter writer, const char *key_name, 
+        double value);
+SIRDEF void sir_writer_bool(SirWriter writer, const char *key_name, 
+        char value);
+
+// Writes a comment line.
+SIRDEF void sir_writer_comment(SirWriter writer, const char *comment);
+
+// Returns 1 if any function called on 'writer' has failed, which happens if
+// the FILE could not be written to, or if a name or value can't be 
+// represented in an INI (e.g. a value containing a newline or a comment 
+// character). The reason is stored in writer->error. Unlike the SirIni 
+// functions, the error is not cleared by later calls.
+SIRDEF char sir_writer_has_error(SirWriter writer);
+
+// Creates a view of 'base' with the INIs in 'overrides' stacked on top of it.
+// A lookup returns the value from the last INI in 'overrides' that defines
+// the key, or from 'base' if none of them do. Which INI wins is worked out
+// for every key here, so a lookup takes the same time however many INIs
+// there are. Null INIs in 'overrides' are skipped. The INIs are not copied
+// and must outlive the overlay. A value changed with sir_set() is seen by the
+// overlay, but keys added or deleted afterwards are not; create the overlay
+// again to see them. Names are case-insensitive if 'base' was loaded with
+// SIR_OPTION_DISABLE_CASE_SENSITIVITY. Returns 0 if memory could not be 
+// allocated.
+SIRDEF SirOverlay sir_overlay(SirIni base, SirIni *overrides, 
+        int overrides_count);
+
+// Frees the given overlay, but not the INIs in it.
+SIRDEF void sir_free_overlay(SirOverlay overlay);
+
+// Retrieves the winning value of the key 'key_name' in the section 
+// 'section_name'. If 'section_name' is 0, the key is searched for in every 
+// section, like sir_str(). Returns 0 if no INI defines the key.
+SIRDEF const char *sir_overlay_str(SirOverlay overlay, 
+        const char *section_name, const char *key_name);
+
+// Returns the index of the INI that the value of a key comes from: 0 for
+// 'base' and i + 1 for overrides[i]. Returns -1 if no INI defines the key.
+SIRDEF int sir_overlay_layer(SirOverlay overlay, const char *section_name, 
+        const char *key_name);
+
+// Loads every file in the directory 'path' whose name matches 'pattern' and
+// merges them into one INI, directory->ini. 'pattern' may use '*' and '?', 
+// e.g. "*.ini", or be 0 to load every file. Names that start with '.' are 
+// left out. Files are merged in the order of their names as compared by 
+// strcmp(), so the value of a key comes from the last file that sets it, 
+// while sections and keys keep the order they first appear in. Each file is
+// parsed with 'options'. If the directory can't be read, directory->ini is
+// empty and has an error. Returns 0 if memory could not be allocated.
+SIRDEF SirDirectory sir_load_directory(const char *path, const char *pattern,
+        SirOptions options, void *mem_ctx);
+
+// Checks the directory for files that have been added, removed or changed 
+// since it was loaded, and merges the files again if there are any. Only 
+// files whose modification time or size changed are read, and only those 
+// whose contents changed are parsed again. Returns 1 if directory->ini was 
+// replaced, in which case the old one has been freed.
+SIRDEF char sir_reload_directory(SirDirectory directory);
+
+// Frees the directory, its files and the merged INI.
+SIRDEF void sir_free_directory(SirDirectory directory);
+
 // These macros can be used to search through all the keys in an INI.
 #define sir_str(ini, key_name) sir_section_str(ini, 0, key_name)
 
@@ -335,6 +1213,16 @@ SIRDEF char sir_has_error(SirIni ini);
 #define SIR_WARNINGS_SIZE_INCR 5
 #endif
 
+// Size of the buffer used by the functions that write to a FILE
+#ifndef SIR_WRITE_BUFFER_SIZE
+#define SIR_WRITE_BUFFER_SIZE 65536
+#endif
+
+// Size of each block of the arena that holds strings added by sir_set()
+#ifndef SIR_ARENA_BLOCK_SIZE
+#define SIR_ARENA_BLOCK_SIZE 16384
+#endif
+
 #ifndef SIR_COMMENT_CHAR
 #define SIR_COMMENT_CHAR ';'
 #endif
@@ -358,31 +1246,183 @@ SIRDEF char sir_has_error(SirIni ini);
 // 'PRIVATE' FUNCTIONS
 // ===================
 static char sir__to_lowercase(char c);
+static char sir__folding(SirOptions options);
+static unsigned long sir__fold_code_point(unsigned long c);
+static unsigned long sir__next_folded(const char **str);
+static unsigned long sir__next_char(const char **str, char folding);
 static char sir__str_equal_case(const char *s1, 
         const char *s2, char case_insensitive);
 static char sir__str_equal(const SirIni ini, const char *s1, const char *s2);
 static char sir__is_comment_char(const SirIni ini, char c);
-static char sir__is_assignment_char(const SirIni ini, char c);
-static int sir__skip_whitespace(const char *str);
+static unsigned char sir__char_class(const SirIni ini, char c);
+static ptrdiff_t sir__skip_whitespace(const char *str);
 static char *sir__trim_whitespace(char *str);
-static int sir__skip_to_char(const char *str, char c);
-static int sir__parse_to_char(char *str, char c, char **parsed_str_ret);
-static int sir__parse_to_assignment_char(const SirIni ini, char *str, 
-        char **parsed_str_ret);
-static void sir__add_to_char_counts(char c, int *line_number, 
-        int *char_number);
+static ptrdiff_t sir__skip_dialect_whitespace(const SirIni ini, 
+        const char *str);
+static char *sir__trim_dialect_whitespace(const SirIni ini, char *str);
+static ptrdiff_t sir__skip_to_char(const char *str, char c);
+static ptrdiff_t sir__parse_to_class(const SirIni ini, char *str, 
+        unsigned char classes, char **parsed_str_ret);
+static ptrdiff_t sir__find_closing_quote(const char *str, char quote, 
+        int count);
+static ptrdiff_t sir__find_value_end(const char *str, char escapes);
+static void sir__unescape(SirIni ini, SirIndex index);
+static char *sir__escape_value(SirIni ini, const char *value);
+static void sir__add_to_char_counts(char c, long long *line_number, 
+        long long *char_number);
+static int sir__utf8_sequence_size(const unsigned char *str, size_t left);
+static void sir__validate_utf8(SirIni ini);
 static char sir__warnings_enabled(SirIni ini);
 static char sir__errors_enabled(SirIni ini);
-static void sir__add_warning(SirIni ini, int line_number, int char_number,
-        const char *msg);
+static void sir__add_warning(SirIni ini, long long line_number, 
+        long long char_number, const char *msg);
 static void sir__set_error(SirIni ini, const char *format, const char *s1, 
         const char *s2);
 static void sir__clear_error_str(SirIni ini);
 static SirIni sir__create_ini(char disable_errors, 
         char disable_warnings, void *mem_ctx);
 SIRDEF SirSection *sir__get_section(SirIni ini, const char *section_name);
+static long sir__str_to_long(SirIni ini, const char *str);
+static unsigned long sir__str_to_unsigned_long(SirIni ini, const char *str);
+static double sir__str_to_double(SirIni ini, const char *str);
+static char sir__str_to_bool(SirIni ini, const char *str);
+static SirIndex sir__section_index(SirIni ini, const char *section_name);
+static SirIndex sir__section_key_index(SirIni ini, SirSection *section, 
+        const char *key_name);
+static ptrdiff_t sir__source_line_start(SirIni ini, ptrdiff_t offset);
+static ptrdiff_t sir__source_line_end(SirIni ini, ptrdiff_t offset);
+static void sir__set_key_span(SirIni ini, SirIndex index, const char *key_name,
+        const char *key_value);
+static char *sir__arena_alloc(SirIni ini, size_t size);
+static const char *sir__arena_strdup(SirIni ini, const char *str);
+static SirIndex sir__add_section(SirIni ini, const char *section_name);
+static void sir__add_key(SirIni ini, SirIndex section_index, 
+        const char *key_name, const char *value);
+static char *sir__join(SirIni ini, const char **parts, int parts_count, 
+        size_t *size_ret);
+static SirPatch *sir__add_patch(SirIni ini, ptrdiff_t start, ptrdiff_t end, 
+        char *text, size_t text_size);
+static void sir__free_patch(SirIni ini, SirPatch *patch);
+static char sir__check_editable(SirIni ini, const char *section_name,
+        const char *key_name);
+static void sir__patch_value(SirIni ini, SirIndex index, const char *key_name, 
+        const char *value);
+static ptrdiff_t sir__section_insert_position(SirIni ini, 
+        SirSection *section);
+static char sir__section_has_keys(SirIni ini, SirIndex section_index, 
+        SirIndex first_key);
+static void sir__save_write(SirBuffer *buffer, const char *data, 
+        size_t size, char *last);
+static void sir__save_section(SirIni ini, SirBuffer *buffer, 
+        SirIndex section_index, SirIndex first_key, char header, char *last);
 static const char **sir__section_key_array(SirIni ini, 
-        const char *section_name, int *size_ret, const char **key_array);
+        const char *section_name, SirIndex *size_ret, const char **key_array);
+
+static void sir__buffer_init(SirBuffer *buffer, FILE *file, 
+        size_t size, void *mem_ctx);
+static void sir__buffer_flush(SirBuffer *buffer);
+static void sir__buffer_free(SirBuffer *buffer, void *mem_ctx);
+static void sir__buffer_write(SirBuffer *buffer, const char *data, 
+        size_t size);
+static void sir__buffer_write_str(SirBuffer *buffer, const char *str);
+static size_t sir__json_safe_prefix(const char *str, size_t size);
+static void sir__buffer_write_json_str(SirBuffer *buffer, const char *str);
+static char sir__representable(const char *str, const char *forbidden, 
+        char allow_outer_whitespace);
+static char sir__writer_valid(SirWriter writer, const char *str, 
+        const char *forbidden, char allow_outer_whitespace, const char *error);
+static int sir__format_unsigned(char *end, unsigned long long value);
+static void sir__writer_line(SirWriter writer, const char *name, 
+        const char *value, size_t value_size, char quoted);
+
+static unsigned int sir__hash_str(unsigned int hash, const char *str, 
+        char case_insensitive);
+static SirHashSlot *sir__hash_slots_create(SirIndex count, size_t *mask_ret,
+        void *mem_ctx);
+static const char *sir__overlay_section_name(SirOverlay overlay, 
+        const SirOverlayKey *key);
+static const char *sir__overlay_key_name(SirOverlay overlay, 
+        const SirOverlayKey *key);
+static SirHashSlot *sir__overlay_slot(SirOverlay overlay, unsigned int hash,
+        const char *section_name, const char *key_name);
+static SirOverlayKey *sir__overlay_find(SirOverlay overlay, 
+        const char *section_name, const char *key_name);
+
+static char *sir__read_file(const char *filename, size_t *size_ret,
+        const char **error_ret, void *mem_ctx);
+static size_t sir__utf16le_to_utf8(char *dest, const unsigned char *src, 
+        size_t size);
+static unsigned int sir__hash_bytes(unsigned int hash, const char *data, 
+        size_t size);
+static char sir__glob_match(const char *pattern, const char *str);
+static int sir__compare_strings(const void *a, const void *b);
+static char **sir__list_directory(const char *path, const char *pattern,
+        int *count_ret, void *mem_ctx);
+static void sir__free_directory_file(SirDirectory directory, 
+        SirDirectoryFile *file);
+static int sir__scan_directory(SirDirectory directory);
+static SirIni sir__merge_directory(SirDirectory directory);
+
+static SirIni sir__load_from_str(char *s, SirOptions options, 
+        const SirDialect *dialect, const char *name, void *mem_ctx, 
+        SirIncludeCache cache);
+static SirIni sir__load_file(const char *filename, SirOptions options, 
+        const SirDialect *dialect, SirIncludeCache cache, void *mem_ctx);
+static char sir__is_include_directive(const char *str);
+static char *sir__add_include(SirIni ini, char *str);
+static char *sir__include_path(SirIni ini, const char *path);
+static int sir__cached_file(SirIncludeCache cache, const char *path,
+        SirOptions options, const SirDialect *dialect);
+static void sir__apply_includes(SirIni ini, SirIncludeCache cache);
+
+static SirIndex sir__key_section(SirIni ini, SirIndex index);
+static const char *sir__raw_value(SirIni ini, SirIndex index);
+static const char *sir__value(SirIni ini, SirIndex index);
+static char sir__create_interpolations(SirIni ini);
+static void sir__add_dependent(SirIni ini, SirIndex index, SirIndex dependent);
+static void sir__invalidate(SirIni ini, SirIndex index);
+static char sir__append(SirIni ini, char **str, size_t *size, 
+        size_t *capacity, const char *data, size_t data_size);
+static const char *sir__reference(SirIni ini, SirIndex index, const char *name);
+static const char *sir__interpolate(SirIni ini, SirIndex index);
+
+static SirHashSlot *sir__inheritance_slot(SirIni ini, 
+        SirInheritance *inheritance, unsigned int hash, const char *key_name);
+static char sir__inherit(SirIni ini, SirIndex section_index);
+static void sir__build_inheritance(SirIni ini);
+static SirIndex sir__find_key(SirIni ini, SirIndex section_index, 
+        const char *key_name);
+
+static void sir__free_key_name_index(SirIni ini);
+static SirHashSlot *sir__key_name_slot(SirIni ini, unsigned int hash, 
+        const char *key_name);
+static char sir__build_key_name_index(SirIni ini);
+
+static int sir__str_compare(const char *s1, const char *s2, 
+        char case_insensitive);
+static char sir__has_prefix(const char *str, const char *prefix, 
+        char case_insensitive);
+static char sir__parse_number(const char *str, double *number_ret);
+static int sir__value_entry_compare(SirIni ini, const SirValueEntry *a, 
+        const SirValueEntry *b, char numbers);
+static void sir__sort_value_entries(SirIni ini, SirValueEntry *entries, 
+        SirIndex count, char numbers);
+static void sir__free_value_index(SirIni ini);
+static char sir__build_value_index(SirIni ini);
+static SirIndex sir__value_lower_bound(SirIni ini, 
+        const SirValueEntry *entries, SirIndex count, 
+        const SirValueEntry *target, char numbers);
+static int sir__compare_column_entries(const void *a, const void *b);
+static char sir__query_match(SirIni ini, const SirQuery *query, 
+        const char *value);
+static SirHashSlot *sir__value_slot(SirIni ini, unsigned int hash, 
+        const char *value);
+static char sir__build_value_table(SirIni ini);
+
+static char sir__bind_value(SirIni ini, const SirField *field, 
+        const char *str, void *out);
+static unsigned int sir__field_hash(SirIni ini, const char *section_name,
+        const char *key_name);
 
 
 // 'PRIVATE' MACROS
@@ -393,6 +1433,15 @@ static const char **sir__section_key_array(SirIni ini,
 #define SIR__BOOL_TRUE_STRING        "true"
 #define SIR__BOOL_FALSE_STRING       "false"
 #define SIR__INI_NO_FILENAME_STRING  "ini"
+#define SIR__HASH_SEED               2166136261u
+#define SIR__HASH_PRIME              16777619u
+#define SIR__FOLD_ASCII              1
+#define SIR__FOLD_UNICODE            2
+
+// The largest value of SirIndex, which is a signed integer type
+#define SIR__INDEX_MAX                                                      \
+    ((SirIndex)((((SirIndex)1 << (sizeof(SirIndex) * CHAR_BIT - 2)) - 1)     \
+            * 2 + 1))
 
 #endif // SIMPLE_INI_READER_HEADER
 
@@ -400,79 +1449,280 @@ static const char **sir__section_key_array(SirIni ini,
 
 #ifdef SIMPLE_INI_READER_IMPLEMENTATION
 
+// Used by sir_load_directory(). SIR__HAS_FILE_SYSTEM is only defined where
+// directories can be listed and files stat()ed; elsewhere loading a 
+// directory fails with an error.
+#if defined(_WIN32)
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef S_ISREG
+#define S_ISREG(mode) (((mode) & S_IFMT) == S_IFREG)
+#endif
+
+#define SIR__HAS_FILE_SYSTEM
+#elif defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#include <unistd.h>
+
+#if defined(_POSIX_VERSION) && (defined(_POSIX_C_SOURCE) || \
+        defined(_XOPEN_SOURCE) || !defined(__STRICT_ANSI__))
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define SIR__HAS_FILE_SYSTEM
+#endif
+#endif
+
 static char sir__to_lowercase(char c)
 {
     if (c >= 'a' && c <= 'z') return c - ('a' - 'A');
     else                      return c;
 }
 
-static char sir__str_equal_case(const char *s1, 
-        const char *s2, char case_insensitive)
+// Returns how names are compared with 'options': 0 for case-sensitive, 
+// SIR__FOLD_ASCII or SIR__FOLD_UNICODE
+static char sir__folding(SirOptions options)
 {
-    if      (!s1 && !s2) return 1;
-    else if (!s1 || !s2) return 0;
+    if (!(options & SIR_OPTION_DISABLE_CASE_SENSITIVITY)) return 0;
 
-    char c1, c2;
+    return (options & SIR_OPTION_FOLD_UNICODE) ? 
+        SIR__FOLD_UNICODE : SIR__FOLD_ASCII;
+}
 
-    while (*s1 && *s2)
+// The code points that Unicode simple case folding changes, from Unicode 
+// 14.0, as { first, last, difference, step }: every 'step'th code point from
+// 'first' to 'last' folds to itself plus 'difference'
+static const long sir__fold_ranges[][4] = {
+    { 0x000B5, 0x000B5,    775, 1 }, { 0x000C0, 0x000D6,     32, 1 },
+    { 0x000D8, 0x000DE,     32, 1 }, { 0x00100, 0x0012E,      1, 2 },
+    { 0x00132, 0x00136,      1, 2 }, { 0x00139, 0x00147,      1, 2 },
+    { 0x0014A, 0x00176,      1, 2 }, { 0x00178, 0x00178,   -121, 1 },
+    { 0x00179, 0x0017D,      1, 2 }, { 0x0017F, 0x0017F,   -268, 1 },
+    { 0x00181, 0x00181,    210, 1 }, { 0x00182, 0x00184,      1, 2 },
+    { 0x00186, 0x00186,    206, 1 }, { 0x00187, 0x00187,      1, 1 },
+    { 0x00189, 0x0018A,    205, 1 }, { 0x0018B, 0x0018B,      1, 1 },
+    { 0x0018E, 0x0018E,     79, 1 }, { 0x0018F, 0x0018F,    202, 1 },
+    { 0x00190, 0x00190,    203, 1 }, { 0x00191, 0x00191,      1, 1 },
+    { 0x00193, 0x00193,    205, 1 }, { 0x00194, 0x00194,    207, 1 },
+    { 0x00196, 0x00196,    211, 1 }, { 0x00197, 0x00197,    209, 1 },
+    { 0x00198, 0x00198,      1, 1 }, { 0x0019C, 0x0019C,    211, 1 },
+    { 0x0019D, 0x0019D,    213, 1 }, { 0x0019F, 0x0019F,    214, 1 },
+    { 0x001A0, 0x001A4,      1, 2 }, { 0x001A6, 0x001A6,    218, 1 },
+    { 0x001A7, 0x001A7,      1, 1 }, { 0x001A9, 0x001A9,    218, 1 },
+    { 0x001AC, 0x001AC,      1, 1 }, { 0x001AE, 0x001AE,    218, 1 },
+    { 0x001AF, 0x001AF,      1, 1 }, { 0x001B1, 0x001B2,    217, 1 },
+    { 0x001B3, 0x001B5,      1, 2 }, { 0x001B7, 0x001B7,    219, 1 },
+    { 0x001B8, 0x001B8,      1, 1 }, { 0x001BC, 0x001BC,      1, 1 },
+    { 0x001C4, 0x001C4,      2, 1 }, { 0x001C5, 0x001C5,      1, 1 },
+    { 0x001C7, 0x001C7,      2, 1 }, { 0x001C8, 0x001C8,      1, 1 },
+    { 0x001CA, 0x001CA,      2, 1 }, { 0x001CB, 0x001DB,      1, 2 },
+    { 0x001DE, 0x001EE,      1, 2 }, { 0x001F1, 0x001F1,      2, 1 },
+    { 0x001F2, 0x001F4,      1, 2 }, { 0x001F6, 0x001F6,    -97, 1 },
+    { 0x001F7, 0x001F7,    -56, 1 }, { 0x001F8, 0x0021E,      1, 2 },
+    { 0x00220, 0x00220,   -130, 1 }, { 0x00222, 0x00232,      1, 2 },
+    { 0x0023A, 0x0023A,  10795, 1 }, { 0x0023B, 0x0023B,      1, 1 },
+    { 0x0023D, 0x0023D,   -163, 1 }, { 0x0023E, 0x0023E,  10792, 1 },
+    { 0x00241, 0x00241,      1, 1 }, { 0x00243, 0x00243,   -195, 1 },
+    { 0x00244, 0x00244,     69, 1 }, { 0x00245, 0x00245,     71, 1 },
+    { 0x00246, 0x0024E,      1, 2 }, { 0x00345, 0x00345,    116, 1 },
+    { 0x00370, 0x00372,      1, 2 }, { 0x00376, 0x00376,      1, 1 },
+    { 0x0037F, 0x0037F,    116, 1 }, { 0x00386, 0x00386,     38, 1 },
+    { 0x00388, 0x0038A,     37, 1 }, { 0x0038C, 0x0038C,     64, 1 },
+    { 0x0038E, 0x0038F,     63, 1 }, { 0x00391, 0x003A1,     32, 1 },
+    { 0x003A3, 0x003AB,     32, 1 }, { 0x003C2, 0x003C2,      1, 1 },
+    { 0x003CF, 0x003CF,      8, 1 }, { 0x003D0, 0x003D0,    -30, 1 },
+    { 0x003D1, 0x003D1,    -25, 1 }, { 0x003D5, 0x003D5,    -15, 1 },
+    { 0x003D6, 0x003D6,    -22, 1 }, { 0x003D8, 0x003EE,      1, 2 },
+    { 0x003F0, 0x003F0,    -54, 1 }, { 0x003F1, 0x003F1,    -48, 1 },
+    { 0x003F4, 0x003F4,    -60, 1 }, { 0x003F5, 0x003F5,    -64, 1 },
+    { 0x003F7, 0x003F7,      1, 1 }, { 0x003F9, 0x003F9,     -7, 1 },
+    { 0x003FA, 0x003FA,      1, 1 }, { 0x003FD, 0x003FF,   -130, 1 },
+    { 0x00400, 0x0040F,     80, 1 }, { 0x00410, 0x0042F,     32, 1 },
+    { 0x00460, 0x00480,      1, 2 }, { 0x0048A, 0x004BE,      1, 2 },
+    { 0x004C0, 0x004C0,     15, 1 }, { 0x004C1, 0x004CD,      1, 2 },
+    { 0x004D0, 0x0052E,      1, 2 }, { 0x00531, 0x00556,     48, 1 },
+    { 0x010A0, 0x010C5,   7264, 1 }, { 0x010C7, 0x010C7,   7264, 1 },
+    { 0x010CD, 0x010CD,   7264, 1 }, { 0x013F8, 0x013FD,     -8, 1 },
+    { 0x01C80, 0x01C80,  -6222, 1 }, { 0x01C81, 0x01C81,  -6221, 1 },
+    { 0x01C82, 0x01C82,  -6212, 1 }, { 0x01C83, 0x01C84,  -6210, 1 },
+    { 0x01C85, 0x01C85,  -6211, 1 }, { 0x01C86, 0x01C86,  -6204, 1 },
+    { 0x01C87, 0x01C87,  -6180, 1 }, { 0x01C88, 0x01C88,  35267, 1 },
+    { 0x01C90, 0x01CBA,  -3008, 1 }, { 0x01CBD, 0x01CBF,  -3008, 1 },
+    { 0x01E00, 0x01E94,      1, 2 }, { 0x01E9B, 0x01E9B,    -58, 1 },
+    { 0x01E9E, 0x01E9E,  -7615, 1 }, { 0x01EA0, 0x01EFE,      1, 2 },
+    { 0x01F08, 0x01F0F,     -8, 1 }, { 0x01F18, 0x01F1D,     -8, 1 },
+    { 0x01F28, 0x01F2F,     -8, 1 }, { 0x01F38, 0x01F3F,     -8, 1 },
+    { 0x01F48, 0x01F4D,     -8, 1 }, { 0x01F59, 0x01F5F,     -8, 2 },
+    { 0x01F68, 0x01F6F,     -8, 1 }, { 0x01F88, 0x01F8F,     -8, 1 },
+    { 0x01F98, 0x01F9F,     -8, 1 }, { 0x01FA8, 0x01FAF,     -8, 1 },
+    { 0x01FB8, 0x01FB9,     -8, 1 }, { 0x01FBA, 0x01FBB,    -74, 1 },
+    { 0x01FBC, 0x01FBC,     -9, 1 }, { 0x01FBE, 0x01FBE,  -7173, 1 },
+    { 0x01FC8, 0x01FCB,    -86, 1 }, { 0x01FCC, 0x01FCC,     -9, 1 },
+    { 0x01FD8, 0x01FD9,     -8, 1 }, { 0x01FDA, 0x01FDB,   -100, 1 },
+    { 0x01FE8, 0x01FE9,     -8, 1 }, { 0x01FEA, 0x01FEB,   -112, 1 },
+    { 0x01FEC, 0x01FEC,     -7, 1 }, { 0x01FF8, 0x01FF9,   -128, 1 },
+    { 0x01FFA, 0x01FFB,   -126, 1 }, { 0x01FFC, 0x01FFC,     -9, 1 },
+    { 0x02126, 0x02126,  -7517, 1 }, { 0x0212A, 0x0212A,  -8383, 1 },
+    { 0x0212B, 0x0212B,  -8262, 1 }, { 0x02132, 0x02132,     28, 1 },
+    { 0x02160, 0x0216F,     16, 1 }, { 0x02183, 0x02183,      1, 1 },
+    { 0x024B6, 0x024CF,     26, 1 }, { 0x02C00, 0x02C2F,     48, 1 },
+    { 0x02C60, 0x02C60,      1, 1 }, { 0x02C62, 0x02C62, -10743, 1 },
+    { 0x02C63, 0x02C63,  -3814, 1 }, { 0x02C64, 0x02C64, -10727, 1 },
+    { 0x02C67, 0x02C6B,      1, 2 }, { 0x02C6D, 0x02C6D, -10780, 1 },
+    { 0x02C6E, 0x02C6E, -10749, 1 }, { 0x02C6F, 0x02C6F, -10783, 1 },
+    { 0x02C70, 0x02C70, -10782, 1 }, { 0x02C72, 0x02C72,      1, 1 },
+    { 0x02C75, 0x02C75,      1, 1 }, { 0x02C7E, 0x02C7F, -10815, 1 },
+    { 0x02C80, 0x02CE2,      1, 2 }, { 0x02CEB, 0x02CED,      1, 2 },
+    { 0x02CF2, 0x02CF2,      1, 1 }, { 0x0A640, 0x0A66C,      1, 2 },
+    { 0x0A680, 0x0A69A,      1, 2 }, { 0x0A722, 0x0A72E,      1, 2 },
+    { 0x0A732, 0x0A76E,      1, 2 }, { 0x0A779, 0x0A77B,      1, 2 },
+    { 0x0A77D, 0x0A77D, -35332, 1 }, { 0x0A77E, 0x0A786,      1, 2 },
+    { 0x0A78B, 0x0A78B,      1, 1 }, { 0x0A78D, 0x0A78D, -42280, 1 },
+    { 0x0A790, 0x0A792,      1, 2 }, { 0x0A796, 0x0A7A8,      1, 2 },
+    { 0x0A7AA, 0x0A7AA, -42308, 1 }, { 0x0A7AB, 0x0A7AB, -42319, 1 },
+    { 0x0A7AC, 0x0A7AC, -42315, 1 }, { 0x0A7AD, 0x0A7AD, -42305, 1 },
+    { 0x0A7AE, 0x0A7AE, -42308, 1 }, { 0x0A7B0, 0x0A7B0, -42258, 1 },
+    { 0x0A7B1, 0x0A7B1, -42282, 1 }, { 0x0A7B2, 0x0A7B2, -42261, 1 },
+    { 0x0A7B3, 0x0A7B3,    928, 1 }, { 0x0A7B4, 0x0A7C2,      1, 2 },
+    { 0x0A7C4, 0x0A7C4,    -48, 1 }, { 0x0A7C5, 0x0A7C5, -42307, 1 },
+    { 0x0A7C6, 0x0A7C6, -35384, 1 }, { 0x0A7C7, 0x0A7C9,      1, 2 },
+    { 0x0A7D0, 0x0A7D0,      1, 1 }, { 0x0A7D6, 0x0A7D8,      1, 2 },
+    { 0x0A7F5, 0x0A7F5,      1, 1 }, { 0x0AB70, 0x0ABBF, -38864, 1 },
+    { 0x0FF21, 0x0FF3A,     32, 1 }, { 0x10400, 0x10427,     40, 1 },
+    { 0x104B0, 0x104D3,     40, 1 }, { 0x10570, 0x1057A,     39, 1 },
+    { 0x1057C, 0x1058A,     39, 1 }, { 0x1058C, 0x10592,     39, 1 },
+    { 0x10594, 0x10595,     39, 1 }, { 0x10C80, 0x10CB2,     64, 1 },
+    { 0x118A0, 0x118BF,     32, 1 }, { 0x16E40, 0x16E5F,     32, 1 },
+    { 0x1E900, 0x1E921,     34, 1 }
+};
+
+static unsigned long sir__fold_code_point(unsigned long c)
+{
+    int low  = 0;
+    int high = (int)(sizeof(sir__fold_ranges) / sizeof(*sir__fold_ranges));
+
+    while (low < high)
     {
-        c1 = *s1;
-        c2 = *s2;
+        int middle = low + (high - low) / 2;
+        const long *range = sir__fold_ranges[middle];
 
-        if (case_insensitive)
+        if ((long)c < range[0])
         {
-            c1 = sir__to_lowercase(c1);
-            c2 = sir__to_lowercase(c2);
+            high = middle;
         }
+        else if ((long)c > range[1])
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            if (((long)c - range[0]) % range[3] == 0)
+                return (unsigned long)((long)c + range[2]);
 
-        if (c1 != c2) return 0;
-
-        ++s1;
-        ++s2;
+            break;
+        }
     }
 
-    if   (*s1 == *s2) return 1;
-    else              return 0;
+    return c;
 }
 
-static char sir__str_equal(const SirIni ini, const char *s1, const char *s2)
+// Decodes the UTF-8 character at '*str', moves '*str' past it and returns it
+// case folded. Bytes that aren't valid UTF-8 are returned above the last
+// code point, so that they don't match the character with the same value.
+static unsigned long sir__next_folded(const char **str)
 {
-    return sir__str_equal_case(s1, s2, 
-            ini->options & SIR_OPTION_DISABLE_CASE_SENSITIVITY);
-}
+    const unsigned char *s = (const unsigned char *)*str;
+    int size = sir__utf8_sequence_size(s, 4);
 
-static char sir__is_comment_char(const SirIni ini, char c)
-{
-    return (c == SIR_COMMENT_CHAR || 
-            (ini && 
-             (!(ini->options & SIR_OPTION_DISABLE_HASH_COMMENTS)) && 
-             c == SIR_COMMENT_CHAR_ALT));
+    if (size < 2)
+    {
+        ++*str;
+        return (size == 1) ? s[0] : 0x110000 + s[0];
+    }
+
+    unsigned long c = s[0] & (0xFF >> (size + 1));
+
+    for (int i = 1; i < size; ++i)
+        c = (c << 6) | (s[i] & 0x3F);
+
+    *str += size;
+
+    return sir__fold_code_point(c);
 }
 
-static char sir__is_assignment_char(const SirIni ini, char c)
+// Returns the character at '*str' as it is compared with 'folding' and moves
+// '*str' past it. Only bytes from 0x80 up are decoded as UTF-8, so ASCII is
+// as fast with SIR__FOLD_UNICODE as with SIR__FOLD_ASCII.
+static unsigned long sir__next_char(const char **str, char folding)
 {
-    return (c == SIR_KEY_ASSIGNMENT_CHAR || 
-            (ini && 
-             (!(ini->options & SIR_OPTION_DISABLE_COLON_ASSIGNMENT)) && 
-             c == SIR_KEY_ASSIGNMENT_CHAR_ALT));
+    unsigned long c = (unsigned char)**str;
+
+    if (folding == SIR__FOLD_UNICODE && c >= 0x80)
+        c = sir__next_folded(str);
+    else
+        ++*str;
+
+    // Some letters, like the Kelvin sign, fold to ASCII
+    if (folding && c < 0x80)
+        c = (unsigned char)sir__to_lowercase((char)c);
+
+    return c;
 }
 
-static int sir__skip_whitespace(const char *str)
+static char sir__str_equal_case(const char *s1, 
+        const char *s2, char case_insensitive)
 {
-    if (!str) return 0;
+    if      (!s1 && !s2) return 1;
+    else if (!s1 || !s2) return 0;
 
-    int n = 0;
+    // Keep the case test out of the loop
+    if (!case_insensitive) return !strcmp(s1, s2);
 
-    while (*str && *str <= ' ')
+    while (*s1 && *s2)
     {
-        ++str;
-        ++n;
+        if (sir__next_char(&s1, case_insensitive) != 
+                sir__next_char(&s2, case_insensitive))
+            return 0;
     }
 
-    return n;
+    return *s1 == *s2;
 }
 
-static char *sir__trim_whitespace(char *str)
+static char sir__str_equal(const SirIni ini, const char *s1, const char *s2)
+{
+    return sir__str_equal_case(s1, s2, sir__folding(ini->options));
+}
+
+static char sir__is_comment_char(const SirIni ini, char c)
+{
+    if (ini) return (sir__char_class(ini, c) & SIR_CHAR_COMMENT) != 0;
+
+    return c == SIR_COMMENT_CHAR;
+}
+
+static unsigned char sir__char_class(const SirIni ini, char c)
+{
+    return ini->dialect.classes[(unsigned char)c];
+}
+
+static ptrdiff_t sir__skip_whitespace(const char *str)
+{
+    if (!str) return 0;
+
+    ptrdiff_t n = 0;
+
+    while (*str && (unsigned char)*str <= ' ')
+    {
+        ++str;
+        ++n;
+    }
+
+    return n;
+}
+
+static char *sir__trim_whitespace(char *str)
 {
     if (!str) return 0;
 
@@ -480,18 +1730,43 @@ static char *sir__trim_whitespace(char *str)
 
     size_t i = strlen(str) - 1;
 
-    while (str[i] <= ' ') --i;
+    while ((unsigned char)str[i] <= ' ') --i;
 
     str[i + 1] = '\0';
 
     return str;
 }
 
-static int sir__skip_to_char(const char *str, char c)
+static ptrdiff_t sir__skip_dialect_whitespace(const SirIni ini, 
+        const char *str)
+{
+    ptrdiff_t n = 0;
+
+    while (str[n] && (sir__char_class(ini, str[n]) & SIR_CHAR_WHITESPACE))
+        ++n;
+
+    return n;
+}
+
+static char *sir__trim_dialect_whitespace(const SirIni ini, char *str)
+{
+    str += sir__skip_dialect_whitespace(ini, str);
+
+    size_t size = strlen(str);
+
+    while (size && (sir__char_class(ini, str[size - 1]) & SIR_CHAR_WHITESPACE))
+        --size;
+
+    str[size] = '\0';
+
+    return str;
+}
+
+static ptrdiff_t sir__skip_to_char(const char *str, char c)
 {
     if (!str) return 0;
 
-    int n = 0;
+    ptrdiff_t n = 0;
 
     while (*str && *str != c)
     {
@@ -502,55 +1777,280 @@ static int sir__skip_to_char(const char *str, char c)
     return n;
 }
 
-static int sir__parse_to_char(char *str, char c, char **parsed_str_ret)
+// Points 'parsed_str_ret' at 'str' and terminates it at the first character 
+// in one of 'classes'. Returns the offset of that character, or -1 if there
+// isn't one.
+static ptrdiff_t sir__parse_to_class(const SirIni ini, char *str, 
+        unsigned char classes, char **parsed_str_ret)
 {
-    if (!str) return 0;
+    if (!ini || !str) return 0;
 
+    const unsigned char *table = ini->dialect.classes;
     char *start = str;
 
-    int n = sir__skip_to_char(str, c);    
-
-    str += n;
+    while (*str && !(table[(unsigned char)*str] & classes)) ++str;
 
     if (parsed_str_ret) *parsed_str_ret = start;
 
-    if (*str == '\0')
+    if (*str == '\0') return -1;
+
+    *str = '\0';
+    return str - start;
+}
+
+// Returns the offset in 'str' of the first 'count' 'quote' characters in a
+// row that aren't escaped with '\', or -1 if there aren't any
+static ptrdiff_t sir__find_closing_quote(const char *str, char quote, 
+        int count)
+{
+    for (ptrdiff_t i = 0; str[i]; ++i)
     {
-        return -1;
+        if (str[i] == '\\' && str[i + 1])
+            ++i;
+        else if (str[i] == quote && 
+                (count == 1 || (str[i + 1] == quote && str[i + 2] == quote)))
+            return i;
     }
-    else
+
+    return -1;
+}
+
+// Returns the offset of the newline that ends the value starting at 'str', or
+// -1 if it runs to the end. With 'escapes', a '\' at the end of a line 
+// continues the value on the next one.
+static ptrdiff_t sir__find_value_end(const char *str, char escapes)
+{
+    for (ptrdiff_t i = 0; str[i]; ++i)
+    {
+        if (escapes && str[i] == '\\' && str[i + 1])
+        {
+            ++i;
+            if (str[i] == '\r' && str[i + 1] == '\n') ++i;
+        }
+        else if (str[i] == SIR__KEY_END_CHAR)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Decodes the escapes in the value of the key at 'index' into the arena. 
+// '\n', '\t' and '\r' are the usual characters, a '\' before '\', a quote or
+// a comment character keeps just that character, and a '\' at the end of a
+// line joins the next line to it without its leading whitespace. Any other
+// '\' is kept as it is, so that paths like 'C:\dir' read the same.
+static void sir__unescape(SirIni ini, SirIndex index)
+{
+    const char *str = ini->key_values[index];
+    char *value = sir__arena_alloc(ini, strlen(str) + 1);
+
+    ini->escaped[index] = 0;
+
+    if (!value)
+    {
+        sir__set_error(ini, "could not allocate memory for the value of "
+                "key '%'", ini->key_names[index], 0);
+        return;
+    }
+
+    char *write = value;
+
+    while (*str)
     {
-        *str = '\0';
-        return n;
+        if (*str != '\\' || !str[1])
+        {
+            *write++ = *str++;
+            continue;
+        }
+
+        char c = str[1];
+        str += 2;
+
+        switch (c)
+        {
+            case 'n': *write++ = '\n'; break;
+            case 't': *write++ = '\t'; break;
+            case 'r': *write++ = '\r'; break;
+
+            case '\r':
+            case '\n':
+                if (c == '\r' && *str == '\n') ++str;
+
+                while (*str && *str != '\n' && 
+                        (sir__char_class(ini, *str) & SIR_CHAR_WHITESPACE))
+                    ++str;
+                break;
+
+            default:
+                if (c != '\\' && !(sir__char_class(ini, c) & 
+                            (SIR_CHAR_QUOTE | SIR_CHAR_COMMENT)))
+                    *write++ = '\\';
+
+                *write++ = c;
+                break;
+        }
     }
+
+    *write = '\0';
+
+    ini->key_values[index] = value;
+
+    if (ini->interpolations)
+        ini->interpolations[index].raw_value = value;
 }
 
-static int sir__parse_to_assignment_char(const SirIni ini, char *str, 
-        char **parsed_str_ret)
+// Returns 'value' quoted and escaped so that it reads back the same with
+// SIR_OPTION_ENABLE_ESCAPES, or 0 if it can be written as it is or escapes 
+// aren't enabled. Values with newlines are written in '"""'. The result must 
+// be freed with SIR_FREE.
+static char *sir__escape_value(SirIni ini, const char *value)
 {
-    if (!ini || !str) return 0;
+    if (!(ini->options & SIR_OPTION_ENABLE_ESCAPES) ||
+            !(sir__char_class(ini, '\"') & SIR_CHAR_QUOTE))
+        return 0;
+
+    size_t size = 0;
+    char needed = 0;
+    char multi_line = 0;
 
-    if (ini->options & SIR_OPTION_DISABLE_COLON_ASSIGNMENT)
+    for (const char *c = value; *c; ++c)
     {
-        return sir__parse_to_char(str, SIR_KEY_ASSIGNMENT_CHAR, 
-                parsed_str_ret);
+        if (*c == '\n')
+            multi_line = 1;
+        else if (*c == '\\' || *c == '\r' || (sir__char_class(ini, *c) &
+                    (SIR_CHAR_QUOTE | SIR_CHAR_COMMENT)))
+            needed = 1;
+
+        size += 2;
     }
-    else
+
+    if (!needed && !multi_line) return 0;
+
+    // The newline after the opening '"""' isn't part of the value
+    const char *quote = multi_line ? "\"\"\"\n" : "\"";
+    size_t quote_size = multi_line ? 3 : 1;
+
+    char *result = SIR_MALLOC(ini->mem_ctx, size + quote_size * 2 + 2);
+
+    if (!result) return 0;
+
+    char *write = result;
+
+    memcpy(write, quote, quote_size + multi_line);
+    write += quote_size + multi_line;
+
+    for (const char *c = value; *c; ++c)
     {
-        int a = sir__skip_to_char(str, SIR_KEY_ASSIGNMENT_CHAR);
-        int b = sir__skip_to_char(str, SIR_KEY_ASSIGNMENT_CHAR_ALT);
+        if (*c == '\r')
+        {
+            *write++ = '\\';
+            *write++ = 'r';
+            continue;
+        }
 
-        if (a < b)
-            return sir__parse_to_char(str, SIR_KEY_ASSIGNMENT_CHAR, 
-                    parsed_str_ret);
-        else
-            return sir__parse_to_char(str, SIR_KEY_ASSIGNMENT_CHAR_ALT, 
-                    parsed_str_ret);
+        if (*c == '\\' || (sir__char_class(ini, *c) & 
+                    (SIR_CHAR_QUOTE | SIR_CHAR_COMMENT)))
+            *write++ = '\\';
+
+        *write++ = *c;
+    }
+
+    memcpy(write, quote, quote_size);
+    write[quote_size] = '\0';
+
+    return result;
+}
+
+// Returns the size of the UTF-8 sequence at 'str', or 0 if it isn't valid.
+// Overlong forms, surrogates and code points above U+10FFFF aren't valid.
+static int sir__utf8_sequence_size(const unsigned char *str, size_t left)
+{
+    unsigned char c = str[0];
+
+    // The range of the second byte, which is narrower for some lead bytes
+    unsigned char low  = 0x80;
+    unsigned char high = 0xBF;
+    int size;
+
+    if (c < 0x80)      return 1;
+    else if (c < 0xC2) return 0;
+    else if (c < 0xE0) size = 2;
+    else if (c < 0xF0) 
+    {
+        size = 3;
+
+        if (c == 0xE0)      low  = 0xA0;
+        else if (c == 0xED) high = 0x9F;
+    }
+    else if (c < 0xF5) 
+    {
+        size = 4;
+
+        if (c == 0xF0)      low  = 0x90;
+        else if (c == 0xF4) high = 0x8F;
+    }
+    else               return 0;
+
+    if ((size_t)size > left || str[1] < low || str[1] > high) return 0;
+
+    for (int i = 2; i < size; ++i)
+        if ((str[i] & 0xC0) != 0x80) return 0;
+
+    return size;
+}
+
+// Adds a warning for each invalid UTF-8 sequence in the INI. Most INIs are
+// all ASCII, which is skipped 8 bytes at a time, and lines are only counted
+// up to the sequences that are reported.
+static void sir__validate_utf8(SirIni ini)
+{
+    const unsigned char *str = (const unsigned char *)ini->data;
+    size_t size = strlen(ini->data);
+    size_t i = 0;
+
+    // Lines and characters have been counted up to 'counted'
+    size_t counted = 0;
+    long long line_number = 1;
+    long long char_number = 1;
+
+    while (i < size)
+    {
+        if (size - i >= 8)
+        {
+            unsigned long long word;
+            memcpy(&word, str + i, 8);
+
+            if (!(word & 0x8080808080808080ULL))
+            {
+                i += 8;
+                continue;
+            }
+        }
+
+        int n = sir__utf8_sequence_size(str + i, size - i);
+
+        if (n)
+        {
+            i += n;
+            continue;
+        }
+
+        for (; counted < i; ++counted)
+            sir__add_to_char_counts((char)str[counted], &line_number, 
+                    &char_number);
+
+        sir__add_warning(ini, line_number, char_number, 
+                "invalid UTF-8 sequence");
+
+        // The continuation bytes of a broken sequence are one warning
+        do ++i; while (i < size && (str[i] & 0xC0) == 0x80);
     }
 }
 
-static void sir__add_to_char_counts(char c, int *line_number, 
-        int *char_number)
+static void sir__add_to_char_counts(char c, long long *line_number, 
+        long long *char_number)
 {
     if (c == '\n')
     {
@@ -573,19 +2073,20 @@ static char sir__errors_enabled(SirIni ini)
     return (!(ini->options & SIR_OPTION_DISABLE_ERRORS));
 }
 
-static void sir__add_warning(SirIni ini, int line_number, int char_number,
-        const char *msg)
+static void sir__add_warning(SirIni ini, long long line_number, 
+        long long char_number, const char *msg)
 {
     if (!ini || !msg || !sir__warnings_enabled(ini)) return;
 
-    // An Int can't be more than 10 digits so these sprintfs should be safe
-    char ln_str[11], cn_str[11];
+    // A long long can't be more than 20 characters so these sprintfs should
+    // be safe
+    char ln_str[21], cn_str[21];
 
-    sprintf(ln_str, "%i", line_number);
-    ln_str[10] = '\0';
+    sprintf(ln_str, "%lld", line_number);
+    ln_str[20] = '\0';
 
-    sprintf(cn_str, "%i", char_number);
-    cn_str[10] = '\0';
+    sprintf(cn_str, "%lld", char_number);
+    cn_str[20] = '\0';
 
     char *str = SIR_MALLOC(ini->mem_ctx, SIR_WARNING_STRING_SIZE);
 
@@ -704,6 +2205,7 @@ static SirIni sir__create_ini(char disable_errors,
     memset(ini, 0, sizeof(*ini));
 
     ini->mem_ctx = mem_ctx;
+    sir_dialect_init(&ini->dialect, SIR_OPTION_NONE);
 
     if (disable_errors)
     {
@@ -736,13 +2238,11 @@ SIRDEF void sir_free_ini(SirIni ini)
 {
     if (ini)
     {
-        int i;
-
-        for (i = 0; i < ini->section_count; ++i)
+        for (SirIndex i = 0; i < ini->section_count; ++i)
             if (ini->sections[i].ranges)
                 SIR_FREE(ini->mem_ctx, ini->sections[i].ranges);
 
-        for (i = 0; i < ini->warnings_count; ++i)
+        for (int i = 0; i < ini->warnings_count; ++i)
             if (ini->warnings[i])
                 SIR_FREE(ini->mem_ctx, (void *)ini->warnings[i]);
 
@@ -757,13 +2257,194 @@ SIRDEF void sir_free_ini(SirIni ini)
         if (ini->error)         SIR_FREE(ini->mem_ctx, ini->error);
         if (ini->error_msg)     SIR_FREE(ini->mem_ctx, ini->error_msg);
         if (ini->warnings)      SIR_FREE(ini->mem_ctx, (void *)ini->warnings);
+        if (ini->source)        SIR_FREE(ini->mem_ctx, ini->source);
+        if (ini->key_spans)     SIR_FREE(ini->mem_ctx, ini->key_spans);
+        if (ini->escaped)       SIR_FREE(ini->mem_ctx, ini->escaped);
+
+        for (SirIndex i = 0; i < ini->patches_count; ++i)
+            sir__free_patch(ini, &ini->patches[i]);
+
+        if (ini->patches)       SIR_FREE(ini->mem_ctx, ini->patches);
+
+        for (int i = 0; i < ini->includes_count; ++i)
+            SIR_FREE(ini->mem_ctx, ini->includes[i].path);
+
+        if (ini->includes)      SIR_FREE(ini->mem_ctx, ini->includes);
+
+        sir__free_key_name_index(ini);
+        sir__free_value_index(ini);
+
+        if (ini->inheritance)
+        {
+            for (SirIndex i = 0; i < ini->section_count; ++i)
+                if (ini->inheritance[i].slots)
+                    SIR_FREE(ini->mem_ctx, ini->inheritance[i].slots);
+
+            SIR_FREE(ini->mem_ctx, ini->inheritance);
+        }
+
+        if (ini->interpolations)
+        {
+            for (SirIndex i = 0; i < ini->key_count; ++i)
+                if (ini->interpolations[i].dependents)
+                    SIR_FREE(ini->mem_ctx, 
+                            ini->interpolations[i].dependents);
+
+            SIR_FREE(ini->mem_ctx, ini->interpolations);
+        }
+
+        while (ini->arena)
+        {
+            SirArenaBlock *next = ini->arena->next;
+            SIR_FREE(ini->mem_ctx, ini->arena);
+            ini->arena = next;
+        }
 
         SIR_FREE(ini->mem_ctx, ini);
     }
 }
 
+// The first pass of the parser looks at every character to blank out
+// comments and count sections and keys, so it's instantiated once for each
+// combination of the options it depends on. Within an instantiation the
+// option tests are constants that the compiler removes, and 
+// sir__load_from_str() picks one from sir__first_passes at load time. Which
+// characters are comments, assignments and so on is a single lookup in the
+// dialect's table. With escapes, escaped characters and text in '"""' are 
+// never comments; they are still counted, since counting too many sections 
+// and keys is harmless. Counting is done in size_t so that a file with more 
+// sections or keys than a SirIndex can hold returns 0 instead of overflowing.
+// It also returns 0, with the error set, if an include can't be recorded.
+#define SIR__FIRST_PASS_INDEX(options)                                      \
+    ((((options) & SIR_OPTION_DISABLE_COMMENT_ANYWHERE) ? 1 : 0) |          \
+     (((options) & SIR_OPTION_ENABLE_INCLUDES) ? 2 : 0) |                   \
+     (((options) & SIR_OPTION_ENABLE_ESCAPES) ? 4 : 0))
+
+#define SIR__DEFINE_FIRST_PASS(index)                                       \
+static char sir__first_pass_##index(SirIni ini)                             \
+{                                                                           \
+    const char comment_anywhere = !((index) & 1);                           \
+    const char includes         = ((index) & 2) != 0;                       \
+    const char escapes          = ((index) & 4) != 0;                       \
+                                                                            \
+    const unsigned char *classes = ini->dialect.classes;                    \
+    char *str = ini->data;                                                  \
+    char line_start = 1;                                                    \
+    char multi_line = 0;                                                    \
+    size_t section_count = 1;                                               \
+    size_t key_count = 0;                                                   \
+                                                                            \
+    while (*str)                                                            \
+    {                                                                       \
+        if (escapes && *str == '\\' && str[1])                              \
+        {                                                                   \
+            ++str;                                                          \
+        }                                                                   \
+        else if (escapes && (classes[(unsigned char)*str] & SIR_CHAR_QUOTE) \
+                && str[1] == *str && str[2] == *str)                        \
+        {                                                                   \
+            multi_line = !multi_line;                                       \
+            str += 2;                                                       \
+        }                                                                   \
+        else if (includes && !multi_line && line_start &&                   \
+                sir__is_include_directive(str))                             \
+        {                                                                   \
+            str = sir__add_include(ini, str);                               \
+            if (!str) return 0;                                             \
+        }                                                                   \
+        else if (!multi_line &&                                             \
+                (classes[(unsigned char)*str] & SIR_CHAR_COMMENT))          \
+        {                                                                   \
+            if (comment_anywhere || str == ini->data || *(str - 1) == '\n') \
+            {                                                               \
+                while (*str && *str != '\n')                                \
+                {                                                           \
+                    *str = ' ';                                             \
+                    ++str;                                                  \
+                }                                                           \
+            }                                                               \
+        }                                                                   \
+                                                                            \
+        if (!*str) break;                                                   \
+                                                                            \
+        unsigned char c = classes[(unsigned char)*str];                     \
+                                                                            \
+        if (c & SIR_CHAR_SECTION_OPEN)     ++section_count;                 \
+        else if (c & SIR_CHAR_ASSIGNMENT)  ++key_count;                     \
+                                                                            \
+        if (*str == '\n')                       line_start = 1;             \
+        else if (!(c & SIR_CHAR_WHITESPACE))    line_start = 0;             \
+                                                                            \
+        ++str;                                                              \
+    }                                                                       \
+                                                                            \
+    if (section_count > (size_t)SIR__INDEX_MAX ||                           \
+            key_count > (size_t)SIR__INDEX_MAX)                             \
+        return 0;                                                           \
+                                                                            \
+    ini->section_count = (SirIndex)section_count;                           \
+    ini->key_count = (SirIndex)key_count;                                   \
+    return 1;                                                               \
+}
+
+SIR__DEFINE_FIRST_PASS(0)
+SIR__DEFINE_FIRST_PASS(1)
+SIR__DEFINE_FIRST_PASS(2)
+SIR__DEFINE_FIRST_PASS(3)
+SIR__DEFINE_FIRST_PASS(4)
+SIR__DEFINE_FIRST_PASS(5)
+SIR__DEFINE_FIRST_PASS(6)
+SIR__DEFINE_FIRST_PASS(7)
+
+static char (*const sir__first_passes[8])(SirIni ini) =
+{
+    sir__first_pass_0, sir__first_pass_1, sir__first_pass_2, 
+    sir__first_pass_3, sir__first_pass_4, sir__first_pass_5,
+    sir__first_pass_6, sir__first_pass_7
+};
+
 SIRDEF SirIni sir_load_from_str(char *s, SirOptions options, 
         const char *name, void *mem_ctx)
+{
+    return sir__load_from_str(s, options, 0, name, mem_ctx, 0);
+}
+
+SIRDEF SirIni sir_load_from_str_dialect(char *s, SirOptions options, 
+        const SirDialect *dialect, const char *name, void *mem_ctx)
+{
+    return sir__load_from_str(s, options, dialect, name, mem_ctx, 0);
+}
+
+SIRDEF void sir_dialect_init(SirDialect *dialect, SirOptions options)
+{
+    unsigned char *classes = dialect->classes;
+
+    memset(classes, SIR_CHAR_NONE, sizeof(dialect->classes));
+
+    for (int c = 1; c <= ' '; ++c)
+        classes[c] = SIR_CHAR_WHITESPACE;
+
+    classes[(unsigned char)SIR_COMMENT_CHAR] |= SIR_CHAR_COMMENT;
+    classes[(unsigned char)SIR_KEY_ASSIGNMENT_CHAR] |= SIR_CHAR_ASSIGNMENT;
+    classes[(unsigned char)SIR__SECTION_NAME_OPEN_CHAR] |= 
+        SIR_CHAR_SECTION_OPEN;
+    classes[(unsigned char)SIR__SECTION_NAME_CLOSE_CHAR] |= 
+        SIR_CHAR_SECTION_CLOSE;
+
+    if (!(options & SIR_OPTION_DISABLE_HASH_COMMENTS))
+        classes[(unsigned char)SIR_COMMENT_CHAR_ALT] |= SIR_CHAR_COMMENT;
+
+    if (!(options & SIR_OPTION_DISABLE_COLON_ASSIGNMENT))
+        classes[(unsigned char)SIR_KEY_ASSIGNMENT_CHAR_ALT] |= 
+            SIR_CHAR_ASSIGNMENT;
+
+    if (!(options & SIR_OPTION_DISABLE_QUOTES))
+        classes['\"'] |= SIR_CHAR_QUOTE;
+}
+
+static SirIni sir__load_from_str(char *s, SirOptions options, 
+        const SirDialect *dialect, const char *name, void *mem_ctx, 
+        SirIncludeCache cache)
 {
     SirIni ini = sir__create_ini(options & SIR_OPTION_DISABLE_ERRORS,
             options & SIR_OPTION_DISABLE_WARNINGS, mem_ctx);
@@ -785,52 +2466,66 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
     ini->options = options;
     ini->data = s;
 
-    // Remove Comments and Count Sections and Keys
-    ini->section_count = 1;
+    if (dialect) ini->dialect = *dialect;
+    else         sir_dialect_init(&ini->dialect, options);
 
-    char *str = ini->data;
+    ini->dialect.classes['\0'] = SIR_CHAR_NONE;
+    ini->dialect.classes['\n'] = SIR_CHAR_WHITESPACE;
 
-    while (*str)
+    if (options & SIR_OPTION_PRESERVE_SOURCE)
     {
-        if (sir__is_comment_char(ini, *str))
-        {
-            if (!(ini->options & SIR_OPTION_DISABLE_COMMENT_ANYWHERE) || 
-                    (ini->options & SIR_OPTION_DISABLE_COMMENT_ANYWHERE 
-                     && (str == ini->data || (str > ini->data && 
-                             *(str - 1) == '\n'))))
-            {
-                while (*str && *str != '\n')
-                {
-                    *str = ' ';
-                    ++str;
-                }
-            }
-        }
+        ini->source_size = strlen(s);
+        ini->source = SIR_MALLOC(mem_ctx, ini->source_size + 1);
+        memcpy(ini->source, s, ini->source_size + 1);
+    }
 
-        if (*str == SIR__SECTION_NAME_OPEN_CHAR) ++ini->section_count;
-        else if (sir__is_assignment_char(ini, *str))  ++ini->key_count;
+    // A UTF-8 byte order mark is blanked, not removed, so that the data has 
+    // the same layout as the source
+    if ((unsigned char)s[0] == 0xEF && (unsigned char)s[1] == 0xBB && 
+            (unsigned char)s[2] == 0xBF)
+        memset(s, ' ', 3);
 
-        ++str;
+    if ((options & SIR_OPTION_VALIDATE_UTF8) && 
+            !(options & SIR_OPTION_DISABLE_WARNINGS))
+        sir__validate_utf8(ini);
+
+    // Remove Comments and Count Sections and Keys
+    if (!sir__first_passes[SIR__FIRST_PASS_INDEX(options)](ini))
+    {
+        if (!sir_has_error(ini))
+            sir__set_error(ini, "'%' has too many sections or keys", 
+                    ini->filename, 0);
+        return ini;
     }
 
+    char *str;
+
     // Check for Warnings
     if (!(ini->options & SIR_OPTION_DISABLE_WARNINGS))
     {
-        int line_number = 1;
-        int char_number = 1;
+        long long line_number = 1;
+        long long char_number = 1;
+
+        const unsigned char *classes = ini->dialect.classes;
+        const char escapes = (ini->options & SIR_OPTION_ENABLE_ESCAPES) != 0;
+        const char inheritance = 
+            (ini->options & SIR_OPTION_ENABLE_INHERITANCE) != 0;
+
         str = ini->data;
         while (*str)
         {
             // Skip Whitespace
-            while (*str && *str <= ' ')
+            while (*str && (classes[(unsigned char)*str] & 
+                        SIR_CHAR_WHITESPACE))
             {
                 sir__add_to_char_counts(*str, &line_number, &char_number);
                 ++str;
             }
 
-            if (*str == SIR__SECTION_NAME_OPEN_CHAR)
+            if (classes[(unsigned char)*str] & SIR_CHAR_SECTION_OPEN)
             {
-                while (*str && *str != SIR__SECTION_NAME_CLOSE_CHAR)
+                while (*str && !(classes[(unsigned char)*str] & 
+                            SIR_CHAR_SECTION_CLOSE))
                 {
                     if (*str == '\n')
                     {
@@ -838,7 +2533,9 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                                 "Newline found in section name. Did you "
                                 "forget to close the section name with ']'?");
                     }
-                    else if (sir__is_assignment_char(ini, *str))
+                    else if ((classes[(unsigned char)*str] & 
+                                SIR_CHAR_ASSIGNMENT) &&
+                            !(*str == ':' && inheritance))
                     {
                         sir__add_warning(ini, line_number, char_number,
                                 "'=' found in section name. Did you "
@@ -850,19 +2547,23 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                     ++str;
                 }
 
+                if (!*str) break;
+
                 sir__add_to_char_counts(*str, &line_number, &char_number);
                 ++str;
             }
             else
             {
-                while (*str && !sir__is_assignment_char(ini, *str))
+                while (*str && !(classes[(unsigned char)*str] & 
+                            SIR_CHAR_ASSIGNMENT))
                 {
-                    if (*str == SIR__SECTION_NAME_OPEN_CHAR)
+                    if (classes[(unsigned char)*str] & SIR_CHAR_SECTION_OPEN)
                     {
                         sir__add_warning(ini, line_number, char_number, 
                                 "'[' found in key name");
                     }
-                    else if (*str == SIR__SECTION_NAME_CLOSE_CHAR)
+                    else if (classes[(unsigned char)*str] & 
+                            SIR_CHAR_SECTION_CLOSE)
                     {
                         sir__add_warning(ini, line_number, char_number,
                                 "']' found in key name");
@@ -873,17 +2574,48 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                     ++str;
                 }
 
+                if (!*str) break;
+
                 sir__add_to_char_counts(*str, &line_number, &char_number);
                 ++str;
 
                 while (*str && *str != SIR__KEY_END_CHAR)
                 {
-                    if (*str == SIR__SECTION_NAME_OPEN_CHAR)
+                    // Escaped characters and multi-line values are skipped
+                    ptrdiff_t skip = 0;
+
+                    if (escapes)
+                    {
+                        if (*str == '\\' && str[1])
+                        {
+                            skip = 2;
+                        }
+                        else if ((classes[(unsigned char)*str] & 
+                                    SIR_CHAR_QUOTE) && 
+                                str[1] == *str && str[2] == *str)
+                        {
+                            ptrdiff_t n = sir__find_closing_quote(str + 3, 
+                                    *str, 3);
+                            skip = (n == -1) ? (ptrdiff_t)strlen(str) : n + 6;
+                        }
+                    }
+
+                    if (skip)
+                    {
+                        for (; skip; --skip, ++str)
+                            sir__add_to_char_counts(*str, &line_number, 
+                                    &char_number);
+
+                        continue;
+                    }
+
+                    if (classes[(unsigned char)*str] & SIR_CHAR_SECTION_OPEN)
                     {
                         sir__add_warning(ini, line_number, char_number, 
                                 "'[' found in key value");
                     }
-                    else if (*str == SIR__SECTION_NAME_CLOSE_CHAR)
+                    else if (classes[(unsigned char)*str] & 
+                            SIR_CHAR_SECTION_CLOSE)
                     {
                         sir__add_warning(ini, line_number, char_number,
                                 "']' found in key value");
@@ -894,6 +2626,8 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                     ++str;
                 }
 
+                if (!*str) break;
+
                 sir__add_to_char_counts(*str, &line_number, &char_number);
                 ++str;
             }
@@ -921,45 +2655,104 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
     memset((void *)ini->key_values, 0, 
             sizeof(*ini->key_values) * ini->key_count);
 
-    for (int i = 0; i < ini->section_count; ++i)
+    if (ini->source)
+    {
+        ini->key_spans = SIR_MALLOC(mem_ctx, 
+                sizeof(*ini->key_spans) * ini->key_count);
+    }
+
+    if (ini->options & SIR_OPTION_ENABLE_ESCAPES)
+    {
+        ini->escaped = SIR_MALLOC(mem_ctx, 
+                sizeof(*ini->escaped) * ini->key_count);
+    }
+
+    if (ini->options & SIR_OPTION_ENABLE_INHERITANCE)
+    {
+        ini->inheritance = SIR_MALLOC(mem_ctx, 
+                sizeof(*ini->inheritance) * ini->section_count);
+
+        memset(ini->inheritance, 0, 
+                sizeof(*ini->inheritance) * ini->section_count);
+
+        for (SirIndex i = 0; i < ini->section_count; ++i)
+            ini->inheritance[i].parent = -1;
+    }
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
     {
         ini->sections[i].ranges_count = 1;
         ini->sections[i].ranges = SIR_MALLOC(mem_ctx, 
                 sizeof(*ini->sections[i].ranges) * 
                 ini->sections[i].ranges_count);
+        ini->sections[i].ranges[0].header_end = 0;
     }
 
     ini->sections[0].ranges[0].start = 0;
     ini->section_names[0] = SIR_GLOBAL_SECTION_NAME;
 
-    int prev_index  = 0;
-    int section_index = 0;
-    int key_index     = 0;
+    SirIndex prev_index  = 0;
+    SirIndex section_index = 0;
+    SirIndex key_index     = 0;
+    SirIndex include_index = 0;
 
     while (*str)
     {
-        str += sir__skip_whitespace(str);
+        str += sir__skip_dialect_whitespace(ini, str);
+
+        // Note where every include directive before this point goes
+        while (include_index < ini->includes_count && 
+                ini->includes[include_index].offset <= str - ini->data)
+        {
+            ini->includes[include_index].key_index = key_index;
+            ini->includes[include_index].section   = prev_index;
+            ++include_index;
+        }
 
         // Section
-        if (*str == SIR__SECTION_NAME_OPEN_CHAR)
+        if (sir__char_class(ini, *str) & SIR_CHAR_SECTION_OPEN)
         {
             char *section_name;
 
-            int range_index = ini->sections[prev_index].ranges_count - 1;
+            SirIndex range_index = ini->sections[prev_index].ranges_count - 1;
 
             ini->sections[prev_index].ranges[range_index].end = key_index;
 
             ++str;
 
-            int n = sir__parse_to_char(str, SIR__SECTION_NAME_CLOSE_CHAR, 
+            ptrdiff_t n = sir__parse_to_class(ini, str, SIR_CHAR_SECTION_CLOSE, 
                     &section_name);
 
-            section_name = sir__trim_whitespace(section_name);
+            ptrdiff_t header_end = 0;
+            if (ini->source)
+            {
+                header_end = (n == -1) ? ini->source_size :
+                    sir__source_line_end(ini, (str - ini->data) + n);
+            }
+
+            section_name = sir__trim_dialect_whitespace(ini, section_name);
+
+            // '[child : parent]'
+            char *parent_name = 0;
+
+            if (ini->inheritance)
+            {
+                char *colon = strchr(section_name, ':');
+
+                if (colon)
+                {
+                    *colon = '\0';
+                    parent_name = sir__trim_dialect_whitespace(ini, 
+                            colon + 1);
+                    section_name = sir__trim_dialect_whitespace(ini, 
+                            section_name);
+                }
+            }
 
             // Check for Duplicates
-            int duplicate = -1;
+            SirIndex duplicate = -1;
             {
-                for (int i = 0; i < section_index + 1; ++i)
+                for (SirIndex i = 0; i < section_index + 1; ++i)
                 {
                     if (sir__str_equal(ini, 
                                 ini->section_names[i], section_name))
@@ -986,6 +2779,8 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
 
                     ini->sections[duplicate].ranges[range_index].start = 
                         key_index;
+                    ini->sections[duplicate].ranges[range_index].header_end =
+                        header_end;
                 }
 
                 prev_index = duplicate;
@@ -996,9 +2791,14 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                 prev_index = section_index;
 
                 ini->sections[section_index].ranges[0].start = key_index;
+                ini->sections[section_index].ranges[0].header_end = 
+                    header_end;
                 ini->section_names[section_index] = section_name;
             }
 
+            if (parent_name && !ini->inheritance[prev_index].parent_name)
+                ini->inheritance[prev_index].parent_name = parent_name;
+
             if (n == -1)
                 break;
             else
@@ -1011,18 +2811,19 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
             char *key_value;
 
             // Parse Name
-            int n = sir__parse_to_assignment_char(ini, str, &key_name);
+            ptrdiff_t n = sir__parse_to_class(ini, str, SIR_CHAR_ASSIGNMENT, 
+                    &key_name);
 
-            key_name = sir__trim_whitespace(key_name);
+            key_name = sir__trim_dialect_whitespace(ini, key_name);
 
             // Check for Duplicate Name (-1 means no duplicate)
-            int duplicate = -1;
+            SirIndex duplicate = -1;
             {
                 SirSection *section = &ini->sections[section_index];
-                int end = 0;
-                int start = 0;
+                SirIndex end = 0;
+                SirIndex start = 0;
 
-                for (int i = 0; i < section->ranges_count; ++i)
+                for (SirIndex i = 0; i < section->ranges_count; ++i)
                 {
                     if (i < section->ranges_count - 1)
                         end = section->ranges[i].end;
@@ -1031,7 +2832,7 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
 
                     start = section->ranges[i].start;
 
-                    for (int j = start; j < end; ++j)
+                    for (SirIndex j = start; j < end; ++j)
                     {
                         if (sir__str_equal(ini, ini->key_names[j], key_name))
                         {
@@ -1047,16 +2848,27 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
             {
                 str += n + 1;
 
+                const char escapes = 
+                    (ini->options & SIR_OPTION_ENABLE_ESCAPES) != 0;
+
+                // The quote character that starts the value, if any
                 char quoted = 0;
+                char *quoted_str = str;
 
                 if (!(ini->options & SIR_OPTION_DISABLE_QUOTES))
                 {
-                    char *quoted_str = str;
                     while (*quoted_str && *quoted_str != SIR__KEY_END_CHAR)
                     {
-                        if (*quoted_str == '\"')
+                        if (escapes && *quoted_str == '\\' && quoted_str[1])
                         {
-                            quoted = 1;
+                            quoted_str += 2;
+                            continue;
+                        }
+
+                        if (sir__char_class(ini, *quoted_str) & 
+                                SIR_CHAR_QUOTE)
+                        {
+                            quoted = *quoted_str;
                             break;
                         }
 
@@ -1064,23 +2876,58 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                     }
                 }
 
+                // The value ends at 'end' and parsing carries on after 
+                // 'end_size' characters, or at the end of the data
+                ptrdiff_t end;
+                int end_size = 1;
+
                 if (quoted)
                 {
-                    str += sir__skip_to_char(str, '\"') + 1;
+                    str = quoted_str + 1;
+
+                    if (escapes && str[0] == quoted && str[1] == quoted)
+                    {
+                        // '"""' values start on the line after the quotes 
+                        // if nothing else is on the line
+                        str += 2;
+                        end_size = 3;
+
+                        if (str[0] == '\r' && str[1] == '\n') str += 2;
+                        else if (str[0] == '\n')             ++str;
+                    }
 
-                    str += sir__parse_to_char(str, '\"', &key_value) + 1;
+                    end = escapes ? 
+                        sir__find_closing_quote(str, quoted, end_size) :
+                        sir__skip_to_char(str, quoted);
+
+                    if (!escapes && !str[end]) end = -1;
+
+                    key_value = str;
                 }
                 else
                 {
-                    str += sir__parse_to_char(str, SIR__KEY_END_CHAR, 
-                            &key_value) + 1;
+                    end = sir__find_value_end(str, escapes);
+                    key_value = str;
+                }
 
-                    key_value = sir__trim_whitespace(key_value);
+                if (end == -1)
+                {
+                    str += strlen(str);
                 }
+                else
+                {
+                    str[end] = '\0';
+                    str += end + end_size;
+                }
+
+                if (!quoted)
+                    key_value = sir__trim_dialect_whitespace(ini, key_value);
             }
             else 
             {
-                key_value = "";
+                // A name with no assignment at the end of the data isn't a 
+                // key, and wasn't counted as one by the first pass
+                break;
             }
 
             // Apply Value to Name
@@ -1093,6 +2940,14 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                             SIR_OPTION_OVERRIDE_DUPLICATE_KEYS)
                     {
                         ini->key_values[duplicate] = key_value;
+
+                        if (ini->escaped)
+                            ini->escaped[duplicate] = 
+                                (strchr(key_value, '\\') != 0);
+
+                        if (ini->source)
+                            sir__set_key_span(ini, duplicate, key_name, 
+                                    key_value);
                     }
                 }
                 else
@@ -1101,17 +2956,29 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                     ini->key_names[key_index] = key_name;
                     ini->key_values[key_index] = key_value;
 
+                    if (ini->escaped)
+                        ini->escaped[key_index] = 
+                            (strchr(key_value, '\\') != 0);
+
+                    if (ini->source)
+                        sir__set_key_span(ini, key_index, key_name, 
+                                key_value);
+
                     ++key_index;
                 }
             }
-
-            if (n == -1) break;
         }
     }
 
     ini->sections[prev_index].ranges[
         ini->sections[prev_index].ranges_count - 1].end = key_index;
 
+    for (; include_index < ini->includes_count; ++include_index)
+    {
+        ini->includes[include_index].key_index = key_index;
+        ini->includes[include_index].section   = prev_index;
+    }
+
     // Shrink if necessary
     if (section_index  + 1 < ini->section_count)
     {
@@ -1122,6 +2989,10 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
         ini->section_names = SIR_REALLOC(mem_ctx, 
                 (void *)ini->section_names,
                 sizeof(*ini->section_names) * ini->section_count);
+
+        if (ini->inheritance)
+            ini->inheritance = SIR_REALLOC(mem_ctx, ini->inheritance,
+                    sizeof(*ini->inheritance) * ini->section_count);
     }
 
     if (key_index < ini->key_count)
@@ -1132,16 +3003,74 @@ SIRDEF SirIni sir_load_from_str(char *s, SirOptions options,
                 sizeof(*ini->key_names) * ini->key_count);
         ini->key_values = SIR_REALLOC(mem_ctx, (void *)ini->key_values, 
                 sizeof(*ini->key_values) * ini->key_count);
+
+        if (ini->key_spans)
+            ini->key_spans = SIR_REALLOC(mem_ctx, ini->key_spans,
+                    sizeof(*ini->key_spans) * ini->key_count);
+
+        if (ini->escaped)
+            ini->escaped = SIR_REALLOC(mem_ctx, ini->escaped,
+                    sizeof(*ini->escaped) * ini->key_count);
     }
 
+    ini->sections_size    = ini->section_count;
+    ini->keys_size        = ini->key_count;
+    ini->source_key_count = ini->key_count;
+
     sir__clear_error_str(ini);
 
+    if (ini->includes_count)
+        sir__apply_includes(ini, cache);
+
+    if (ini->inheritance)
+        sir__build_inheritance(ini);
+
+    if (ini->options & SIR_OPTION_INDEX_VALUES)
+        sir__build_value_index(ini);
+
     return ini;
 
 }
 
 SIRDEF SirIni sir_load_from_file(const char *filename, 
         SirOptions options, void *mem_ctx)
+{
+    return sir_load_from_file_cached(filename, options, 0, mem_ctx);
+}
+
+SIRDEF SirIni sir_load_from_file_cached(const char *filename, 
+        SirOptions options, SirIncludeCache cache, void *mem_ctx)
+{
+    // Includes are cached for the length of this call if there isn't a cache
+    SirIncludeCache temporary_cache = 0;
+
+    if (!cache && (options & SIR_OPTION_ENABLE_INCLUDES))
+        cache = temporary_cache = sir_include_cache_create(mem_ctx);
+
+    SirIni ini = sir__load_file(filename, options, 0, cache, mem_ctx);
+
+    sir_free_include_cache(temporary_cache);
+
+    return ini;
+}
+
+SIRDEF SirIni sir_load_from_file_dialect(const char *filename, 
+        SirOptions options, const SirDialect *dialect, void *mem_ctx)
+{
+    SirIncludeCache cache = 0;
+
+    if (options & SIR_OPTION_ENABLE_INCLUDES)
+        cache = sir_include_cache_create(mem_ctx);
+
+    SirIni ini = sir__load_file(filename, options, dialect, cache, mem_ctx);
+
+    sir_free_include_cache(cache);
+
+    return ini;
+}
+
+static SirIni sir__load_file(const char *filename, SirOptions options, 
+        const SirDialect *dialect, SirIncludeCache cache, void *mem_ctx)
 {
     // create a temporary ini file in case of errors
     SirIni ini = sir__create_ini(0, 0, mem_ctx);
@@ -1150,68 +3079,30 @@ SIRDEF SirIni sir_load_from_file(const char *filename,
     strcpy((char *)ini->filename, filename);
 
     // Load Entire File
-    FILE *file = fopen(filename, "r");
-
-    if (!file) 
-    {
-        sir__set_error(ini, strerror(errno), 0, 0);
-        return ini;
-    }
-
-    if (fseek(file, 0, SEEK_END) == -1)
-    {
-        fclose(file);
-        sir__set_error(ini, strerror(errno), 0, 0);
-        return ini;
-    }
-
-    long size = ftell(file);
-    if (size == -1L)
-    {
-        fclose(file);
-        sir__set_error(ini, strerror(errno), 0, 0);
-        return ini;
-    }
-
-    rewind(file);
+    const char *error;
+    char *data = sir__read_file(filename, 0, &error, mem_ctx);
 
-    char *data = SIR_MALLOC(mem_ctx, size + 1);
     if (!data)
     {
-        fclose(file);
-        sir__set_error(ini, "SIR_MALLOC failed", 0, 0);
-        return ini;
-    }
-
-    size_t bytes_read = fread(data, 1, size, file);
-    if (ferror(file))
-    {
-        SIR_FREE(mem_ctx, data);
-        fclose(file);
-        sir__set_error(ini, strerror(errno), 0, 0);
+        sir__set_error(ini, error, 0, 0);
         return ini;
     }
 
-    if (bytes_read < (size_t)size)
-    {
-        size = bytes_read;
-        data = SIR_REALLOC(mem_ctx, data, size + 1);
+    sir_free_ini(ini);
 
-        if (!data)
-        {
-            fclose(file);
-            sir__set_error(ini, strerror(errno), 0, 0);
-            return ini;
-        }
-    }
+    // Mark the file as loading, so that including it from itself or from a
+    // file it includes is caught
+    int cached = cache ? 
+        sir__cached_file(cache, filename, options, dialect) : -1;
 
-    fclose(file);
+    if (cached != -1) cache->files[cached].loading = 1;
 
-    data[size] = '\0';
+    ini = sir__load_from_str(data, options, dialect, filename, mem_ctx, 
+            cache);
 
-    sir_free_ini(ini);
+    if (cached != -1) cache->files[cached].loading = 0;
 
-    return sir_load_from_str(data, options, filename, mem_ctx);
+    return ini;
 }
 
 SIRDEF SirSection *sir__get_section(SirIni ini, const char *section_name)
@@ -1225,22 +3116,55 @@ SIRDEF SirSection *sir__get_section(SirIni ini, const char *section_name)
         return 0;
     }
 
-    for (int i = 0; i < ini->section_count; ++i)
+    SirIndex index = sir__section_index(ini, section_name);
+
+    if (index != -1)
+    {
+        sir__clear_error_str(ini);
+        return &ini->sections[index];
+    }
+
+    sir__set_error(ini, "section '%' not found", section_name, 0);
+    return 0;
+}
+
+// Returns the index of the section named 'section_name', or -1 if there
+// isn't one
+static SirIndex sir__section_index(SirIni ini, const char *section_name)
+{
+    for (SirIndex i = 0; i < ini->section_count; ++i)
     {
         if (ini->section_names[i] && 
                 sir__str_equal(ini, ini->section_names[i], section_name))
+            return i;
+    }
+
+    return -1;
+}
+
+// Returns the index of the key named 'key_name' in 'section', or -1 if there
+// isn't one
+static SirIndex sir__section_key_index(SirIni ini, SirSection *section, 
+        const char *key_name)
+{
+    for (SirIndex i = 0; i < section->ranges_count; ++i)
+    {
+        SirIndex start = section->ranges[i].start;
+        SirIndex end   = section->ranges[i].end;
+
+        for (SirIndex j = start; j < end; ++j)
         {
-            sir__clear_error_str(ini);
-            return &ini->sections[i];
+            if (ini->key_names[j] && sir__str_equal(ini, 
+                        ini->key_names[j], key_name))
+                return j;
         }
     }
 
-    sir__set_error(ini, "section '%' not found", section_name, 0);
-    return 0;
+    return -1;
 }
 
 static const char **sir__section_key_array(SirIni ini, 
-        const char *section_name, int *size_ret, const char **key_array)
+        const char *section_name, SirIndex *size_ret, const char **key_array)
 {
     if (!ini) return 0;
 
@@ -1256,26 +3180,33 @@ static const char **sir__section_key_array(SirIni ini,
     if (sir_has_error(ini))
         return 0;
 
-    int i;
-    int key_count = 0;
+    SirIndex i;
+    SirIndex key_count = 0;
     for (i = 0; i < section->ranges_count; ++i)
     {
-        key_count += section->ranges[i].end - section->ranges[i].start;
+        for (SirIndex j = section->ranges[i].start; 
+                j < section->ranges[i].end; ++j)
+            if (ini->key_names[j])
+                ++key_count;
     }
 
     const char **array = SIR_MALLOC(ini->mem_ctx, 
             sizeof(*array) * key_count);
 
-    int index = 0;
+    SirIndex index = 0;
 
     for (i = 0; i < section->ranges_count; ++i)
     {
-        int start = section->ranges[i].start;
-        int end   = section->ranges[i].end;
+        SirIndex start = section->ranges[i].start;
+        SirIndex end   = section->ranges[i].end;
 
-        for (int j = start; j < end; ++j)
+        for (SirIndex j = start; j < end; ++j)
         {
-            array[index] = key_array[j];
+            // Skip keys removed by sir_delete()
+            if (!ini->key_names[j]) continue;
+
+            array[index] = (key_array == ini->key_values) ?
+                sir__value(ini, j) : key_array[j];
             ++index;
         }
     }
@@ -1289,14 +3220,14 @@ static const char **sir__section_key_array(SirIni ini,
 }
 
 SIRDEF const char **sir_section_key_names(SirIni ini, 
-        const char *section_name, int *values_size_ret)
+        const char *section_name, SirIndex *values_size_ret)
 {
     return sir__section_key_array(ini, section_name, values_size_ret, 
             ini->key_names);
 }
 
 SIRDEF const char **sir_section_key_values(SirIni ini, 
-        const char *section_name, int *values_size_ret)
+        const char *section_name, SirIndex *values_size_ret)
 {
     return sir__section_key_array(ini, section_name, values_size_ret, 
             ini->key_values);
@@ -1304,6 +3235,8 @@ SIRDEF const char **sir_section_key_values(SirIni ini,
 
 SIRDEF void sir_free(SirIni ini, void *mem)
 {
+    (void)ini;
+
     SIR_FREE(ini->mem_ctx, (void *)mem);
 }
 
@@ -1331,23 +3264,15 @@ SIRDEF const char *sir_section_str(SirIni ini, const char *section_name,
 
     if (section)
     {
-        int start;
-        int end;
+        SirIndex index = sir__find_key(ini, 
+                (SirIndex)(section - ini->sections), key_name);
 
-        for (int i = 0; i < section->ranges_count; ++i)
+        if (index != -1)
         {
-            start = section->ranges[i].start;
-            end   = section->ranges[i].end;
+            const char *key_value = sir__interpolate(ini, index);
 
-            for (int j = start; j < end; ++j)
-            {
-                if (ini->key_names[j] && sir__str_equal(ini, 
-                            ini->key_names[j], key_name))
-                {
-                    sir__clear_error_str(ini);
-                    return ini->key_values[j];
-                }
-            }
+            if (key_value) sir__clear_error_str(ini);
+            return key_value;
         }
 
         sir__set_error(ini, "key '%' not found in section '%'", 
@@ -1357,28 +3282,25 @@ SIRDEF const char *sir_section_str(SirIni ini, const char *section_name,
     }
     else
     {
-        const char *key_value = 0;
+        SirIndex index = -1;
 
-        for (int i = 0; i < ini->key_count; ++i)
+        for (SirIndex i = 0; i < ini->key_count; ++i)
         {
             if (ini->key_names[i] && 
                     sir__str_equal(ini, ini->key_names[i], key_name))
             {
-                if (ini->options & SIR_OPTION_OVERRIDE_DUPLICATE_KEYS)
-                {
-                    key_value = ini->key_values[i];
-                }
-                else
-                {
-                    sir__clear_error_str(ini);
-                    return ini->key_values[i];
-                }
+                index = i;
+
+                if (!(ini->options & SIR_OPTION_OVERRIDE_DUPLICATE_KEYS))
+                    break;
             }
         }
 
-        if (key_value)
+        if (index != -1)
         {
-            sir__clear_error_str(ini);
+            const char *key_value = sir__interpolate(ini, index);
+
+            if (key_value) sir__clear_error_str(ini);
             return key_value;
         }
 
@@ -1394,6 +3316,12 @@ SIRDEF long sir_section_long(SirIni ini, const char *section_name,
 
     if (sir_has_error(ini) || !str) return 0;
 
+    return sir__str_to_long(ini, str);
+}
+
+// Converts 'str' to a long, or sets an error and returns 0
+static long sir__str_to_long(SirIni ini, const char *str)
+{
     char *endptr;
 
     errno = 0;
@@ -1441,6 +3369,12 @@ SIRDEF long sir_section_unsigned_long(SirIni ini, const char *section_name,
 
     if (sir_has_error(ini) || !str) return 0;
 
+    return sir__str_to_unsigned_long(ini, str);
+}
+
+// Converts 'str' to an unsigned long, or sets an error and returns 0
+static unsigned long sir__str_to_unsigned_long(SirIni ini, const char *str)
+{
     char *endptr;
 
     errno = 0;
@@ -1474,6 +3408,12 @@ SIRDEF double sir_section_double(SirIni ini, const char *section_name,
 
     if (sir_has_error(ini) || !str) return 0;
 
+    return sir__str_to_double(ini, str);
+}
+
+// Converts 'str' to a double, or sets an error and returns 0
+static double sir__str_to_double(SirIni ini, const char *str)
+{
     char *endptr;
 
     errno = 0;
@@ -1517,7 +3457,17 @@ SIRDEF double sir_section_double(SirIni ini, const char *section_name,
 SIRDEF char sir_section_bool(SirIni ini, const char *section_name, 
         const char *key_name)
 {
-    long l = sir_section_long(ini, section_name, key_name);
+    const char *str = sir_section_str(ini, section_name, key_name);
+
+    if (sir_has_error(ini) || !str) return -1;
+
+    return sir__str_to_bool(ini, str);
+}
+
+// Converts 'str' to 1 or 0, or sets an error and returns -1
+static char sir__str_to_bool(SirIni ini, const char *str)
+{
+    long l = sir__str_to_long(ini, str);
 
     if (!sir_has_error(ini))
     {
@@ -1525,9 +3475,7 @@ SIRDEF char sir_section_bool(SirIni ini, const char *section_name,
         else     return 0;
     }
 
-    const char *str = sir_section_str(ini, section_name, key_name);
-
-    if (sir_has_error(ini) || !str) return -1;
+    sir__clear_error_str(ini);
 
     str += sir__skip_whitespace(str);
 
@@ -1551,7 +3499,7 @@ SIRDEF char sir_section_bool(SirIni ini, const char *section_name,
 }
 
 SIRDEF const char **sir_section_csv(const SirIni ini, 
-        const char *section_name, const char *key_name, int *csv_size_ret)
+        const char *section_name, const char *key_name, SirIndex *csv_size_ret)
 {
     const char *str = sir_section_str(ini, section_name, key_name);
 
@@ -1565,10 +3513,9 @@ SIRDEF const char **sir_section_csv(const SirIni ini,
 
     s = sir__trim_whitespace(s);
 
-    int csv_size = 1;
+    SirIndex csv_size = 1;
 
-    int i;
-    for (i = 0; s[i]; ++i) 
+    for (ptrdiff_t i = 0; s[i]; ++i) 
         if (s[i] == ',')
             ++csv_size;
 
@@ -1577,7 +3524,7 @@ SIRDEF const char **sir_section_csv(const SirIni ini,
     char *start = s;
     char *end   = s;
 
-    i = 0;
+    SirIndex i = 0;
     while (i < csv_size)
     {
         start += sir__skip_whitespace(start);
@@ -1610,4 +3557,3977 @@ SIRDEF void sir_free_csv(SirIni ini, const char **csv)
     }
 }
 
+static void sir__buffer_init(SirBuffer *buffer, FILE *file, 
+        size_t size, void *mem_ctx)
+{
+    (void)mem_ctx;
+
+    buffer->file   = file;
+    buffer->data   = SIR_MALLOC(mem_ctx, size);
+    buffer->used   = 0;
+    buffer->size   = buffer->data ? size : 0;
+    buffer->failed = (file == 0);
+}
+
+static void sir__buffer_flush(SirBuffer *buffer)
+{
+    if (buffer->used && !buffer->failed && 
+            fwrite(buffer->data, 1, buffer->used, buffer->file) < buffer->used)
+        buffer->failed = 1;
+
+    buffer->used = 0;
+}
+
+static void sir__buffer_free(SirBuffer *buffer, void *mem_ctx)
+{
+    (void)mem_ctx;
+
+    sir__buffer_flush(buffer);
+
+    if (buffer->data) SIR_FREE(mem_ctx, buffer->data);
+
+    buffer->data = 0;
+    buffer->size = 0;
+}
+
+static void sir__buffer_write(SirBuffer *buffer, const char *data, 
+        size_t size)
+{
+    if (buffer->used + size > buffer->size)
+    {
+        sir__buffer_flush(buffer);
+
+        // Big strings are written directly rather than copied
+        if (size > buffer->size / 2)
+        {
+            if (!buffer->failed && 
+                    fwrite(data, 1, size, buffer->file) < size)
+                buffer->failed = 1;
+
+            return;
+        }
+    }
+
+    memcpy(buffer->data + buffer->used, data, size);
+    buffer->used += size;
+}
+
+static void sir__buffer_write_str(SirBuffer *buffer, const char *str)
+{
+    sir__buffer_write(buffer, str, strlen(str));
+}
+
+// Returns the number of characters at the start of the 'size' characters at
+// 'str' that can be copied into a JSON string as they are. Eight characters
+// are checked at a time by testing every byte of a 64-bit word at once for
+// control characters, '"' and '\\'.
+static size_t sir__json_safe_prefix(const char *str, size_t size)
+{
+    const unsigned long long ones  = 0x0101010101010101ULL;
+    const unsigned long long highs = 0x8080808080808080ULL;
+
+    size_t n = 0;
+
+    while (n + 8 <= size)
+    {
+        unsigned long long word;
+        memcpy(&word, str + n, 8);
+
+        unsigned long long quotes  = word ^ (ones * '\"');
+        unsigned long long slashes = word ^ (ones * '\\');
+
+        unsigned long long special = 
+            ((word - ones * 0x20) & ~word) |
+            ((quotes - ones) & ~quotes) |
+            ((slashes - ones) & ~slashes);
+
+        if (special & highs)
+            break;
+
+        n += 8;
+    }
+
+    while (n < size && (unsigned char)str[n] >= 0x20 && str[n] != '\"' && 
+            str[n] != '\\')
+        ++n;
+
+    return n;
+}
+
+static void sir__buffer_write_json_str(SirBuffer *buffer, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    const char *end = str + strlen(str);
+
+    sir__buffer_write(buffer, "\"", 1);
+
+    for (;;)
+    {
+        size_t n = sir__json_safe_prefix(str, end - str);
+
+        sir__buffer_write(buffer, str, n);
+
+        str += n;
+
+        if (str == end) break;
+
+        char escaped[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t size = 2;
+
+        switch (*str)
+        {
+            case '\"': escaped[1] = '\"'; break;
+            case '\\': escaped[1] = '\\'; break;
+            case '\n': escaped[1] = 'n';  break;
+            case '\r': escaped[1] = 'r';  break;
+            case '\t': escaped[1] = 't';  break;
+            default:
+                escaped[1] = 'u';
+                escaped[2] = '0';
+                escaped[3] = '0';
+                escaped[4] = hex[(*str >> 4) & 0xf];
+                escaped[5] = hex[*str & 0xf];
+                size = 6;
+        }
+
+        sir__buffer_write(buffer, escaped, size);
+
+        ++str;
+    }
+
+    sir__buffer_write(buffer, "\"", 1);
+}
+
+SIRDEF void sir_write_json(SirIni ini, FILE *file)
+{
+    if (!ini) return;
+
+    SirBuffer buffer;
+    sir__buffer_init(&buffer, file, SIR_WRITE_BUFFER_SIZE, ini->mem_ctx);
+
+    sir__buffer_write(&buffer, "{", 1);
+
+    char first_section = 1;
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+    {
+        SirSection *section = &ini->sections[i];
+
+        if (i == 0)
+        {
+            SirIndex key_count = 0;
+
+            for (SirIndex j = 0; j < section->ranges_count; ++j)
+                for (SirIndex k = section->ranges[j].start; 
+                        k < section->ranges[j].end; ++k)
+                    if (ini->key_names[k])
+                        ++key_count;
+
+            if (!key_count) continue;
+        }
+
+        if (!first_section) sir__buffer_write(&buffer, ",", 1);
+        first_section = 0;
+
+        sir__buffer_write(&buffer, "\n  ", 3);
+        sir__buffer_write_json_str(&buffer, ini->section_names[i]);
+        sir__buffer_write(&buffer, ": {", 3);
+
+        char first_key = 1;
+
+        for (SirIndex j = 0; j < section->ranges_count; ++j)
+        {
+            for (SirIndex k = section->ranges[j].start; 
+                    k < section->ranges[j].end; ++k)
+            {
+                if (!ini->key_names[k]) continue;
+
+                if (!first_key) sir__buffer_write(&buffer, ",", 1);
+                first_key = 0;
+
+                sir__buffer_write(&buffer, "\n    ", 5);
+                sir__buffer_write_json_str(&buffer, ini->key_names[k]);
+                sir__buffer_write(&buffer, ": ", 2);
+                sir__buffer_write_json_str(&buffer, sir__value(ini, k));
+            }
+        }
+
+        sir__buffer_write_str(&buffer, first_key ? "}" : "\n  }");
+    }
+
+    sir__buffer_write_str(&buffer, first_section ? "}\n" : "\n}\n");
+
+    sir__buffer_free(&buffer, ini->mem_ctx);
+
+    if (buffer.failed)
+        sir__set_error(ini, "could not write JSON: %", strerror(errno), 0);
+    else
+        sir__clear_error_str(ini);
+}
+
+SIRDEF void sir_write_ndjson(SirIni ini, FILE *file)
+{
+    if (!ini) return;
+
+    SirBuffer buffer;
+    sir__buffer_init(&buffer, file, SIR_WRITE_BUFFER_SIZE, ini->mem_ctx);
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+    {
+        SirSection *section = &ini->sections[i];
+
+        for (SirIndex j = 0; j < section->ranges_count; ++j)
+        {
+            for (SirIndex k = section->ranges[j].start; 
+                    k < section->ranges[j].end; ++k)
+            {
+                if (!ini->key_names[k]) continue;
+
+                sir__buffer_write_str(&buffer, "{\"section\":");
+                sir__buffer_write_json_str(&buffer, ini->section_names[i]);
+                sir__buffer_write_str(&buffer, ",\"key\":");
+                sir__buffer_write_json_str(&buffer, ini->key_names[k]);
+                sir__buffer_write_str(&buffer, ",\"value\":");
+                sir__buffer_write_json_str(&buffer, sir__value(ini, k));
+                sir__buffer_write(&buffer, "}\n", 2);
+            }
+        }
+    }
+
+    sir__buffer_free(&buffer, ini->mem_ctx);
+
+    if (buffer.failed)
+        sir__set_error(ini, "could not write NDJSON: %", strerror(errno), 0);
+    else
+        sir__clear_error_str(ini);
+}
+
+SIRDEF SirWriter sir_writer_create(FILE *file, void *mem_ctx)
+{
+    SirWriter writer = SIR_MALLOC(mem_ctx, sizeof(*writer));
+
+    if (!writer) return 0;
+
+    memset(writer, 0, sizeof(*writer));
+
+    writer->mem_ctx = mem_ctx;
+
+    sir__buffer_init(&writer->buffer, file, SIR_WRITE_BUFFER_SIZE, mem_ctx);
+
+    if (!writer->buffer.data)
+        writer->error = "SIR_MALLOC failed";
+
+    return writer;
+}
+
+SIRDEF void sir_free_writer(SirWriter writer)
+{
+    if (writer)
+    {
+        sir__buffer_free(&writer->buffer, writer->mem_ctx);
+
+        SIR_FREE(writer->mem_ctx, writer);
+    }
+}
+
+SIRDEF void sir_writer_flush(SirWriter writer)
+{
+    if (!writer) return;
+
+    sir__buffer_flush(&writer->buffer);
+
+    if (writer->buffer.failed && !writer->error)
+        writer->error = "could not write to file";
+}
+
+SIRDEF char sir_writer_has_error(SirWriter writer)
+{
+    return (writer && writer->error);
+}
+
+// Returns 1 if 'str' contains none of the characters in 'forbidden', a 
+// newline or a comment character, and (unless 'allow_outer_whitespace') 
+// doesn't start or end with whitespace.
+static char sir__representable(const char *str, const char *forbidden, 
+        char allow_outer_whitespace)
+{
+    const char *c = str;
+
+    for (; *c; ++c)
+    {
+        if (*c == '\n' || sir__is_comment_char(0, *c) || 
+                *c == SIR_COMMENT_CHAR_ALT || strchr(forbidden, *c))
+            return 0;
+    }
+
+    if (!allow_outer_whitespace && c != str && 
+            ((unsigned char)*str <= ' ' || (unsigned char)c[-1] <= ' '))
+        return 0;
+
+    return 1;
+}
+
+// Same as sir__representable(), but sets 'error' on the writer on failure
+static char sir__writer_valid(SirWriter writer, const char *str, 
+        const char *forbidden, char allow_outer_whitespace, const char *error)
+{
+    if (sir__representable(str, forbidden, allow_outer_whitespace))
+        return 1;
+
+    writer->error = error;
+    return 0;
+}
+
+// Writes the decimal digits of 'value' backwards from 'end', returning the
+// number of digits written.
+static int sir__format_unsigned(char *end, unsigned long long value)
+{
+    char *c = end;
+
+    do
+    {
+        *--c = '0' + (char)(value % 10);
+        value /= 10;
+    }
+    while (value);
+
+    return (int)(end - c);
+}
+
+static void sir__writer_line(SirWriter writer, const char *name, 
+        const char *value, size_t value_size, char quoted)
+{
+    SirBuffer *buffer = &writer->buffer;
+
+    sir__buffer_write_str(buffer, name);
+    sir__buffer_write(buffer, " = ", 3);
+
+    if (quoted) sir__buffer_write(buffer, "\"", 1);
+
+    sir__buffer_write(buffer, value, value_size);
+
+    if (quoted) sir__buffer_write(buffer, "\"", 1);
+
+    sir__buffer_write(buffer, "\n", 1);
+
+    writer->wrote_anything = 1;
+}
+
+SIRDEF void sir_writer_section(SirWriter writer, const char *section_name)
+{
+    if (!writer || !section_name) return;
+
+    if (!sir__writer_valid(writer, section_name, "]", 0,
+                "section name can't be represented in an INI"))
+        return;
+
+    SirBuffer *buffer = &writer->buffer;
+
+    // Separate sections with a blank line
+    if (writer->wrote_anything)
+        sir__buffer_write(buffer, "\n", 1);
+
+    sir__buffer_write(buffer, "[", 1);
+    sir__buffer_write_str(buffer, section_name);
+    sir__buffer_write(buffer, "]\n", 2);
+
+    writer->wrote_anything = 1;
+}
+
+SIRDEF void sir_writer_key(SirWriter writer, const char *key_name, 
+        const char *value)
+{
+    if (!writer || !key_name || !value) return;
+
+    if (!sir__writer_valid(writer, key_name, "[]=:", 0, 
+                "key name can't be represented in an INI") ||
+            !sir__writer_valid(writer, value, "\"", 1,
+                "key value can't be represented in an INI"))
+        return;
+
+    size_t size = strlen(value);
+
+    sir__writer_line(writer, key_name, value, size, 
+            size && ((unsigned char)value[0] <= ' ' || 
+                (unsigned char)value[size - 1] <= ' '));
+}
+
+SIRDEF void sir_writer_long(SirWriter writer, const char *key_name, 
+        long value)
+{
+    if (!writer || !key_name) return;
+
+    if (!sir__writer_valid(writer, key_name, "[]=:", 0, 
+                "key name can't be represented in an INI"))
+        return;
+
+    char digits[24];
+    char *end = digits + sizeof(digits);
+
+    // Negate as unsigned so that LONG_MIN doesn't overflow
+    unsigned long long magnitude = (value < 0) ? 
+        0ULL - (unsigned long long)value : (unsigned long long)value;
+
+    int n = sir__format_unsigned(end, magnitude);
+
+    if (value < 0) end[-++n] = '-';
+
+    sir__writer_line(writer, key_name, end - n, n, 0);
+}
+
+SIRDEF void sir_writer_unsigned_long(SirWriter writer, const char *key_name, 
+        unsigned long value)
+{
+    if (!writer || !key_name) return;
+
+    if (!sir__writer_valid(writer, key_name, "[]=:", 0, 
+                "key name can't be represented in an INI"))
+        return;
+
+    char digits[24];
+    char *end = digits + sizeof(digits);
+
+    int n = sir__format_unsigned(end, value);
+
+    sir__writer_line(writer, key_name, end - n, n, 0);
+}
+
+SIRDEF void sir_writer_double(SirWriter writer, const char *key_name, 
+        double value)
+{
+    if (!writer || !key_name) return;
+
+    if (!sir__writer_valid(writer, key_name, "[]=:", 0, 
+                "key name can't be represented in an INI"))
+        return;
+
+    char digits[40];
+    int n = 0;
+
+    // Look for the smallest number of decimal places that reads back as 
+    // exactly 'value'. Integers below 2^53 and powers of ten up to 10^22 are
+    // exact doubles, so the division is correctly rounded in the same way as
+    // strtod() rounds "<scaled>e-<places>".
+    double magnitude = (value < 0) ? -value : value;
+    double power = 1.0;
+
+    for (int places = 0; places <= 15 && magnitude == magnitude; ++places)
+    {
+        double scaled = magnitude * power;
+
+        if (scaled >= 9007199254740992.0)
+            break;
+
+        unsigned long long integer = (unsigned long long)(scaled + 0.5);
+
+        if ((double)integer / power == magnitude)
+        {
+            char integer_digits[24];
+            char *integer_end = integer_digits + sizeof(integer_digits);
+            int count = sir__format_unsigned(integer_end, integer);
+
+            // Pad with zeroes so there is a digit before the '.'
+            while (count <= places) integer_end[-++count] = '0';
+
+            char *write = digits;
+
+            if (value < 0 || (value == 0 && 1 / value < 0)) *write++ = '-';
+
+            memcpy(write, integer_end - count, count - places);
+            write += count - places;
+
+            if (places)
+            {
+                *write++ = '.';
+                memcpy(write, integer_end - places, places);
+                write += places;
+            }
+
+            n = (int)(write - digits);
+            break;
+        }
+
+        power *= 10.0;
+    }
+
+    if (!n)
+        n = snprintf(digits, sizeof(digits), "%.17g", value);
+
+    sir__writer_line(writer, key_name, digits, n, 0);
+}
+
+SIRDEF void sir_writer_bool(SirWriter writer, const char *key_name, 
+        char value)
+{
+    if (!writer || !key_name) return;
+
+    if (!sir__writer_valid(writer, key_name, "[]=:", 0, 
+                "key name can't be represented in an INI"))
+        return;
+
+    const char *str = value ? SIR__BOOL_TRUE_STRING : SIR__BOOL_FALSE_STRING;
+
+    sir__writer_line(writer, key_name, str, strlen(str), 0);
+}
+
+SIRDEF void sir_writer_comment(SirWriter writer, const char *comment)
+{
+    if (!writer || !comment) return;
+
+    if (strchr(comment, '\n'))
+    {
+        writer->error = "comment can't contain a newline";
+        return;
+    }
+
+    char prefix[2] = { SIR_COMMENT_CHAR, ' ' };
+
+    sir__buffer_write(&writer->buffer, prefix, 2);
+    sir__buffer_write_str(&writer->buffer, comment);
+    sir__buffer_write(&writer->buffer, "\n", 1);
+
+    writer->wrote_anything = 1;
+}
+
+static ptrdiff_t sir__source_line_start(SirIni ini, ptrdiff_t offset)
+{
+    while (offset > 0 && ini->source[offset - 1] != '\n') --offset;
+
+    return offset;
+}
+
+// Returns the offset just after the newline that ends the line containing
+// 'offset', or the size of the source if it is the last line
+static ptrdiff_t sir__source_line_end(SirIni ini, ptrdiff_t offset)
+{
+    const char *newline = memchr(ini->source + offset, '\n', 
+            (size_t)(ini->source_size - offset));
+
+    return newline ? (newline - ini->source) + 1 : ini->source_size;
+}
+
+// Records where the key at 'index' is in ini->source. 'key_name' and 
+// 'key_value' point into ini->data, which has the same layout as the source.
+static void sir__set_key_span(SirIni ini, SirIndex index, const char *key_name,
+        const char *key_value)
+{
+    SirKeySpan *span = &ini->key_spans[index];
+
+    ptrdiff_t name_start = key_name - ini->data;
+
+    if (key_value >= ini->data && key_value <= ini->data + ini->source_size)
+    {
+        span->value_start = key_value - ini->data;
+        span->value_end   = span->value_start + (ptrdiff_t)strlen(key_value);
+    }
+    else
+    {
+        span->value_start = -1;
+        span->value_end   = name_start + (ptrdiff_t)strlen(key_name);
+    }
+
+    span->line_start = sir__source_line_start(ini, name_start);
+    span->line_end   = sir__source_line_end(ini, span->value_end);
+}
+
+// Returns 'size' bytes from the INI's arena. The memory is only freed by
+// sir_free_ini().
+static char *sir__arena_alloc(SirIni ini, size_t size)
+{
+    SirArenaBlock *block = ini->arena;
+
+    if (!block || block->size - block->used < size)
+    {
+        size_t block_size = (size > SIR_ARENA_BLOCK_SIZE) ?
+            size : SIR_ARENA_BLOCK_SIZE;
+
+        SirArenaBlock *new_block = SIR_MALLOC(ini->mem_ctx,
+                sizeof(*new_block) + block_size);
+
+        if (!new_block) return 0;
+
+        new_block->used = 0;
+        new_block->size = block_size;
+
+        // A block that only fits one big string goes behind the current
+        // block, so that what is left of the current block can still be used
+        if (block && size > SIR_ARENA_BLOCK_SIZE)
+        {
+            new_block->next = block->next;
+            block->next = new_block;
+        }
+        else
+        {
+            new_block->next = block;
+            ini->arena = new_block;
+        }
+
+        block = new_block;
+    }
+
+    char *mem = (char *)(block + 1) + block->used;
+    block->used += size;
+
+    return mem;
+}
+
+static const char *sir__arena_strdup(SirIni ini, const char *str)
+{
+    size_t size = strlen(str) + 1;
+    char *copy = sir__arena_alloc(ini, size);
+
+    if (copy) memcpy(copy, str, size);
+
+    return copy;
+}
+
+// Adds an empty section and returns its index. The section and key arrays
+// double in size when they are full.
+static SirIndex sir__add_section(SirIni ini, const char *section_name)
+{
+    if (ini->section_count == ini->sections_size)
+    {
+        ini->sections_size = ini->sections_size ? ini->sections_size * 2 : 8;
+
+        ini->sections = SIR_REALLOC(ini->mem_ctx, (void *)ini->sections,
+                sizeof(*ini->sections) * ini->sections_size);
+        ini->section_names = SIR_REALLOC(ini->mem_ctx,
+                (void *)ini->section_names,
+                sizeof(*ini->section_names) * ini->sections_size);
+
+        if (ini->inheritance)
+            ini->inheritance = SIR_REALLOC(ini->mem_ctx, ini->inheritance,
+                    sizeof(*ini->inheritance) * ini->sections_size);
+    }
+
+    SirIndex index = ini->section_count++;
+    SirSection *section = &ini->sections[index];
+
+    section->ranges_count = 1;
+    section->ranges = SIR_MALLOC(ini->mem_ctx, sizeof(*section->ranges));
+    section->ranges[0].start      = ini->key_count;
+    section->ranges[0].end        = ini->key_count;
+    section->ranges[0].header_end = -1;
+
+    ini->section_names[index] = sir__arena_strdup(ini, section_name);
+
+    if (ini->inheritance)
+    {
+        memset(&ini->inheritance[index], 0, sizeof(*ini->inheritance));
+        ini->inheritance[index].parent = -1;
+    }
+
+    return index;
+}
+
+// Adds a key to the end of the key arrays. The last range of the section is
+// extended if it ends at the last key, otherwise a new range is started.
+static void sir__add_key(SirIni ini, SirIndex section_index,
+        const char *key_name, const char *value)
+{
+    if (ini->key_count == ini->keys_size)
+    {
+        ini->keys_size = ini->keys_size ? ini->keys_size * 2 : 16;
+
+        ini->key_names = SIR_REALLOC(ini->mem_ctx, (void *)ini->key_names,
+                sizeof(*ini->key_names) * ini->keys_size);
+        ini->key_values = SIR_REALLOC(ini->mem_ctx, (void *)ini->key_values,
+                sizeof(*ini->key_values) * ini->keys_size);
+
+        if (ini->interpolations)
+            ini->interpolations = SIR_REALLOC(ini->mem_ctx,
+                    ini->interpolations,
+                    sizeof(*ini->interpolations) * ini->keys_size);
+
+        if (ini->escaped)
+            ini->escaped = SIR_REALLOC(ini->mem_ctx, ini->escaped,
+                    sizeof(*ini->escaped) * ini->keys_size);
+    }
+
+    SirIndex index = ini->key_count++;
+
+    if (ini->escaped) ini->escaped[index] = 0;
+
+    sir__free_key_name_index(ini);
+    sir__free_value_index(ini);
+
+    ini->key_names[index]  = sir__arena_strdup(ini, key_name);
+    ini->key_values[index] = sir__arena_strdup(ini, value);
+
+    if (ini->interpolations)
+    {
+        memset(&ini->interpolations[index], 0, 
+                sizeof(*ini->interpolations));
+        ini->interpolations[index].raw_value = ini->key_values[index];
+    }
+
+    SirSection *section = &ini->sections[section_index];
+    SirSectionRange *range = &section->ranges[section->ranges_count - 1];
+
+    if (range->end == index)
+    {
+        ++range->end;
+        return;
+    }
+
+    ++section->ranges_count;
+    section->ranges = SIR_REALLOC(ini->mem_ctx, section->ranges,
+            sizeof(*section->ranges) * section->ranges_count);
+
+    range = &section->ranges[section->ranges_count - 1];
+    range->start      = index;
+    range->end        = index + 1;
+    range->header_end = -1;
+}
+
+// Returns a newly allocated string made of each of the strings in 'parts'
+static char *sir__join(SirIni ini, const char **parts, int parts_count, 
+        size_t *size_ret)
+{
+    (void)ini;
+
+    size_t size = 0;
+
+    for (int i = 0; i < parts_count; ++i)
+        size += strlen(parts[i]);
+
+    char *str = SIR_MALLOC(ini->mem_ctx, size + 1);
+    char *write = str;
+
+    for (int i = 0; i < parts_count; ++i)
+    {
+        size_t n = strlen(parts[i]);
+        memcpy(write, parts[i], n);
+        write += n;
+    }
+
+    *write = '\0';
+
+    if (size_ret) *size_ret = size;
+
+    return str;
+}
+
+static void sir__free_patch(SirIni ini, SirPatch *patch)
+{
+    (void)ini;
+
+    if (patch->text) SIR_FREE(ini->mem_ctx, patch->text);
+}
+
+// Adds a patch that replaces [start, end) of the source with 'text', which
+// must have been allocated with SIR_MALLOC and is owned by the patch. A patch
+// that replaces exactly the same bytes is overwritten. Patches with 
+// start == end are insertions; they are kept in the order they were added, 
+// before any patch that replaces bytes from the same position.
+static SirPatch *sir__add_patch(SirIni ini, ptrdiff_t start, ptrdiff_t end, 
+        char *text, size_t text_size)
+{
+    char insertion = (start == end);
+
+    // Binary search for the first patch that must come after this one
+    SirIndex low  = 0;
+    SirIndex high = ini->patches_count;
+
+    while (low < high)
+    {
+        SirIndex middle = low + (high - low) / 2;
+        SirPatch *p = &ini->patches[middle];
+
+        if (p->start < start || (p->start == start && 
+                    (!insertion || p->start == p->end)))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (!insertion && low > 0 && ini->patches[low - 1].start == start &&
+            ini->patches[low - 1].end == end)
+    {
+        SirPatch *patch = &ini->patches[low - 1];
+
+        sir__free_patch(ini, patch);
+        memset(patch, 0, sizeof(*patch));
+
+        patch->start     = start;
+        patch->end       = end;
+        patch->text      = text;
+        patch->text_size = text_size;
+
+        return patch;
+    }
+
+    if (ini->patches_count == ini->patches_size)
+    {
+        ini->patches_size = ini->patches_size ? ini->patches_size * 2 : 8;
+        ini->patches = SIR_REALLOC(ini->mem_ctx, ini->patches,
+                sizeof(*ini->patches) * ini->patches_size);
+    }
+
+    memmove(&ini->patches[low + 1], &ini->patches[low], 
+            sizeof(*ini->patches) * (ini->patches_count - low));
+
+    ++ini->patches_count;
+
+    SirPatch *patch = &ini->patches[low];
+    memset(patch, 0, sizeof(*patch));
+
+    patch->start     = start;
+    patch->end       = end;
+    patch->text      = text;
+    patch->text_size = text_size;
+
+    return patch;
+}
+
+// Sets an error and returns 0 if the names are missing
+static char sir__check_editable(SirIni ini, const char *section_name,
+        const char *key_name)
+{
+    if (!section_name)
+    {
+        sir__set_error(ini,
+                "the parameter 'section_name' is not optional", 0, 0);
+        return 0;
+    }
+
+    if (!key_name)
+    {
+        sir__set_error(ini, "the parameter 'key_name' is not optional",
+                0, 0);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Adds a patch that replaces the value of the key at 'index' in the source
+static void sir__patch_value(SirIni ini, SirIndex index, const char *key_name,
+        const char *value)
+{
+    SirKeySpan *span = &ini->key_spans[index];
+
+    size_t value_size = strlen(value);
+    const char *quote = (value_size &&
+            ((unsigned char)value[0] <= ' ' || 
+             (unsigned char)value[value_size - 1] <= ' ')) ? "\"" : "";
+
+    char *text;
+    size_t text_size;
+
+    // Escaped values replace the whole line, since they bring their own 
+    // quotes
+    char *escaped = sir__escape_value(ini, value);
+
+    if (escaped)
+    {
+        const char *newline = (ini->source[span->line_end - 1] == '\n') ?
+            "\n" : "";
+        const char *parts[] = { key_name, " = ", escaped, newline };
+
+        text = sir__join(ini, parts, 4, &text_size);
+        sir__add_patch(ini, span->line_start, span->line_end,
+                text, text_size);
+
+        SIR_FREE(ini->mem_ctx, escaped);
+    }
+    else if (span->value_start == -1)
+    {
+        const char *newline = (ini->source[span->line_end - 1] == '\n') ?
+            "\n" : "";
+        const char *parts[] = {
+            key_name, " = ", quote, value, quote, newline
+        };
+
+        text = sir__join(ini, parts, 6, &text_size);
+        sir__add_patch(ini, span->line_start, span->line_end,
+                text, text_size);
+    }
+    else
+    {
+        // Values that were quoted stay quoted
+        if (span->value_start > 0 &&
+                ini->source[span->value_start - 1] == '\"')
+            quote = "";
+
+        const char *parts[] = { quote, value, quote };
+
+        text = sir__join(ini, parts, 3, &text_size);
+        sir__add_patch(ini, span->value_start, span->value_end,
+                text, text_size);
+    }
+}
+
+SIRDEF void sir_set(SirIni ini, const char *section_name,
+        const char *key_name, const char *value)
+{
+    if (!ini) return;
+
+    if (!sir__check_editable(ini, section_name, key_name))
+        return;
+
+    if (!value)
+    {
+        sir__set_error(ini, "the parameter 'value' is not optional", 0, 0);
+        return;
+    }
+
+    if (!sir__representable(section_name, "]", 0))
+    {
+        sir__set_error(ini, "section name '%' can't be represented in an INI",
+                section_name, 0);
+        return;
+    }
+
+    if (!sir__representable(key_name, "[]=:", 0))
+    {
+        sir__set_error(ini, "key name '%' can't be represented in an INI",
+                key_name, 0);
+        return;
+    }
+
+    // Values are escaped when they're saved if escapes are enabled
+    if (!(ini->options & SIR_OPTION_ENABLE_ESCAPES) && 
+            !sir__representable(value, "\"", 1))
+    {
+        sir__set_error(ini, "value '%' can't be represented in an INI",
+                value, 0);
+        return;
+    }
+
+    SirIndex section_index = sir__section_index(ini, section_name);
+    SirIndex index = (section_index != -1) ?
+        sir__section_key_index(ini, &ini->sections[section_index],
+                key_name) : -1;
+
+    if (index == -1)
+    {
+        if (section_index == -1)
+            section_index = sir__add_section(ini, section_name);
+
+        sir__add_key(ini, section_index, key_name, value);
+
+        if (ini->inheritance)
+            sir__build_inheritance(ini);
+    }
+    else
+    {
+        // Keys added by sir_set() are written from memory by sir_save(), so
+        // only keys from the source need a patch
+        if (ini->source && index < ini->source_key_count)
+            sir__patch_value(ini, index, key_name, value);
+
+        ini->key_values[index] = sir__arena_strdup(ini, value);
+
+        if (ini->escaped) ini->escaped[index] = 0;
+
+        sir__invalidate(ini, index);
+        sir__free_value_index(ini);
+    }
+
+    sir__clear_error_str(ini);
+}
+
+SIRDEF void sir_delete(SirIni ini, const char *section_name,
+        const char *key_name)
+{
+    if (!ini) return;
+
+    if (!sir__check_editable(ini, section_name, key_name))
+        return;
+
+    SirSection *section = sir__get_section(ini, section_name);
+
+    if (!section) return;
+
+    SirIndex index = sir__section_key_index(ini, section, key_name);
+
+    if (index == -1)
+    {
+        sir__set_error(ini, "key '%' not found in section '%'",
+                key_name, section_name);
+        return;
+    }
+
+    if (ini->source && index < ini->source_key_count)
+    {
+        SirKeySpan *span = &ini->key_spans[index];
+
+        // Remove any edits to the value
+        SirIndex write = 0;
+        for (SirIndex i = 0; i < ini->patches_count; ++i)
+        {
+            SirPatch *patch = &ini->patches[i];
+
+            if (patch->start >= span->line_start &&
+                    patch->end <= span->line_end)
+            {
+                sir__free_patch(ini, patch);
+                continue;
+            }
+
+            ini->patches[write++] = *patch;
+        }
+
+        ini->patches_count = write;
+
+        char *text = SIR_MALLOC(ini->mem_ctx, 1);
+        *text = '\0';
+
+        sir__add_patch(ini, span->line_start, span->line_end, text, 0);
+    }
+
+    ini->key_names[index]  = 0;
+    ini->key_values[index] = "";
+
+    if (ini->escaped) ini->escaped[index] = 0;
+    sir__invalidate(ini, index);
+    sir__free_key_name_index(ini);
+    sir__free_value_index(ini);
+
+    if (ini->inheritance)
+        sir__build_inheritance(ini);
+
+    sir__clear_error_str(ini);
+}
+
+// Returns the offset in the source that keys added to 'section' by sir_set()
+// are written at: after the last key of the last range of the section that
+// came from the source, or after its header if that range has no keys
+static ptrdiff_t sir__section_insert_position(SirIni ini, 
+        SirSection *section)
+{
+    for (SirIndex i = section->ranges_count - 1; i >= 0; --i)
+    {
+        SirSectionRange *range = &section->ranges[i];
+
+        if (range->header_end == -1) continue;
+
+        SirIndex end = (range->end < ini->source_key_count) ?
+            range->end : ini->source_key_count;
+
+        return (end > range->start) ?
+            ini->key_spans[end - 1].line_end : range->header_end;
+    }
+
+    return ini->source_size;
+}
+
+// Returns 1 if the section has any keys that haven't been deleted at
+// 'first_key' or after
+static char sir__section_has_keys(SirIni ini, SirIndex section_index,
+        SirIndex first_key)
+{
+    SirSection *section = &ini->sections[section_index];
+
+    for (SirIndex i = 0; i < section->ranges_count; ++i)
+    {
+        SirIndex start = section->ranges[i].start;
+
+        if (start < first_key) start = first_key;
+
+        for (SirIndex j = start; j < section->ranges[i].end; ++j)
+            if (ini->key_names[j])
+                return 1;
+    }
+
+    return 0;
+}
+
+// Writes to 'buffer' and remembers the last character written in 'last'
+static void sir__save_write(SirBuffer *buffer, const char *data,
+        size_t size, char *last)
+{
+    if (size == 0) return;
+
+    sir__buffer_write(buffer, data, size);
+    *last = data[size - 1];
+}
+
+// Writes the keys of a section from index 'first_key' onwards, preceded by
+// the section header if 'header' is set. 'last' is the last character that
+// was written, or 0 if nothing has been written.
+static void sir__save_section(SirIni ini, SirBuffer *buffer,
+        SirIndex section_index, SirIndex first_key, char header, char *last)
+{
+    SirSection *section = &ini->sections[section_index];
+
+    if (*last && *last != '\n')
+        sir__save_write(buffer, "\n", 1, last);
+
+    if (header)
+    {
+        // Separate sections with a blank line
+        if (*last)
+            sir__save_write(buffer, "\n", 1, last);
+
+        sir__save_write(buffer, "[", 1, last);
+        sir__buffer_write_str(buffer, ini->section_names[section_index]);
+        sir__save_write(buffer, "]\n", 2, last);
+    }
+
+    for (SirIndex i = 0; i < section->ranges_count; ++i)
+    {
+        SirIndex start = section->ranges[i].start;
+
+        if (start < first_key) start = first_key;
+
+        for (SirIndex j = start; j < section->ranges[i].end; ++j)
+        {
+            // Skip keys removed by sir_delete()
+            if (!ini->key_names[j]) continue;
+
+            const char *value = sir__raw_value(ini, j);
+            char *escaped = sir__escape_value(ini, value);
+            size_t size = strlen(value);
+            char quoted = size && ((unsigned char)value[0] <= ' ' || 
+                    (unsigned char)value[size - 1] <= ' ');
+
+            sir__buffer_write_str(buffer, ini->key_names[j]);
+            sir__buffer_write(buffer, " = ", 3);
+
+            if (escaped)
+            {
+                sir__buffer_write_str(buffer, escaped);
+                sir__save_write(buffer, "\n", 1, last);
+                SIR_FREE(ini->mem_ctx, escaped);
+                continue;
+            }
+
+            if (quoted) sir__buffer_write(buffer, "\"", 1);
+
+            sir__buffer_write(buffer, value, size);
+
+            if (quoted) sir__buffer_write(buffer, "\"", 1);
+
+            sir__save_write(buffer, "\n", 1, last);
+        }
+    }
+}
+
+SIRDEF void sir_save(SirIni ini, const char *filename)
+{
+    if (!ini) return;
+
+    if (!filename)
+    {
+        sir__set_error(ini, "the parameter 'filename' is not optional",
+                0, 0);
+        return;
+    }
+
+    FILE *file = fopen(filename, "wb");
+
+    if (!file)
+    {
+        sir__set_error(ini, "%: %", filename, strerror(errno));
+        return;
+    }
+
+    SirBuffer buffer;
+    sir__buffer_init(&buffer, file, SIR_WRITE_BUFFER_SIZE, ini->mem_ctx);
+
+    char last = 0;
+
+    if (!ini->source)
+    {
+        for (SirIndex i = 0; i < ini->section_count; ++i)
+        {
+            char header = (i != 0);
+
+            // The global section has no header, so it is only written if it
+            // has keys
+            if (!header && !sir__section_has_keys(ini, i, 0))
+                continue;
+
+            sir__save_section(ini, &buffer, i, 0, header, &last);
+        }
+    }
+    else
+    {
+        // Sections that sir_set() added keys to, in the order that the keys
+        // have to be written in. Sections added by sir_set() go at the end
+        // of the source.
+        SirIndex *inserts = SIR_MALLOC(ini->mem_ctx,
+                sizeof(*inserts) * (ini->section_count + 1));
+        ptrdiff_t *positions = SIR_MALLOC(ini->mem_ctx,
+                sizeof(*positions) * (ini->section_count + 1));
+        SirIndex inserts_count = 0;
+
+        for (SirIndex i = 0; i < ini->section_count; ++i)
+        {
+            SirSection *section = &ini->sections[i];
+            ptrdiff_t position;
+
+            if (section->ranges[0].header_end == -1)
+            {
+                position = ini->source_size;
+            }
+            else if (sir__section_has_keys(ini, i, ini->source_key_count))
+            {
+                position = sir__section_insert_position(ini, section);
+            }
+            else
+            {
+                continue;
+            }
+
+            // Insertion sort, keeping sections with the same position in
+            // index order
+            SirIndex j = inserts_count++;
+
+            while (j > 0 && positions[j - 1] > position)
+            {
+                inserts[j]   = inserts[j - 1];
+                positions[j] = positions[j - 1];
+                --j;
+            }
+
+            inserts[j]   = i;
+            positions[j] = position;
+        }
+
+        // Unchanged text between patches is big enough to be written
+        // directly
+        ptrdiff_t position = 0;
+        SirIndex patch_index = 0;
+        SirIndex insert_index = 0;
+
+        while (patch_index < ini->patches_count ||
+                insert_index < inserts_count)
+        {
+            SirPatch *patch = (patch_index < ini->patches_count) ?
+                &ini->patches[patch_index] : 0;
+
+            if (insert_index < inserts_count &&
+                    (!patch || positions[insert_index] <= patch->start))
+            {
+                SirIndex section_index = inserts[insert_index];
+
+                sir__save_write(&buffer, ini->source + position,
+                        positions[insert_index] - position, &last);
+                sir__save_section(ini, &buffer, section_index,
+                        ini->source_key_count,
+                        ini->sections[section_index].ranges[0].header_end
+                        == -1, &last);
+
+                position = positions[insert_index];
+                ++insert_index;
+            }
+            else
+            {
+                sir__save_write(&buffer, ini->source + position,
+                        patch->start - position, &last);
+                sir__save_write(&buffer, patch->text, patch->text_size,
+                        &last);
+
+                position = patch->end;
+                ++patch_index;
+            }
+        }
+
+        sir__save_write(&buffer, ini->source + position,
+                ini->source_size - position, &last);
+
+        SIR_FREE(ini->mem_ctx, inserts);
+        SIR_FREE(ini->mem_ctx, positions);
+    }
+
+    sir__buffer_free(&buffer, ini->mem_ctx);
+
+    if (fclose(file) || buffer.failed)
+        sir__set_error(ini, "%: %", filename, strerror(errno));
+    else
+        sir__clear_error_str(ini);
+}
+
+// FNV-1a hash of 'str', continuing from 'hash'. The terminator is hashed too,
+// so that several strings can be hashed one after the other without
+// ("ab", "c") and ("a", "bc") hashing the same.
+static unsigned int sir__hash_str(unsigned int hash, const char *str,
+        char case_insensitive)
+{
+    while (*str)
+    {
+        unsigned long c = sir__next_char(&str, case_insensitive);
+
+        // Folded code points above 0xFF are hashed a byte at a time
+        for (; c > 0xFF; c >>= 8)
+            hash = (hash ^ (unsigned int)(c & 0xFF)) * SIR__HASH_PRIME;
+
+        hash = (hash ^ (unsigned int)c) * SIR__HASH_PRIME;
+    }
+
+    return hash * SIR__HASH_PRIME;
+}
+
+// Allocates an empty hash table with room for 'count' entries. The number of
+// slots is a power of two that is at least twice 'count', so lookups stay
+// short and there is always an empty slot to stop at.
+static SirHashSlot *sir__hash_slots_create(SirIndex count, size_t *mask_ret,
+        void *mem_ctx)
+{
+    (void)mem_ctx;
+
+    size_t size = 8;
+
+    while (size < (size_t)count * 2)
+        size *= 2;
+
+    SirHashSlot *slots = SIR_MALLOC(mem_ctx, sizeof(*slots) * size);
+
+    if (!slots) return 0;
+
+    for (size_t i = 0; i < size; ++i)
+        slots[i].index = -1;
+
+    *mask_ret = size - 1;
+
+    return slots;
+}
+
+static const char *sir__overlay_section_name(SirOverlay overlay,
+        const SirOverlayKey *key)
+{
+    return overlay->layers[key->layer]->section_names[key->section];
+}
+
+static const char *sir__overlay_key_name(SirOverlay overlay,
+        const SirOverlayKey *key)
+{
+    return overlay->layers[key->layer]->key_names[key->key];
+}
+
+// Returns the slot that holds the key, or the empty slot it would go in. If
+// 'section_name' is 0 the key is looked for in 'keys', otherwise in
+// 'section_keys'.
+static SirHashSlot *sir__overlay_slot(SirOverlay overlay, unsigned int hash,
+        const char *section_name, const char *key_name)
+{
+    SirHashSlot *slots = section_name ?
+        overlay->section_key_slots : overlay->key_slots;
+    SirOverlayKey *entries = section_name ?
+        overlay->section_keys : overlay->keys;
+
+    for (size_t i = hash & overlay->mask; ;
+            i = (i + 1) & overlay->mask)
+    {
+        SirHashSlot *slot = &slots[i];
+
+        if (slot->index == -1) return slot;
+
+        if (slot->hash != hash) continue;
+
+        SirOverlayKey *key = &entries[slot->index];
+        const char *name = sir__overlay_key_name(overlay, key);
+
+        // Skip keys deleted since the overlay was made
+        if (!name) continue;
+
+        if (sir__str_equal_case(name, key_name, overlay->case_insensitive) &&
+                (!section_name || sir__str_equal_case(
+                    sir__overlay_section_name(overlay, key), section_name,
+                    overlay->case_insensitive)))
+            return slot;
+    }
+}
+
+static SirOverlayKey *sir__overlay_find(SirOverlay overlay,
+        const char *section_name, const char *key_name)
+{
+    char ci = overlay->case_insensitive;
+
+    unsigned int hash = section_name ?
+        sir__hash_str(sir__hash_str(SIR__HASH_SEED, section_name, ci),
+                key_name, ci) :
+        sir__hash_str(SIR__HASH_SEED, key_name, ci);
+
+    SirHashSlot *slot = sir__overlay_slot(overlay, hash, section_name,
+            key_name);
+
+    if (slot->index == -1) return 0;
+
+    return section_name ? &overlay->section_keys[slot->index] :
+        &overlay->keys[slot->index];
+}
+
+SIRDEF SirOverlay sir_overlay(SirIni base, SirIni *overrides,
+        int overrides_count)
+{
+    if (!base) return 0;
+
+    void *mem_ctx = base->mem_ctx;
+
+    SirOverlay overlay = SIR_MALLOC(mem_ctx, sizeof(*overlay));
+
+    if (!overlay) return 0;
+
+    memset(overlay, 0, sizeof(*overlay));
+
+    overlay->mem_ctx = mem_ctx;
+    overlay->case_insensitive = sir__folding(base->options);
+
+    overlay->layers = SIR_MALLOC(mem_ctx,
+            sizeof(*overlay->layers) * (overrides_count + 1));
+
+    if (!overlay->layers)
+    {
+        sir_free_overlay(overlay);
+        return 0;
+    }
+
+    overlay->layers[overlay->layers_count++] = base;
+
+    SirIndex total_keys = base->key_count;
+
+    for (int i = 0; i < overrides_count; ++i)
+    {
+        overlay->layers[overlay->layers_count++] = overrides[i];
+
+        if (overrides[i]) total_keys += overrides[i]->key_count;
+    }
+
+    overlay->section_keys = SIR_MALLOC(mem_ctx,
+            sizeof(*overlay->section_keys) * (total_keys + 1));
+    overlay->keys = SIR_MALLOC(mem_ctx,
+            sizeof(*overlay->keys) * (total_keys + 1));
+    overlay->section_key_slots = sir__hash_slots_create(total_keys,
+            &overlay->mask, mem_ctx);
+    overlay->key_slots = sir__hash_slots_create(total_keys,
+            &overlay->mask, mem_ctx);
+
+    if (!overlay->section_keys || !overlay->keys ||
+            !overlay->section_key_slots || !overlay->key_slots)
+    {
+        sir_free_overlay(overlay);
+        return 0;
+    }
+
+    char ci = overlay->case_insensitive;
+
+    // Layers are added from the bottom up, so a key in a higher layer
+    // replaces the one below it
+    for (int layer = 0; layer < overlay->layers_count; ++layer)
+    {
+        SirIni ini = overlay->layers[layer];
+
+        if (!ini) continue;
+
+        for (SirIndex section = 0; section < ini->section_count; ++section)
+        {
+            SirSection *ranges = &ini->sections[section];
+
+            unsigned int section_hash = sir__hash_str(SIR__HASH_SEED,
+                    ini->section_names[section], ci);
+
+            for (SirIndex i = 0; i < ranges->ranges_count; ++i)
+            {
+                for (SirIndex j = ranges->ranges[i].start;
+                        j < ranges->ranges[i].end; ++j)
+                {
+                    const char *key_name = ini->key_names[j];
+
+                    if (!key_name) continue;
+
+                    SirOverlayKey key = { layer, section, j };
+
+                    unsigned int hash = sir__hash_str(section_hash,
+                            key_name, ci);
+                    SirHashSlot *slot = sir__overlay_slot(overlay, hash,
+                            ini->section_names[section], key_name);
+
+                    if (slot->index == -1)
+                    {
+                        slot->hash  = hash;
+                        slot->index = overlay->section_keys_count++;
+                    }
+
+                    overlay->section_keys[slot->index] = key;
+
+                    // Within one layer, the key found when searching every
+                    // section is the first one, or the last one if
+                    // duplicates override
+                    hash = sir__hash_str(SIR__HASH_SEED, key_name, ci);
+                    slot = sir__overlay_slot(overlay, hash, 0, key_name);
+
+                    if (slot->index == -1)
+                    {
+                        slot->hash  = hash;
+                        slot->index = overlay->keys_count++;
+                        overlay->keys[slot->index] = key;
+                        continue;
+                    }
+
+                    SirOverlayKey *winner = &overlay->keys[slot->index];
+
+                    if (winner->layer < layer ||
+                            ((ini->options &
+                              SIR_OPTION_OVERRIDE_DUPLICATE_KEYS) ?
+                             j > winner->key : j < winner->key))
+                        *winner = key;
+                }
+            }
+        }
+    }
+
+    return overlay;
+}
+
+SIRDEF void sir_free_overlay(SirOverlay overlay)
+{
+    if (overlay)
+    {
+        if (overlay->layers)
+            SIR_FREE(overlay->mem_ctx, overlay->layers);
+        if (overlay->section_keys)
+            SIR_FREE(overlay->mem_ctx, overlay->section_keys);
+        if (overlay->keys)
+            SIR_FREE(overlay->mem_ctx, overlay->keys);
+        if (overlay->section_key_slots)
+            SIR_FREE(overlay->mem_ctx, overlay->section_key_slots);
+        if (overlay->key_slots)
+            SIR_FREE(overlay->mem_ctx, overlay->key_slots);
+
+        SIR_FREE(overlay->mem_ctx, overlay);
+    }
+}
+
+SIRDEF const char *sir_overlay_str(SirOverlay overlay,
+        const char *section_name, const char *key_name)
+{
+    if (!overlay || !key_name) return 0;
+
+    SirOverlayKey *key = sir__overlay_find(overlay, section_name, key_name);
+
+    return key ? sir__value(overlay->layers[key->layer], key->key) : 0;
+}
+
+SIRDEF int sir_overlay_layer(SirOverlay overlay, const char *section_name,
+        const char *key_name)
+{
+    if (!overlay || !key_name) return -1;
+
+    SirOverlayKey *key = sir__overlay_find(overlay, section_name, key_name);
+
+    return key ? key->layer : -1;
+}
+
+// Transcodes 'size' bytes of UTF-16LE at 'src' to UTF-8 at 'dest' and 
+// returns the size of the UTF-8. No unit takes more than 3 bytes, so 'dest'
+// can be in the same buffer as long as it starts at least size / 2 bytes 
+// before 'src'. Unpaired surrogates become U+FFFD and an odd last byte is 
+// dropped. Runs of ASCII are transcoded 4 units at a time.
+static size_t sir__utf16le_to_utf8(char *dest, const unsigned char *src, 
+        size_t size)
+{
+    // The bits that are 0 in 4 ASCII units, in the same order in memory on
+    // any machine
+    static const unsigned char ascii_bytes[8] = { 
+        0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF 
+    };
+
+    unsigned long long ascii_mask;
+    memcpy(&ascii_mask, ascii_bytes, sizeof(ascii_mask));
+
+    unsigned char *write = (unsigned char *)dest;
+    size_t i = 0;
+
+    while (i + 1 < size)
+    {
+        if (size - i >= 8)
+        {
+            unsigned long long word;
+            memcpy(&word, src + i, sizeof(word));
+
+            if (!(word & ascii_mask))
+            {
+                unsigned char a = src[i], b = src[i + 2];
+                unsigned char c = src[i + 4], d = src[i + 6];
+
+                write[0] = a;
+                write[1] = b;
+                write[2] = c;
+                write[3] = d;
+
+                write += 4;
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned long code = src[i] | (src[i + 1] << 8);
+        i += 2;
+
+        if (code >= 0xD800 && code <= 0xDFFF)
+        {
+            unsigned long low = (i + 1 < size) ? 
+                (unsigned long)(src[i] | (src[i + 1] << 8)) : 0;
+
+            if (code <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF)
+            {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+            else
+            {
+                code = 0xFFFD;
+            }
+        }
+
+        if (code < 0x80)
+        {
+            *write++ = (unsigned char)code;
+        }
+        else if (code < 0x800)
+        {
+            *write++ = (unsigned char)(0xC0 | (code >> 6));
+            *write++ = (unsigned char)(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            *write++ = (unsigned char)(0xE0 | (code >> 12));
+            *write++ = (unsigned char)(0x80 | ((code >> 6) & 0x3F));
+            *write++ = (unsigned char)(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            *write++ = (unsigned char)(0xF0 | (code >> 18));
+            *write++ = (unsigned char)(0x80 | ((code >> 12) & 0x3F));
+            *write++ = (unsigned char)(0x80 | ((code >> 6) & 0x3F));
+            *write++ = (unsigned char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    return (size_t)(write - (unsigned char *)dest);
+}
+
+// Reads the whole of 'filename' into a null-terminated string allocated with
+// SIR_MALLOC. Returns 0 and points 'error_ret' at a message on failure.
+static char *sir__read_file(const char *filename, size_t *size_ret,
+        const char **error_ret, void *mem_ctx)
+{
+    (void)mem_ctx;
+
+    FILE *file = fopen(filename, "rb");
+
+    if (!file)
+    {
+        *error_ret = strerror(errno);
+        return 0;
+    }
+
+    // fstat() has a 64-bit size where ftell() has a 32-bit long, e.g. on
+    // Windows. Plain ISO C only has ftell().
+    long long file_size = -1;
+
+#if defined(_WIN32)
+    struct __stat64 st;
+
+    if (_fstat64(_fileno(file), &st) == 0) file_size = st.st_size;
+#elif defined(SIR__HAS_FILE_SYSTEM)
+    struct stat st;
+
+    if (fstat(fileno(file), &st) == 0) file_size = st.st_size;
+#else
+    if (fseek(file, 0, SEEK_END) == 0)
+    {
+        file_size = ftell(file);
+        rewind(file);
+    }
+#endif
+
+    if (file_size < 0)
+    {
+        fclose(file);
+        *error_ret = strerror(errno);
+        return 0;
+    }
+
+    // A UTF-16 file can take up to half as much again as UTF-8
+    if ((unsigned long long)file_size >= (size_t)-1 / 2)
+    {
+        fclose(file);
+        *error_ret = "file is too big to load";
+        return 0;
+    }
+
+    size_t size = (size_t)file_size;
+
+    // A UTF-16LE file is read into the end of a buffer that is big enough 
+    // for it as UTF-8, and transcoded towards the start of the same buffer
+    unsigned char bom[2];
+    size_t bom_size = fread(bom, 1, 2, file);
+    char utf16 = (bom_size == 2 && bom[0] == 0xFF && bom[1] == 0xFE);
+
+    size_t to_read = size;
+    size_t capacity = to_read + 1;
+    size_t offset = 0;
+
+    if (utf16)
+    {
+        to_read -= 2;
+        capacity = (to_read / 2) * 3 + (to_read & 1) + 1;
+        offset = capacity - 1 - to_read;
+    }
+    else
+    {
+        to_read = (to_read > bom_size) ? to_read - bom_size : 0;
+        offset = bom_size;
+    }
+
+    char *data = SIR_MALLOC(mem_ctx, capacity);
+    if (!data)
+    {
+        fclose(file);
+        *error_ret = "SIR_MALLOC failed";
+        return 0;
+    }
+
+    if (!utf16) memcpy(data, bom, bom_size);
+
+    size_t bytes_read = fread(data + offset, 1, to_read, file);
+    if (ferror(file))
+    {
+        SIR_FREE(mem_ctx, data);
+        fclose(file);
+        *error_ret = strerror(errno);
+        return 0;
+    }
+
+    if (utf16)
+        bytes_read = sir__utf16le_to_utf8(data, 
+                (const unsigned char *)data + offset, bytes_read);
+    else
+        bytes_read += bom_size;
+
+    size = bytes_read;
+
+    if (bytes_read + 1 < capacity)
+    {
+        data = SIR_REALLOC(mem_ctx, data, size + 1);
+
+        if (!data)
+        {
+            fclose(file);
+            *error_ret = strerror(errno);
+            return 0;
+        }
+    }
+
+    fclose(file);
+
+    data[size] = '\0';
+
+    if (size_ret) *size_ret = size;
+
+    return data;
+}
+
+// FNV-1a hash of 'size' bytes of 'data', continuing from 'hash'
+static unsigned int sir__hash_bytes(unsigned int hash, const char *data,
+        size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ (unsigned char)data[i]) * SIR__HASH_PRIME;
+
+    return hash;
+}
+
+// Returns 1 if 'str' matches 'pattern', where '*' matches any number of
+// characters and '?' matches any one character
+static char sir__glob_match(const char *pattern, const char *str)
+{
+    // Where to carry on from if the text after the last '*' doesn't match
+    const char *star = 0;
+    const char *star_str = 0;
+
+    while (*str)
+    {
+        if (*pattern == '*')
+        {
+            star = ++pattern;
+            star_str = str;
+        }
+        else if (*pattern == '?' || *pattern == *str)
+        {
+            ++pattern;
+            ++str;
+        }
+        else if (star)
+        {
+            pattern = star;
+            str = ++star_str;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    while (*pattern == '*') ++pattern;
+
+    return *pattern == '\0';
+}
+
+static int sir__compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+// Returns the sorted names of the files in 'path' that match 'pattern' (or
+// every file if 'pattern' is 0), leaving out names that start with '.'. The
+// names, and the array, must be freed with SIR_FREE. Returns 0 if the
+// directory could not be read.
+static char **sir__list_directory(const char *path, const char *pattern,
+        int *count_ret, void *mem_ctx)
+{
+#ifndef SIR__HAS_FILE_SYSTEM
+    (void)path;
+    (void)pattern;
+    (void)count_ret;
+    (void)mem_ctx;
+    (void)sir__glob_match;
+    (void)sir__compare_strings;
+
+    return 0;
+#else
+    (void)mem_ctx;
+
+    char **names = 0;
+    int count = 0;
+    int size  = 0;
+    char out_of_memory = 0;
+
+#ifdef _WIN32
+    size_t path_size = strlen(path);
+    char *search = SIR_MALLOC(mem_ctx, path_size + 3);
+
+    if (!search)
+    {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    memcpy(search, path, path_size);
+    memcpy(search + path_size, "\\*", 3);
+
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = FindFirstFileA(search, &find_data);
+
+    SIR_FREE(mem_ctx, search);
+
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        errno = ENOENT;
+        return 0;
+    }
+
+    do
+    {
+        const char *name = find_data.cFileName;
+
+        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+#else
+    DIR *dir = opendir(path);
+
+    if (!dir) return 0;
+
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)))
+    {
+        const char *name = entry->d_name;
+#endif
+
+        if (name[0] == '.' || (pattern && !sir__glob_match(pattern, name)))
+            continue;
+
+        if (count == size)
+        {
+            char **grown = SIR_REALLOC(mem_ctx, names, 
+                    sizeof(*names) * (size ? size * 2 : 16));
+
+            if (!grown)
+            {
+                out_of_memory = 1;
+                break;
+            }
+
+            names = grown;
+            size = size ? size * 2 : 16;
+        }
+
+        size_t name_size = strlen(name) + 1;
+
+        names[count] = SIR_MALLOC(mem_ctx, name_size);
+
+        if (!names[count])
+        {
+            out_of_memory = 1;
+            break;
+        }
+
+        memcpy(names[count], name, name_size);
+        ++count;
+    }
+#ifdef _WIN32
+    while (FindNextFileA(find, &find_data));
+
+    FindClose(find);
+#else
+    closedir(dir);
+#endif
+
+    // A directory with no matching files still returns an array
+    if (!out_of_memory && !names)
+    {
+        names = SIR_MALLOC(mem_ctx, sizeof(*names));
+        out_of_memory = !names;
+    }
+
+    if (out_of_memory)
+    {
+        for (int i = 0; i < count; ++i)
+            SIR_FREE(mem_ctx, names[i]);
+
+        if (names) SIR_FREE(mem_ctx, names);
+
+        errno = ENOMEM;
+        return 0;
+    }
+
+    if (count) qsort(names, count, sizeof(*names), sir__compare_strings);
+
+    *count_ret = count;
+
+    return names;
+#endif
+}
+
+static void sir__free_directory_file(SirDirectory directory,
+        SirDirectoryFile *file)
+{
+    (void)directory;
+
+    if (file->filename) SIR_FREE(directory->mem_ctx, file->filename);
+
+    sir_free_ini(file->ini);
+}
+
+// Brings directory->files up to date with the directory. Files whose
+// modification time and size haven't changed are kept as they are, and files
+// that have changed are only parsed again if their contents hash differently.
+// Returns 1 if any file was added, removed or parsed again, or -1 if the
+// directory could not be read.
+static int sir__scan_directory(SirDirectory directory)
+{
+#ifndef SIR__HAS_FILE_SYSTEM
+    (void)sir__list_directory;
+    (void)sir__hash_bytes;
+
+    directory->error = "directories can't be listed on this platform";
+    return -1;
+#else
+    void *mem_ctx = directory->mem_ctx;
+
+    int names_count = 0;
+    char **names = sir__list_directory(directory->path, directory->pattern,
+            &names_count, mem_ctx);
+
+    if (!names)
+    {
+        directory->error = strerror(errno);
+        return -1;
+    }
+
+    SirDirectoryFile *files = SIR_MALLOC(mem_ctx,
+            sizeof(*files) * (names_count + 1));
+    int files_count = 0;
+    int changed = 0;
+
+    size_t path_size = strlen(directory->path);
+    char separator = (path_size && (directory->path[path_size - 1] == '/' ||
+                directory->path[path_size - 1] == '\\')) ? 0 : '/';
+
+    // Every name is turned into a path before any file is looked at, so that
+    // running out of memory leaves directory->files as it was
+    int paths_count = 0;
+
+    for (; files && paths_count < names_count; ++paths_count)
+    {
+        size_t name_size = strlen(names[paths_count]);
+        char *filename = SIR_MALLOC(mem_ctx, path_size + name_size + 2);
+
+        if (!filename) break;
+
+        char *write = filename;
+
+        memcpy(write, directory->path, path_size);
+        write += path_size;
+
+        if (separator) *write++ = separator;
+
+        memcpy(write, names[paths_count], name_size + 1);
+
+        SIR_FREE(mem_ctx, names[paths_count]);
+        names[paths_count] = filename;
+    }
+
+    if (!files || paths_count < names_count)
+    {
+        for (int i = 0; i < names_count; ++i)
+            SIR_FREE(mem_ctx, names[i]);
+
+        SIR_FREE(mem_ctx, names);
+
+        if (files) SIR_FREE(mem_ctx, files);
+
+        directory->error = "could not allocate memory for the file list";
+        return -1;
+    }
+
+    // Both lists are sorted, so cached files are found by walking them
+    // together
+    int cached = 0;
+
+    for (int i = 0; i < names_count; ++i)
+    {
+        char *filename = names[i];
+
+        SirDirectoryFile *old = 0;
+
+        while (cached < directory->files_count)
+        {
+            int cmp = strcmp(directory->files[cached].filename, filename);
+
+            if (cmp > 0) break;
+
+            if (cmp == 0)
+            {
+                old = &directory->files[cached++];
+                break;
+            }
+
+            // Removed since the last scan
+            sir__free_directory_file(directory, &directory->files[cached++]);
+            changed = 1;
+        }
+
+        struct stat st;
+
+        if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            SIR_FREE(mem_ctx, filename);
+
+            if (old)
+            {
+                sir__free_directory_file(directory, old);
+                changed = 1;
+            }
+
+            continue;
+        }
+
+        SirDirectoryFile *file = &files[files_count];
+
+        if (old && old->mtime == (long long)st.st_mtime &&
+                old->size == (long long)st.st_size)
+        {
+            SIR_FREE(mem_ctx, filename);
+
+            *file = *old;
+            ++files_count;
+            continue;
+        }
+
+        size_t size;
+        const char *error;
+        char *data = sir__read_file(filename, &size, &error, mem_ctx);
+
+        if (!data)
+        {
+            // Most likely removed while being scanned
+            SIR_FREE(mem_ctx, filename);
+
+            if (old)
+            {
+                sir__free_directory_file(directory, old);
+                changed = 1;
+            }
+
+            continue;
+        }
+
+        unsigned int hash = sir__hash_bytes(SIR__HASH_SEED, data, size);
+
+        if (old && old->hash == hash)
+        {
+            // Only the modification time changed
+            SIR_FREE(mem_ctx, filename);
+            SIR_FREE(mem_ctx, data);
+
+            *file = *old;
+        }
+        else
+        {
+            if (old) sir__free_directory_file(directory, old);
+
+            file->filename = filename;
+            file->hash = hash;
+            file->ini = sir_load_from_str(data, directory->options,
+                    filename, mem_ctx);
+
+            changed = 1;
+        }
+
+        file->mtime = (long long)st.st_mtime;
+        file->size  = (long long)st.st_size;
+        ++files_count;
+    }
+
+    for (; cached < directory->files_count; ++cached)
+    {
+        sir__free_directory_file(directory, &directory->files[cached]);
+        changed = 1;
+    }
+
+    SIR_FREE(mem_ctx, names);
+
+    if (directory->files) SIR_FREE(mem_ctx, directory->files);
+
+    directory->files = files;
+    directory->files_count = files_count;
+
+    return changed;
+#endif
+}
+
+// Makes a new INI out of every file in the directory. Sections and keys are
+// in the order they first appear in, and the value of each key is taken from
+// the last file that sets it.
+static SirIni sir__merge_directory(SirDirectory directory)
+{
+    void *mem_ctx = directory->mem_ctx;
+
+    char *data = SIR_MALLOC(mem_ctx, 1);
+
+    if (!data) return 0;
+
+    *data = '\0';
+
+    SirIni merged = sir_load_from_str(data,
+            directory->options & ~SIR_OPTION_PRESERVE_SOURCE,
+            directory->path, mem_ctx);
+
+    if (!merged || directory->files_count == 0)
+        return merged;
+
+    SirIni *layers = SIR_MALLOC(mem_ctx,
+            sizeof(*layers) * directory->files_count);
+    SirOverlay overlay = 0;
+    char *added = 0;
+
+    if (layers)
+    {
+        for (int i = 0; i < directory->files_count; ++i)
+            layers[i] = directory->files[i].ini;
+
+        overlay = sir_overlay(layers[0], layers + 1,
+                directory->files_count - 1);
+    }
+
+    if (overlay)
+        added = SIR_MALLOC(mem_ctx, overlay->section_keys_count + 1);
+
+    if (!added)
+    {
+        if (overlay) sir_free_overlay(overlay);
+        if (layers)  SIR_FREE(mem_ctx, layers);
+
+        directory->error = "could not allocate memory to merge the files";
+        sir__set_error(merged, "%: %", directory->path, directory->error);
+
+        return merged;
+    }
+
+    memset(added, 0, overlay->section_keys_count + 1);
+
+    for (int layer = 0; layer < directory->files_count; ++layer)
+    {
+        SirIni ini = layers[layer];
+
+        // A file that couldn't be loaded at all
+        if (!ini) continue;
+
+        for (SirIndex i = 0; i < ini->section_count; ++i)
+        {
+            const char *section_name = ini->section_names[i];
+            SirSection *section = &ini->sections[i];
+
+            SirIndex merged_section = sir__section_index(merged, section_name);
+
+            if (merged_section == -1)
+                merged_section = sir__add_section(merged, section_name);
+
+            for (SirIndex j = 0; j < section->ranges_count; ++j)
+            {
+                for (SirIndex k = section->ranges[j].start;
+                        k < section->ranges[j].end; ++k)
+                {
+                    if (!ini->key_names[k]) continue;
+
+                    SirOverlayKey *winner = sir__overlay_find(overlay,
+                            section_name, ini->key_names[k]);
+
+                    SirIndex index = (SirIndex)(winner - overlay->section_keys);
+
+                    if (added[index]) continue;
+
+                    added[index] = 1;
+
+                    sir__add_key(merged, merged_section, ini->key_names[k],
+                            sir__raw_value(layers[winner->layer],
+                                winner->key));
+                }
+            }
+        }
+    }
+
+    SIR_FREE(mem_ctx, added);
+    SIR_FREE(mem_ctx, layers);
+    sir_free_overlay(overlay);
+
+    return merged;
+}
+
+SIRDEF SirDirectory sir_load_directory(const char *path, const char *pattern,
+        SirOptions options, void *mem_ctx)
+{
+    if (!path) return 0;
+
+    SirDirectory directory = SIR_MALLOC(mem_ctx, sizeof(*directory));
+
+    if (!directory) return 0;
+
+    memset(directory, 0, sizeof(*directory));
+
+    directory->mem_ctx = mem_ctx;
+    directory->options = options;
+
+    directory->path = SIR_MALLOC(mem_ctx, strlen(path) + 1);
+
+    if (pattern)
+        directory->pattern = SIR_MALLOC(mem_ctx, strlen(pattern) + 1);
+
+    if (!directory->path || (pattern && !directory->pattern))
+    {
+        sir_free_directory(directory);
+        return 0;
+    }
+
+    strcpy(directory->path, path);
+
+    if (pattern) strcpy(directory->pattern, pattern);
+
+    int scanned = sir__scan_directory(directory);
+
+    directory->ini = sir__merge_directory(directory);
+
+    if (!directory->ini)
+    {
+        sir_free_directory(directory);
+        return 0;
+    }
+
+    if (scanned == -1)
+        sir__set_error(directory->ini, "%: %", path, directory->error);
+
+    return directory;
+}
+
+SIRDEF char sir_reload_directory(SirDirectory directory)
+{
+    if (!directory) return 0;
+
+    int scanned = sir__scan_directory(directory);
+
+    if (scanned == -1)
+    {
+        sir__set_error(directory->ini, "%: %", directory->path,
+                directory->error);
+        return 0;
+    }
+
+    if (scanned == 0)
+    {
+        sir__clear_error_str(directory->ini);
+        return 0;
+    }
+
+    SirIni merged = sir__merge_directory(directory);
+
+    // Keeps the last merge if there isn't memory for a new one
+    if (!merged)
+    {
+        sir__set_error(directory->ini, "%: %", directory->path,
+                "could not allocate memory to merge the files");
+        return 0;
+    }
+
+    sir_free_ini(directory->ini);
+    directory->ini = merged;
+
+    return 1;
+}
+
+SIRDEF void sir_free_directory(SirDirectory directory)
+{
+    if (directory)
+    {
+        for (int i = 0; i < directory->files_count; ++i)
+            sir__free_directory_file(directory, &directory->files[i]);
+
+        if (directory->files)
+            SIR_FREE(directory->mem_ctx, directory->files);
+        if (directory->path)
+            SIR_FREE(directory->mem_ctx, directory->path);
+        if (directory->pattern)
+            SIR_FREE(directory->mem_ctx, directory->pattern);
+
+        sir_free_ini(directory->ini);
+
+        SIR_FREE(directory->mem_ctx, directory);
+    }
+}
+
+// Returns 1 if 'str' starts with '!include' or '@include' and whitespace
+static char sir__is_include_directive(const char *str)
+{
+    return (str[0] == '!' || str[0] == '@') &&
+        strncmp(str + 1, "include", 7) == 0 &&
+        (str[8] == ' ' || str[8] == '\t');
+}
+
+// Records the include directive at 'str' and blanks out its line so that the
+// rest of the parser doesn't see it. Returns the end of the line, or 0 with 
+// the error set if there isn't memory to record it.
+static char *sir__add_include(SirIni ini, char *str)
+{
+    char *start = str + 8;
+    char *end   = start;
+
+    while (*end && *end != '\n') ++end;
+
+    start += sir__skip_whitespace(start);
+
+    char *path_end = start;
+
+    while (path_end < end && !sir__is_comment_char(ini, *path_end))
+        ++path_end;
+
+    while (path_end > start && (unsigned char)path_end[-1] <= ' ') --path_end;
+
+    if (path_end - start >= 2 && *start == '\"' && path_end[-1] == '\"')
+    {
+        ++start;
+        --path_end;
+    }
+
+    if (ini->includes_count == ini->includes_size)
+    {
+        int size = ini->includes_size ? ini->includes_size * 2 : 4;
+        SirInclude *includes = SIR_REALLOC(ini->mem_ctx, ini->includes,
+                sizeof(*ini->includes) * size);
+
+        if (!includes)
+        {
+            sir__set_error(ini, "could not allocate memory for includes", 
+                    0, 0);
+            return 0;
+        }
+
+        ini->includes = includes;
+        ini->includes_size = size;
+    }
+
+    char *path = SIR_MALLOC(ini->mem_ctx, path_end - start + 1);
+
+    if (!path)
+    {
+        sir__set_error(ini, "could not allocate memory for includes", 0, 0);
+        return 0;
+    }
+
+    SirInclude *include = &ini->includes[ini->includes_count++];
+
+    include->path = path;
+    memcpy(include->path, start, path_end - start);
+    include->path[path_end - start] = '\0';
+
+    include->offset    = str - ini->data;
+    include->key_index = 0;
+    include->section   = 0;
+
+    for (; str < end; ++str)
+        *str = ' ';
+
+    return end;
+}
+
+// Returns 'path' relative to the directory of the INI's filename, unless it
+// is absolute. The result must be freed with SIR_FREE.
+static char *sir__include_path(SirIni ini, const char *path)
+{
+    size_t directory_size = 0;
+
+    char absolute = (path[0] == '/' || path[0] == '\\' ||
+            (path[0] && path[1] == ':'));
+
+    if (!absolute)
+    {
+        for (size_t i = 0; ini->filename[i]; ++i)
+            if (ini->filename[i] == '/' || ini->filename[i] == '\\')
+                directory_size = i + 1;
+    }
+
+    size_t path_size = strlen(path);
+    char *result = SIR_MALLOC(ini->mem_ctx, directory_size + path_size + 1);
+
+    memcpy(result, ini->filename, directory_size);
+    memcpy(result + directory_size, path, path_size + 1);
+
+    return result;
+}
+
+// Returns the index of the file in the cache for 'options' and 'dialect' (or
+// the dialect of 'options' if it's 0), adding it if it isn't there. Returns
+// -1 with errno set if the file can't be found or added.
+static int sir__cached_file(SirIncludeCache cache, const char *path,
+        SirOptions options, const SirDialect *dialect)
+{
+    long long device = 0;
+    long long inode  = 0;
+
+    // Compared the way sir__load_from_str() will use it
+    SirDialect key;
+
+    if (dialect) key = *dialect;
+    else         sir_dialect_init(&key, options);
+
+    key.classes['\0'] = SIR_CHAR_NONE;
+    key.classes['\n'] = SIR_CHAR_WHITESPACE;
+
+#ifdef SIR__HAS_FILE_SYSTEM
+    struct stat st;
+
+    if (stat(path, &st) != 0) return -1;
+
+    device = (long long)st.st_dev;
+    inode  = (long long)st.st_ino;
+#else
+    // Without stat() the file is identified by its path alone
+    FILE *exists = fopen(path, "rb");
+
+    if (!exists) return -1;
+
+    fclose(exists);
+#endif
+
+    for (int i = 0; i < cache->files_count; ++i)
+    {
+        SirCachedFile *file = &cache->files[i];
+
+        if ((inode ? (file->device == device && file->inode == inode) :
+                    strcmp(file->path, path) == 0) &&
+                file->options == options &&
+                memcmp(&file->dialect, &key, sizeof(key)) == 0)
+            return i;
+    }
+
+    if (cache->files_count == cache->files_size)
+    {
+        int size = cache->files_size ? cache->files_size * 2 : 8;
+        SirCachedFile *files = SIR_REALLOC(cache->mem_ctx, cache->files,
+                sizeof(*cache->files) * size);
+
+        if (!files)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        cache->files = files;
+        cache->files_size = size;
+    }
+
+    SirCachedFile *file = &cache->files[cache->files_count];
+
+    file->path = SIR_MALLOC(cache->mem_ctx, strlen(path) + 1);
+
+    if (!file->path)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    strcpy(file->path, path);
+
+    file->device  = device;
+    file->inode   = inode;
+    file->options = options;
+    file->dialect = key;
+    file->ini     = 0;
+    file->loading = 0;
+
+    return cache->files_count++;
+}
+
+// Merges the keys of every included file into the INI. A key from an
+// included file is treated as if it was written where the directive is: it
+// replaces the same key from before the directive only with
+// SIR_OPTION_OVERRIDE_DUPLICATE_KEYS, and otherwise replaces the same key
+// from after the directive. Keys in the global section of an included file
+// go in the section that the directive is in.
+static void sir__apply_includes(SirIni ini, SirIncludeCache cache)
+{
+    SirIncludeCache temporary_cache = 0;
+
+    if (!cache)
+        cache = temporary_cache = sir_include_cache_create(ini->mem_ctx);
+
+    char override = (ini->options & SIR_OPTION_OVERRIDE_DUPLICATE_KEYS) != 0;
+
+    // Where each key is in the text: key i of this INI is at 2 * i + 1, and
+    // keys from a directive found after 'key_index' keys are at
+    // 2 * key_index, so they sort between the keys around the directive
+    SirIndex positions_size = ini->key_count + 16;
+    SirIndex *positions = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*positions) * positions_size);
+
+    if (!positions)
+        sir__set_error(ini, "could not allocate memory for includes", 0, 0);
+
+    for (SirIndex i = 0; positions && i < ini->key_count; ++i)
+        positions[i] = 2 * i + 1;
+
+    for (int i = 0; positions && i < ini->includes_count; ++i)
+    {
+        SirInclude *include = &ini->includes[i];
+        SirIndex position = 2 * include->key_index;
+
+        char *path = sir__include_path(ini, include->path);
+        int cached = sir__cached_file(cache, path, ini->options, 
+                &ini->dialect);
+
+        if (cached == -1)
+        {
+            sir__set_error(ini, "%: %", path, strerror(errno));
+            SIR_FREE(ini->mem_ctx, path);
+            continue;
+        }
+
+        if (cache->files[cached].loading)
+        {
+            sir__set_error(ini, "%: include cycle", path, 0);
+            SIR_FREE(ini->mem_ctx, path);
+            continue;
+        }
+
+        if (!cache->files[cached].ini)
+        {
+            SirIni loaded = sir__load_file(path, ini->options, 
+                    &ini->dialect, cache, ini->mem_ctx);
+
+            cache->files[cached].ini = loaded;
+        }
+
+        SIR_FREE(ini->mem_ctx, path);
+
+        SirIni included = cache->files[cached].ini;
+
+        if (sir_has_error(included))
+            sir__set_error(ini, "%", included->error, 0);
+
+        for (SirIndex j = 0; j < included->section_count; ++j)
+        {
+            SirSection *section = &included->sections[j];
+            SirIndex target = include->section;
+
+            if (j != 0)
+            {
+                target = sir__section_index(ini, included->section_names[j]);
+
+                if (target == -1)
+                    target = sir__add_section(ini,
+                            included->section_names[j]);
+            }
+
+            for (SirIndex k = 0; k < section->ranges_count; ++k)
+            {
+                for (SirIndex l = section->ranges[k].start;
+                        l < section->ranges[k].end; ++l)
+                {
+                    const char *key_name = included->key_names[l];
+
+                    if (!key_name) continue;
+
+                    SirIndex index = sir__section_key_index(ini,
+                            &ini->sections[target], key_name);
+
+                    if (index == -1)
+                    {
+                        if (ini->key_count == positions_size)
+                        {
+                            SirIndex *grown = SIR_REALLOC(ini->mem_ctx,
+                                    positions, sizeof(*positions) * 
+                                    positions_size * 2);
+
+                            if (!grown)
+                            {
+                                sir__set_error(ini, "could not allocate "
+                                        "memory for includes", 0, 0);
+                                continue;
+                            }
+
+                            positions = grown;
+                            positions_size *= 2;
+                        }
+
+                        positions[ini->key_count] = position;
+
+                        sir__add_key(ini, target, key_name,
+                                sir__raw_value(included, l));
+                    }
+                    else if ((positions[index] <= position) == override)
+                    {
+                        positions[index] = position;
+
+                        ini->key_values[index] = sir__arena_strdup(ini,
+                                sir__raw_value(included, l));
+
+                        if (ini->escaped) ini->escaped[index] = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    if (positions) SIR_FREE(ini->mem_ctx, positions);
+
+    for (int i = 0; i < ini->includes_count; ++i)
+        SIR_FREE(ini->mem_ctx, ini->includes[i].path);
+
+    SIR_FREE(ini->mem_ctx, ini->includes);
+
+    ini->includes       = 0;
+    ini->includes_count = 0;
+    ini->includes_size  = 0;
+
+    sir_free_include_cache(temporary_cache);
+}
+
+SIRDEF SirIncludeCache sir_include_cache_create(void *mem_ctx)
+{
+    SirIncludeCache cache = SIR_MALLOC(mem_ctx, sizeof(*cache));
+
+    if (!cache) return 0;
+
+    memset(cache, 0, sizeof(*cache));
+
+    cache->mem_ctx = mem_ctx;
+
+    return cache;
+}
+
+SIRDEF void sir_free_include_cache(SirIncludeCache cache)
+{
+    if (cache)
+    {
+        for (int i = 0; i < cache->files_count; ++i)
+        {
+            SIR_FREE(cache->mem_ctx, cache->files[i].path);
+            sir_free_ini(cache->files[i].ini);
+        }
+
+        if (cache->files) SIR_FREE(cache->mem_ctx, cache->files);
+
+        SIR_FREE(cache->mem_ctx, cache);
+    }
+}
+
+// Returns the index of the section that key 'index' is in, or -1
+static SirIndex sir__key_section(SirIni ini, SirIndex index)
+{
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+    {
+        SirSection *section = &ini->sections[i];
+
+        for (SirIndex j = 0; j < section->ranges_count; ++j)
+            if (index >= section->ranges[j].start &&
+                    index < section->ranges[j].end)
+                return i;
+    }
+
+    return -1;
+}
+
+// Returns the value of key 'index' as it was written or set, before any
+// references in it were expanded
+static const char *sir__raw_value(SirIni ini, SirIndex index)
+{
+    if (ini->escaped && ini->escaped[index])
+        sir__unescape(ini, index);
+
+    return ini->interpolations ? ini->interpolations[index].raw_value :
+        ini->key_values[index];
+}
+
+// Returns the value of key 'index' with its references expanded, or as it was
+// written if they can't be expanded
+static const char *sir__value(SirIni ini, SirIndex index)
+{
+    const char *value = sir__interpolate(ini, index);
+
+    return value ? value : sir__raw_value(ini, index);
+}
+
+static char sir__create_interpolations(SirIni ini)
+{
+    ini->interpolations = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*ini->interpolations) * ini->keys_size);
+
+    if (!ini->interpolations)
+    {
+        sir__set_error(ini, "could not allocate memory for interpolation",
+                0, 0);
+        return 0;
+    }
+
+    memset(ini->interpolations, 0,
+            sizeof(*ini->interpolations) * ini->keys_size);
+
+    for (SirIndex i = 0; i < ini->key_count; ++i)
+        ini->interpolations[i].raw_value = ini->key_values[i];
+
+    return 1;
+}
+
+// Records that the expanded value of key 'dependent' uses key 'index'
+static void sir__add_dependent(SirIni ini, SirIndex index, SirIndex dependent)
+{
+    SirInterpolation *interpolation = &ini->interpolations[index];
+
+    for (SirIndex i = 0; i < interpolation->dependents_count; ++i)
+        if (interpolation->dependents[i] == dependent)
+            return;
+
+    if (interpolation->dependents_count == interpolation->dependents_size)
+    {
+        interpolation->dependents_size = interpolation->dependents_size ?
+            interpolation->dependents_size * 2 : 4;
+        interpolation->dependents = SIR_REALLOC(ini->mem_ctx,
+                interpolation->dependents,
+                sizeof(*interpolation->dependents) *
+                interpolation->dependents_size);
+    }
+
+    interpolation->dependents[interpolation->dependents_count++] = dependent;
+}
+
+// Called when the value of key 'index' has changed. Forgets its expanded
+// value and the expanded values of every key that used it, so that they are
+// expanded again the next time they are read.
+static void sir__invalidate(SirIni ini, SirIndex index)
+{
+    if (!ini->interpolations) return;
+
+    SirInterpolation *interpolation = &ini->interpolations[index];
+
+    interpolation->raw_value = ini->key_values[index];
+    interpolation->state = SIR_INTERPOLATION_UNRESOLVED;
+
+    // The dependents add themselves again when they are expanded
+    SirIndex count = interpolation->dependents_count;
+    interpolation->dependents_count = 0;
+
+    for (SirIndex i = 0; i < count; ++i)
+    {
+        SirIndex dependent = interpolation->dependents[i];
+        SirInterpolation *other = &ini->interpolations[dependent];
+
+        if (other->state == SIR_INTERPOLATION_UNRESOLVED) continue;
+
+        ini->key_values[dependent] = other->raw_value;
+        sir__invalidate(ini, dependent);
+    }
+}
+
+// Appends 'size' bytes to a string allocated with SIR_MALLOC
+static char sir__append(SirIni ini, char **str, size_t *size,
+        size_t *capacity, const char *data, size_t data_size)
+{
+    (void)ini;
+
+    if (*size + data_size + 1 > *capacity)
+    {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+
+        while (new_capacity < *size + data_size + 1)
+            new_capacity *= 2;
+
+        char *new_str = SIR_REALLOC(ini->mem_ctx, *str, new_capacity);
+
+        if (!new_str) return 0;
+
+        *str = new_str;
+        *capacity = new_capacity;
+    }
+
+    memcpy(*str + *size, data, data_size);
+    *size += data_size;
+    (*str)[*size] = '\0';
+
+    return 1;
+}
+
+// Returns the value that the reference 'name' (the text between '${' and '}')
+// in key 'index' expands to, or 0 and sets an error
+static const char *sir__reference(SirIni ini, SirIndex index, const char *name)
+{
+    if (strncmp(name, "ENV:", 4) == 0)
+    {
+        const char *value = getenv(name + 4);
+
+        if (!value)
+            sir__set_error(ini, "environment variable '%' is not set",
+                    name + 4, 0);
+
+        return value;
+    }
+
+    // Anything before the last ':' is the section, which defaults to the
+    // section of the key being expanded
+    const char *colon = strrchr(name, ':');
+    const char *key_name = colon ? colon + 1 : name;
+    SirIndex section_index;
+
+    if (colon)
+    {
+        size_t section_size = colon - name;
+        char *section_name = SIR_MALLOC(ini->mem_ctx, section_size + 1);
+
+        memcpy(section_name, name, section_size);
+        section_name[section_size] = '\0';
+
+        section_index = sir__section_index(ini, section_name);
+
+        SIR_FREE(ini->mem_ctx, section_name);
+    }
+    else
+    {
+        section_index = sir__key_section(ini, index);
+    }
+
+    SirIndex reference = (section_index != -1) ? 
+        sir__find_key(ini, section_index, key_name) : -1;
+
+    if (reference == -1)
+    {
+        sir__set_error(ini, "'${%}' in key '%' not found", name,
+                ini->key_names[index]);
+        return 0;
+    }
+
+    const char *value = sir__interpolate(ini, reference);
+
+    if (value) sir__add_dependent(ini, reference, index);
+
+    return value;
+}
+
+// Returns the value of key 'index' with every '${section:key}', '${key}' and
+// '${ENV:VARIABLE}' in it replaced, or 0 and sets an error if one can't be.
+// Values are expanded the first time they are read and the result is kept in
+// the arena, so reading them again costs nothing.
+static const char *sir__interpolate(SirIni ini, SirIndex index)
+{
+    if (ini->escaped && ini->escaped[index])
+        sir__unescape(ini, index);
+
+    if (!(ini->options & SIR_OPTION_ENABLE_INTERPOLATION))
+        return ini->key_values[index];
+
+    if (!ini->interpolations && !sir__create_interpolations(ini))
+        return 0;
+
+    SirInterpolation *interpolation = &ini->interpolations[index];
+
+    if (interpolation->state == SIR_INTERPOLATION_RESOLVED)
+        return ini->key_values[index];
+
+    if (interpolation->state == SIR_INTERPOLATION_RESOLVING)
+    {
+        sir__set_error(ini, "key '%' refers to itself",
+                ini->key_names[index], 0);
+        return 0;
+    }
+
+    const char *raw = interpolation->raw_value;
+
+    // Most values have nothing to expand
+    if (!strstr(raw, "${"))
+    {
+        interpolation->state = SIR_INTERPOLATION_RESOLVED;
+        return raw;
+    }
+
+    interpolation->state = SIR_INTERPOLATION_RESOLVING;
+
+    char *result = 0;
+    size_t size = 0;
+    size_t capacity = 0;
+    char failed = !sir__append(ini, &result, &size, &capacity, "", 0);
+
+    const char *str = raw;
+
+    while (*str && !failed)
+    {
+        const char *start = strstr(str, "${");
+        const char *end = start ? strchr(start + 2, '}') : 0;
+
+        // Whatever is left has no complete reference in it
+        if (!end)
+        {
+            failed = !sir__append(ini, &result, &size, &capacity,
+                    str, strlen(str));
+            break;
+        }
+
+        // '$${' is written as '${'
+        if (start > str && start[-1] == '$')
+        {
+            failed = !sir__append(ini, &result, &size, &capacity,
+                    str, start - str - 1) ||
+                !sir__append(ini, &result, &size, &capacity, "${", 2);
+            str = start + 2;
+            continue;
+        }
+
+        failed = !sir__append(ini, &result, &size, &capacity,
+                str, start - str);
+
+        size_t name_size = end - start - 2;
+        char *name = SIR_MALLOC(ini->mem_ctx, name_size + 1);
+
+        memcpy(name, start + 2, name_size);
+        name[name_size] = '\0';
+
+        const char *value = sir__reference(ini, index, name);
+
+        SIR_FREE(ini->mem_ctx, name);
+
+        failed = failed || !value ||
+            !sir__append(ini, &result, &size, &capacity, value,
+                    strlen(value));
+
+        str = end + 1;
+    }
+
+    // Failures aren't remembered, so that the error is set on every read
+    if (failed)
+    {
+        interpolation->state = SIR_INTERPOLATION_UNRESOLVED;
+        SIR_FREE(ini->mem_ctx, result);
+        return 0;
+    }
+
+    char *value = sir__arena_alloc(ini, size + 1);
+
+    if (value) memcpy(value, result, size + 1);
+
+    SIR_FREE(ini->mem_ctx, result);
+
+    if (!value) 
+    {
+        interpolation->state = SIR_INTERPOLATION_UNRESOLVED;
+        return 0;
+    }
+
+    interpolation->state = SIR_INTERPOLATION_RESOLVED;
+    ini->key_values[index] = value;
+
+    return value;
+}
+
+// Returns the slot in the section's table that holds the key named
+// 'key_name', or the empty slot it would go in
+static SirHashSlot *sir__inheritance_slot(SirIni ini,
+        SirInheritance *inheritance, unsigned int hash, const char *key_name)
+{
+    for (size_t i = hash & inheritance->mask; ;
+            i = (i + 1) & inheritance->mask)
+    {
+        SirHashSlot *slot = &inheritance->slots[i];
+
+        if (slot->index == -1) return slot;
+
+        if (slot->hash == hash && ini->key_names[slot->index] &&
+                sir__str_equal(ini, ini->key_names[slot->index], key_name))
+            return slot;
+    }
+}
+
+// Builds the table of every key that section 'section_index' has, building
+// the tables of its ancestors first. Its own keys hide the keys it inherits.
+// Returns 0 and sets an error if the section inherits from itself.
+static char sir__inherit(SirIni ini, SirIndex section_index)
+{
+    SirInheritance *inheritance = &ini->inheritance[section_index];
+
+    if (inheritance->state == SIR_INHERITANCE_BUILT) return 1;
+
+    if (inheritance->state == SIR_INHERITANCE_BUILDING)
+    {
+        sir__set_error(ini, "section '%' inherits from itself",
+                ini->section_names[section_index], 0);
+        return 0;
+    }
+
+    inheritance->state = SIR_INHERITANCE_BUILDING;
+
+    SirIndex parent = inheritance->parent;
+    char ok = 1;
+
+    if (parent != -1 && !sir__inherit(ini, parent))
+    {
+        parent = -1;
+        ok = 0;
+    }
+
+    // The recursion doesn't add sections, so this is still valid
+    SirSection *section = &ini->sections[section_index];
+    SirInheritance *parent_inheritance = (parent != -1) ?
+        &ini->inheritance[parent] : 0;
+
+    SirIndex count = parent_inheritance ? parent_inheritance->keys_count : 0;
+
+    for (SirIndex i = 0; i < section->ranges_count; ++i)
+        count += section->ranges[i].end - section->ranges[i].start;
+
+    inheritance->slots = sir__hash_slots_create(count, &inheritance->mask,
+            ini->mem_ctx);
+    inheritance->keys_count = 0;
+
+    char ci = sir__folding(ini->options);
+
+    for (SirIndex i = 0; i < section->ranges_count; ++i)
+    {
+        for (SirIndex j = section->ranges[i].start;
+                j < section->ranges[i].end; ++j)
+        {
+            if (!ini->key_names[j]) continue;
+
+            unsigned int hash = sir__hash_str(SIR__HASH_SEED,
+                    ini->key_names[j], ci);
+            SirHashSlot *slot = sir__inheritance_slot(ini, inheritance,
+                    hash, ini->key_names[j]);
+
+            if (slot->index == -1)
+            {
+                slot->hash  = hash;
+                slot->index = j;
+                ++inheritance->keys_count;
+            }
+            else if (ini->options & SIR_OPTION_OVERRIDE_DUPLICATE_KEYS)
+            {
+                slot->index = j;
+            }
+        }
+    }
+
+    if (parent_inheritance)
+    {
+        for (size_t i = 0; i <= parent_inheritance->mask; ++i)
+        {
+            SirHashSlot *parent_slot = &parent_inheritance->slots[i];
+
+            if (parent_slot->index == -1) continue;
+
+            SirHashSlot *slot = sir__inheritance_slot(ini, inheritance,
+                    parent_slot->hash, ini->key_names[parent_slot->index]);
+
+            if (slot->index == -1)
+            {
+                *slot = *parent_slot;
+                ++inheritance->keys_count;
+            }
+        }
+    }
+
+    inheritance->state = SIR_INHERITANCE_BUILT;
+
+    return ok;
+}
+
+// Finds the parent of every section and builds the key tables of every
+// section from scratch. Called after loading and whenever keys or sections
+// are added or removed.
+static void sir__build_inheritance(SirIni ini)
+{
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+    {
+        SirInheritance *inheritance = &ini->inheritance[i];
+
+        if (inheritance->slots)
+            SIR_FREE(ini->mem_ctx, inheritance->slots);
+
+        inheritance->slots = 0;
+        inheritance->state = SIR_INHERITANCE_NONE;
+
+        if (inheritance->parent == -1 && inheritance->parent_name)
+        {
+            inheritance->parent = sir__section_index(ini,
+                    inheritance->parent_name);
+
+            if (inheritance->parent == -1)
+                sir__set_error(ini, "section '%' inherits from '%', which "
+                        "doesn't exist", ini->section_names[i],
+                        inheritance->parent_name);
+        }
+    }
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+        sir__inherit(ini, i);
+}
+
+// Returns the index of the key named 'key_name' in section 'section_index'
+// or, with SIR_OPTION_ENABLE_INHERITANCE, in the sections it inherits from.
+// Returns -1 if there isn't one.
+static SirIndex sir__find_key(SirIni ini, SirIndex section_index, 
+        const char *key_name)
+{
+    SirInheritance *inheritance = ini->inheritance ?
+        &ini->inheritance[section_index] : 0;
+
+    if (!inheritance || !inheritance->slots)
+        return sir__section_key_index(ini, &ini->sections[section_index],
+                key_name);
+
+    char ci = sir__folding(ini->options);
+    unsigned int hash = sir__hash_str(SIR__HASH_SEED, key_name, ci);
+
+    return sir__inheritance_slot(ini, inheritance, hash, key_name)->index;
+}
+
+static void sir__free_key_name_index(SirIni ini)
+{
+    if (ini->key_sections)   SIR_FREE(ini->mem_ctx, ini->key_sections);
+    if (ini->key_name_next)  SIR_FREE(ini->mem_ctx, ini->key_name_next);
+    if (ini->key_name_slots) SIR_FREE(ini->mem_ctx, ini->key_name_slots);
+
+    ini->key_sections   = 0;
+    ini->key_name_next  = 0;
+    ini->key_name_slots = 0;
+}
+
+// Returns the slot in the key name table that holds the keys named
+// 'key_name', or the empty slot they would go in
+static SirHashSlot *sir__key_name_slot(SirIni ini, unsigned int hash,
+        const char *key_name)
+{
+    for (size_t i = hash & ini->key_name_mask; ;
+            i = (i + 1) & ini->key_name_mask)
+    {
+        SirHashSlot *slot = &ini->key_name_slots[i];
+
+        if (slot->index == -1) return slot;
+
+        if (slot->hash == hash &&
+                sir__str_equal(ini, ini->key_names[slot->index], key_name))
+            return slot;
+    }
+}
+
+// Builds a table of key names, where each slot holds the first key with that
+// name and ini->key_name_next chains the rest of them in order. Also notes
+// the section of every key.
+static char sir__build_key_name_index(SirIni ini)
+{
+    ini->key_sections = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*ini->key_sections) * (ini->key_count + 1));
+    ini->key_name_next = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*ini->key_name_next) * (ini->key_count + 1));
+    ini->key_name_slots = sir__hash_slots_create(ini->key_count,
+            &ini->key_name_mask, ini->mem_ctx);
+
+    if (!ini->key_sections || !ini->key_name_next || !ini->key_name_slots)
+    {
+        sir__free_key_name_index(ini);
+        sir__set_error(ini, "could not allocate memory for key name index",
+                0, 0);
+        return 0;
+    }
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+    {
+        SirSection *section = &ini->sections[i];
+
+        for (SirIndex j = 0; j < section->ranges_count; ++j)
+            for (SirIndex k = section->ranges[j].start;
+                    k < section->ranges[j].end; ++k)
+                ini->key_sections[k] = i;
+    }
+
+    char ci = sir__folding(ini->options);
+
+    // Going backwards leaves each chain in the order of the keys
+    for (SirIndex i = ini->key_count - 1; i >= 0; --i)
+    {
+        ini->key_name_next[i] = -1;
+
+        if (!ini->key_names[i]) continue;
+
+        unsigned int hash = sir__hash_str(SIR__HASH_SEED,
+                ini->key_names[i], ci);
+        SirHashSlot *slot = sir__key_name_slot(ini, hash, ini->key_names[i]);
+
+        ini->key_name_next[i] = slot->index;
+
+        slot->hash  = hash;
+        slot->index = i;
+    }
+
+    return 1;
+}
+
+SIRDEF SirIndex sir_column(SirIni ini, const char *key_name, SirColumn *column)
+{
+    if (!ini) return 0;
+
+    if (!key_name)
+    {
+        sir__set_error(ini, "the parameter 'key_name' is not optional",
+                0, 0);
+        return 0;
+    }
+
+    if (!column)
+    {
+        sir__set_error(ini, "the parameter 'column' is not optional", 0, 0);
+        return 0;
+    }
+
+    memset(column, 0, sizeof(*column));
+
+    if (!ini->key_name_slots && !sir__build_key_name_index(ini))
+        return 0;
+
+    char ci = sir__folding(ini->options);
+    unsigned int hash = sir__hash_str(SIR__HASH_SEED, key_name, ci);
+    SirIndex first = sir__key_name_slot(ini, hash, key_name)->index;
+
+    SirIndex count = 0;
+
+    for (SirIndex i = first; i != -1; i = ini->key_name_next[i])
+        ++count;
+
+    if (count)
+    {
+        column->entries = SIR_MALLOC(ini->mem_ctx,
+                sizeof(*column->entries) * count);
+
+        if (!column->entries)
+        {
+            sir__set_error(ini, "could not allocate memory for column",
+                    0, 0);
+            return 0;
+        }
+    }
+
+    for (SirIndex i = first; i != -1; i = ini->key_name_next[i])
+    {
+        SirColumnEntry *entry = &column->entries[column->count++];
+
+        entry->section    = ini->key_sections[i];
+        entry->key        = i;
+        entry->value      = sir__value(ini, i);
+        entry->value_size = strlen(entry->value);
+    }
+
+    sir__clear_error_str(ini);
+
+    return column->count;
+}
+
+SIRDEF const double *sir_column_numbers(SirIni ini, SirColumn *column)
+{
+    if (!ini || !column) return 0;
+
+    if (column->numbers || !column->count) return column->numbers;
+
+    column->numbers = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*column->numbers) * column->count);
+
+    if (!column->numbers)
+    {
+        sir__set_error(ini, "could not allocate memory for column", 0, 0);
+        return 0;
+    }
+
+    for (SirIndex i = 0; i < column->count; ++i)
+    {
+        const char *str = column->entries[i].value;
+        char *endptr;
+
+        errno = 0;
+        double d = strtod(str, &endptr);
+
+        column->numbers[i] = (errno == ERANGE || endptr == str) ? NAN : d;
+    }
+
+    sir__clear_error_str(ini);
+
+    return column->numbers;
+}
+
+SIRDEF void sir_free_column(SirIni ini, SirColumn *column)
+{
+    if (!ini || !column) return;
+
+    if (column->entries) SIR_FREE(ini->mem_ctx, column->entries);
+    if (column->numbers) SIR_FREE(ini->mem_ctx, column->numbers);
+
+    memset(column, 0, sizeof(*column));
+}
+
+// Compares two strings like strcmp(), ignoring case if 'case_insensitive' is
+// set
+static int sir__str_compare(const char *s1, const char *s2,
+        char case_insensitive)
+{
+    for (;;)
+    {
+        unsigned long c1 = sir__next_char(&s1, case_insensitive);
+        unsigned long c2 = sir__next_char(&s2, case_insensitive);
+
+        if (c1 != c2 || !c1) return (c1 > c2) - (c1 < c2);
+    }
+}
+
+// Returns 1 if 'str' starts with 'prefix'
+static char sir__has_prefix(const char *str, const char *prefix,
+        char case_insensitive)
+{
+    while (*prefix)
+    {
+        if (sir__next_char(&str, case_insensitive) != 
+                sir__next_char(&prefix, case_insensitive))
+            return 0;
+    }
+
+    return 1;
+}
+
+// Returns 1 and stores the number in 'number_ret' if all of 'str' is a
+// number
+static char sir__parse_number(const char *str, double *number_ret)
+{
+    char *endptr;
+
+    errno = 0;
+    double d = strtod(str, &endptr);
+
+    if (endptr == str || *endptr || errno == ERANGE || d != d) return 0;
+
+    *number_ret = d;
+    return 1;
+}
+
+// Orders entries by key name, then by value, or by number if 'numbers' is
+// set
+static int sir__value_entry_compare(SirIni ini, const SirValueEntry *a,
+        const SirValueEntry *b, char numbers)
+{
+    char ci = sir__folding(ini->options);
+
+    int result = sir__str_compare(a->name, b->name, ci);
+
+    if (result) return result;
+
+    if (numbers)
+        return (a->number > b->number) - (a->number < b->number);
+
+    return sir__str_compare(a->value, b->value, ci);
+}
+
+// Stable merge sort, since qsort() can't be given the INI
+static void sir__sort_value_entries(SirIni ini, SirValueEntry *entries,
+        SirIndex count, char numbers)
+{
+    SirValueEntry *temp = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*temp) * (count + 1));
+
+    if (!temp) return;
+
+    for (SirIndex width = 1; width < count; width *= 2)
+    {
+        for (SirIndex start = 0; start < count; start += 2 * width)
+        {
+            SirIndex middle = (start + width < count) ? start + width : count;
+            SirIndex end = (start + 2 * width < count) ? 
+                start + 2 * width : count;
+            SirIndex i = start;
+            SirIndex j = middle;
+            SirIndex k = start;
+
+            while (i < middle && j < end)
+            {
+                if (sir__value_entry_compare(ini, &entries[j], &entries[i],
+                            numbers) < 0)
+                    temp[k++] = entries[j++];
+                else
+                    temp[k++] = entries[i++];
+            }
+
+            while (i < middle) temp[k++] = entries[i++];
+            while (j < end)    temp[k++] = entries[j++];
+        }
+
+        memcpy(entries, temp, sizeof(*entries) * count);
+    }
+
+    SIR_FREE(ini->mem_ctx, temp);
+}
+
+static void sir__free_value_index(SirIni ini)
+{
+    if (ini->sorted_values)  SIR_FREE(ini->mem_ctx, ini->sorted_values);
+    if (ini->sorted_numbers) SIR_FREE(ini->mem_ctx, ini->sorted_numbers);
+
+    if (ini->value_slots)    SIR_FREE(ini->mem_ctx, ini->value_slots);
+    if (ini->value_next)     SIR_FREE(ini->mem_ctx, ini->value_next);
+
+    ini->sorted_values        = 0;
+    ini->sorted_values_count  = 0;
+    ini->sorted_numbers       = 0;
+    ini->sorted_numbers_count = 0;
+    ini->value_slots          = 0;
+    ini->value_next           = 0;
+}
+
+// Sorts every key by name and value, and every key whose value is a number
+// by name and number, so that queries can use binary searches
+static char sir__build_value_index(SirIni ini)
+{
+    ini->sorted_values = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*ini->sorted_values) * (ini->key_count + 1));
+    ini->sorted_numbers = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*ini->sorted_numbers) * (ini->key_count + 1));
+
+    if (!ini->sorted_values || !ini->sorted_numbers)
+    {
+        sir__free_value_index(ini);
+        sir__set_error(ini, "could not allocate memory for value index",
+                0, 0);
+        return 0;
+    }
+
+    for (SirIndex i = 0; i < ini->key_count; ++i)
+    {
+        if (!ini->key_names[i]) continue;
+
+        SirValueEntry entry;
+
+        entry.name   = ini->key_names[i];
+        entry.value  = sir__value(ini, i);
+        entry.key    = i;
+        entry.number = 0;
+
+        ini->sorted_values[ini->sorted_values_count++] = entry;
+
+        if (sir__parse_number(entry.value, &entry.number))
+            ini->sorted_numbers[ini->sorted_numbers_count++] = entry;
+    }
+
+    sir__sort_value_entries(ini, ini->sorted_values,
+            ini->sorted_values_count, 0);
+    sir__sort_value_entries(ini, ini->sorted_numbers,
+            ini->sorted_numbers_count, 1);
+
+    return 1;
+}
+
+// Returns the first entry that doesn't sort before 'target'
+static SirIndex sir__value_lower_bound(SirIni ini, 
+        const SirValueEntry *entries, SirIndex count, 
+        const SirValueEntry *target, char numbers)
+{
+    SirIndex low = 0;
+    SirIndex high = count;
+
+    while (low < high)
+    {
+        SirIndex middle = low + (high - low) / 2;
+
+        if (sir__value_entry_compare(ini, &entries[middle], target,
+                    numbers) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+static int sir__compare_column_entries(const void *a, const void *b)
+{
+    SirIndex key_a = ((const SirColumnEntry *)a)->key;
+    SirIndex key_b = ((const SirColumnEntry *)b)->key;
+
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+// Returns 1 if the value of a key matches the query
+static char sir__query_match(SirIni ini, const SirQuery *query,
+        const char *value)
+{
+    char ci = sir__folding(ini->options);
+    double number;
+
+    switch (query->type)
+    {
+        case SIR_QUERY_EQUAL:
+            return sir__str_equal(ini, value, query->value);
+
+        case SIR_QUERY_PREFIX:
+            return sir__has_prefix(value, query->value, ci);
+
+        case SIR_QUERY_RANGE:
+            return sir__parse_number(value, &number) &&
+                number >= query->min && number <= query->max;
+    }
+
+    return 0;
+}
+
+SIRDEF SirIndex sir_query(SirIni ini, const SirQuery *query, SirColumn *result)
+{
+    if (!ini) return 0;
+
+    if (!query || !query->key_name)
+    {
+        sir__set_error(ini, "the parameter 'query' is not optional", 0, 0);
+        return 0;
+    }
+
+    if (!result)
+    {
+        sir__set_error(ini, "the parameter 'result' is not optional", 0, 0);
+        return 0;
+    }
+
+    if (query->type != SIR_QUERY_RANGE && !query->value)
+    {
+        sir__set_error(ini, "the query on key '%' has no value",
+                query->key_name, 0);
+        return 0;
+    }
+
+    // Without an index, only the keys with the right name are looked at
+    if (!(ini->options & SIR_OPTION_INDEX_VALUES))
+    {
+        sir_column(ini, query->key_name, result);
+
+        SirIndex count = 0;
+
+        for (SirIndex i = 0; i < result->count; ++i)
+            if (sir__query_match(ini, query, result->entries[i].value))
+                result->entries[count++] = result->entries[i];
+
+        result->count = count;
+
+        return count;
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    if (!ini->sorted_values && !sir__build_value_index(ini))
+        return 0;
+
+    char numbers = (query->type == SIR_QUERY_RANGE);
+    const SirValueEntry *entries = numbers ?
+        ini->sorted_numbers : ini->sorted_values;
+    SirIndex count = numbers ?
+        ini->sorted_numbers_count : ini->sorted_values_count;
+
+    // Sorts before every entry that matches
+    SirValueEntry target;
+
+    target.name   = query->key_name;
+    target.value  = numbers ? "" : query->value;
+    target.number = query->min;
+    target.key    = -1;
+
+    SirIndex first = sir__value_lower_bound(ini, entries, count, &target, 
+            numbers);
+
+    char ci = sir__folding(ini->options);
+    SirIndex last = first;
+
+    while (last < count &&
+            sir__str_equal(ini, entries[last].name, query->key_name) &&
+            (numbers ? entries[last].number <= query->max :
+             query->type == SIR_QUERY_PREFIX ?
+             sir__has_prefix(entries[last].value, query->value, ci) :
+             sir__str_equal(ini, entries[last].value, query->value)))
+        ++last;
+
+    if (last > first)
+    {
+        result->entries = SIR_MALLOC(ini->mem_ctx,
+                sizeof(*result->entries) * (last - first));
+
+        if (!result->entries)
+        {
+            sir__set_error(ini, "could not allocate memory for query", 0, 0);
+            return 0;
+        }
+
+        if (!ini->key_sections && !sir__build_key_name_index(ini))
+            return 0;
+    }
+
+    for (SirIndex i = first; i < last; ++i)
+    {
+        SirColumnEntry *entry = &result->entries[result->count++];
+
+        entry->section    = ini->key_sections[entries[i].key];
+        entry->key        = entries[i].key;
+        entry->value      = entries[i].value;
+        entry->value_size = strlen(entries[i].value);
+    }
+
+    // Results are in the order of the keys, as with sir_column()
+    if (result->count)
+        qsort(result->entries, result->count, sizeof(*result->entries),
+                sir__compare_column_entries);
+
+    sir__clear_error_str(ini);
+
+    return result->count;
+}
+
+// Returns the slot in the value table that holds the keys whose value is
+// 'value', or the empty slot they would go in
+static SirHashSlot *sir__value_slot(SirIni ini, unsigned int hash,
+        const char *value)
+{
+    for (size_t i = hash & ini->value_mask; ;
+            i = (i + 1) & ini->value_mask)
+    {
+        SirHashSlot *slot = &ini->value_slots[i];
+
+        if (slot->index == -1) return slot;
+
+        // Values have been expanded by the time they are in the table
+        if (slot->hash == hash &&
+                sir__str_equal(ini, ini->key_values[slot->index], value))
+            return slot;
+    }
+}
+
+// Builds a table of values, where each slot holds the first key with that
+// value and ini->value_next chains the rest of them in order
+static char sir__build_value_table(SirIni ini)
+{
+    ini->value_next = SIR_MALLOC(ini->mem_ctx,
+            sizeof(*ini->value_next) * (ini->key_count + 1));
+    ini->value_slots = sir__hash_slots_create(ini->key_count,
+            &ini->value_mask, ini->mem_ctx);
+
+    if (!ini->value_next || !ini->value_slots)
+    {
+        sir__free_value_index(ini);
+        sir__set_error(ini, "could not allocate memory for value table",
+                0, 0);
+        return 0;
+    }
+
+    char ci = sir__folding(ini->options);
+
+    // Going backwards leaves each chain in the order of the keys
+    for (SirIndex i = ini->key_count - 1; i >= 0; --i)
+    {
+        ini->value_next[i] = -1;
+
+        if (!ini->key_names[i]) continue;
+
+        const char *value = sir__value(ini, i);
+        unsigned int hash = sir__hash_str(SIR__HASH_SEED, value, ci);
+        SirHashSlot *slot = sir__value_slot(ini, hash, value);
+
+        ini->value_next[i] = slot->index;
+
+        slot->hash  = hash;
+        slot->index = i;
+    }
+
+    return 1;
+}
+
+SIRDEF SirIndex sir_find_by_value(SirIni ini, const char *value, 
+        SirColumn *result)
+{
+    if (!ini) return 0;
+
+    if (!value)
+    {
+        sir__set_error(ini, "the parameter 'value' is not optional", 0, 0);
+        return 0;
+    }
+
+    if (!result)
+    {
+        sir__set_error(ini, "the parameter 'result' is not optional", 0, 0);
+        return 0;
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    if (!ini->value_slots && !sir__build_value_table(ini))
+        return 0;
+
+    if (!ini->key_sections && !sir__build_key_name_index(ini))
+        return 0;
+
+    char ci = sir__folding(ini->options);
+    unsigned int hash = sir__hash_str(SIR__HASH_SEED, value, ci);
+    SirIndex first = sir__value_slot(ini, hash, value)->index;
+
+    SirIndex count = 0;
+
+    for (SirIndex i = first; i != -1; i = ini->value_next[i])
+        ++count;
+
+    if (count)
+    {
+        result->entries = SIR_MALLOC(ini->mem_ctx,
+                sizeof(*result->entries) * count);
+
+        if (!result->entries)
+        {
+            sir__set_error(ini, "could not allocate memory for result",
+                    0, 0);
+            return 0;
+        }
+    }
+
+    for (SirIndex i = first; i != -1; i = ini->value_next[i])
+    {
+        SirColumnEntry *entry = &result->entries[result->count++];
+
+        entry->section    = ini->key_sections[i];
+        entry->key        = i;
+        entry->value      = ini->key_values[i];
+        entry->value_size = strlen(entry->value);
+    }
+
+    sir__clear_error_str(ini);
+
+    return result->count;
+}
+
+// Converts 'str' to the type of 'field' and stores it in 'out'. Returns 0
+// and sets an error, without storing anything, if it can't be converted or
+// is out of the field's range.
+static char sir__bind_value(SirIni ini, const SirField *field,
+        const char *str, void *out)
+{
+    char *dest = (char *)out + field->offset;
+    double number = 0;
+
+    long l = 0;
+    unsigned long ul = 0;
+    double d = 0;
+    char b = 0;
+
+    sir__clear_error_str(ini);
+
+    switch (field->type)
+    {
+        case SIR_FIELD_STR:
+            *(const char **)dest = str;
+            return 1;
+
+        case SIR_FIELD_LONG:
+            number = (double)(l = sir__str_to_long(ini, str));
+            break;
+
+        case SIR_FIELD_UNSIGNED_LONG:
+            number = (double)(ul = sir__str_to_unsigned_long(ini, str));
+            break;
+
+        case SIR_FIELD_DOUBLE:
+            number = d = sir__str_to_double(ini, str);
+            break;
+
+        case SIR_FIELD_BOOL:
+            number = b = sir__str_to_bool(ini, str);
+            break;
+    }
+
+    if (sir_has_error(ini)) return 0;
+
+    if (field->min < field->max &&
+            (number < field->min || number > field->max))
+    {
+        sir__set_error(ini, "'%' is out of the range of key '%'", str,
+                field->key_name);
+        return 0;
+    }
+
+    switch (field->type)
+    {
+        case SIR_FIELD_STR:           break;
+        case SIR_FIELD_LONG:          *(long *)dest = l;           break;
+        case SIR_FIELD_UNSIGNED_LONG: *(unsigned long *)dest = ul; break;
+        case SIR_FIELD_DOUBLE:        *(double *)dest = d;         break;
+        case SIR_FIELD_BOOL:          *dest = b;                   break;
+    }
+
+    return 1;
+}
+
+static unsigned int sir__field_hash(SirIni ini, const char *section_name,
+        const char *key_name)
+{
+    char ci = sir__folding(ini->options);
+
+    return sir__hash_str(sir__hash_str(SIR__HASH_SEED, section_name, ci),
+            key_name, ci);
+}
+
+SIRDEF char sir_bind(SirIni ini, SirSchema schema, void *out)
+{
+    if (!ini) return 0;
+
+    if (!out)
+    {
+        sir__set_error(ini, "the parameter 'out' is not optional", 0, 0);
+        return 0;
+    }
+
+    // The fields are put in a hash table, so each key of the INI is matched
+    // with its field by one lookup
+    size_t mask;
+    SirHashSlot *slots = sir__hash_slots_create(schema.fields_count, &mask,
+            ini->mem_ctx);
+    char *bound = SIR_MALLOC(ini->mem_ctx, schema.fields_count + 1);
+
+    if (!slots || !bound)
+    {
+        if (slots) SIR_FREE(ini->mem_ctx, slots);
+        if (bound) SIR_FREE(ini->mem_ctx, bound);
+
+        sir__set_error(ini, "could not allocate memory for schema", 0, 0);
+        return 0;
+    }
+
+    memset(bound, 0, schema.fields_count + 1);
+
+    for (int i = 0; i < schema.fields_count; ++i)
+    {
+        const SirField *field = &schema.fields[i];
+        unsigned int hash = sir__field_hash(ini, field->section_name,
+                field->key_name);
+
+        size_t j = hash & mask;
+
+        while (slots[j].index != -1)
+            j = (j + 1) & mask;
+
+        slots[j].hash  = hash;
+        slots[j].index = i;
+    }
+
+    char ok = 1;
+    char ci = sir__folding(ini->options);
+
+    for (SirIndex i = 0; i < ini->section_count && ok; ++i)
+    {
+        SirSection *section = &ini->sections[i];
+        unsigned int section_hash = sir__hash_str(SIR__HASH_SEED,
+                ini->section_names[i], ci);
+
+        for (SirIndex j = 0; j < section->ranges_count && ok; ++j)
+        {
+            for (SirIndex k = section->ranges[j].start;
+                    k < section->ranges[j].end && ok; ++k)
+            {
+                if (!ini->key_names[k]) continue;
+
+                unsigned int hash = sir__hash_str(section_hash,
+                        ini->key_names[k], ci);
+
+                for (size_t l = hash & mask; slots[l].index != -1;
+                        l = (l + 1) & mask)
+                {
+                    SirIndex index = slots[l].index;
+                    const SirField *field = &schema.fields[index];
+
+                    if (slots[l].hash != hash || bound[index] ||
+                            !sir__str_equal(ini, field->key_name,
+                                ini->key_names[k]) ||
+                            !sir__str_equal(ini, field->section_name,
+                                ini->section_names[i]))
+                        continue;
+
+                    ok = sir__bind_value(ini, field, sir__value(ini, k),
+                            out);
+                    bound[index] = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Fields that weren't in the INI are inherited, given their default or
+    // reported as missing
+    for (int i = 0; i < schema.fields_count && ok; ++i)
+    {
+        if (bound[i]) continue;
+
+        const SirField *field = &schema.fields[i];
+        SirIndex section_index = ini->inheritance ?
+            sir__section_index(ini, field->section_name) : -1;
+        SirIndex key_index = (section_index != -1) ?
+            sir__find_key(ini, section_index, field->key_name) : -1;
+
+        if (key_index != -1)
+        {
+            ok = sir__bind_value(ini, field, sir__value(ini, key_index),
+                    out);
+        }
+        else if (field->default_value)
+        {
+            ok = sir__bind_value(ini, field, field->default_value, out);
+        }
+        else if (field->required)
+        {
+            sir__set_error(ini, "key '%' in section '%' is required",
+                    field->key_name, field->section_name);
+            ok = 0;
+        }
+    }
+
+    SIR_FREE(ini->mem_ctx, slots);
+    SIR_FREE(ini->mem_ctx, bound);
+
+    if (ok) sir__clear_error_str(ini);
+
+    return ok;
+}
+
 #endif // SIMPLE_INI_READER_IMPLEMENTATION
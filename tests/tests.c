@@ -12,6 +12,9 @@
 
 #include <windows.h>
 
+#define popen  _popen
+#define pclose _pclose
+
 long long time_in_usecs()
 {
     LARGE_INTEGER freq, ctr;
@@ -192,7 +195,7 @@ int main(int argc, char **argv)
     {
         ini = sir_load_from_file("test3.ini", 0, 0);
 
-        int size;
+        SirIndex size;
         const char **csv = sir_csv(ini, "csv", &size);
         if (sir_has_error(ini))
             print("TEST 3 FAILED: %s\n", ini->error);
@@ -201,19 +204,20 @@ int main(int argc, char **argv)
         else
             sir_free_csv(ini, csv);
 
-        const char **names = sir_section_key_names(ini, "global", &size);
+        SirIndex names_size;
+        const char **names = sir_section_key_names(ini, "global", &names_size);
         if (sir_has_error(ini))
             print("TEST 3 FAILED: %s\n", ini->error);
-        else if (size != 3)
+        else if (names_size != 3)
             print("TEST 3 FAILED\n");
         else
             sir_free(ini, (void *)names);
 
         const char **values = 
-            sir_section_key_values(ini, "another_section", &size);
+            sir_section_key_values(ini, "another_section", &names_size);
         if (sir_has_error(ini))
             print("TEST 3 FAILED: %s\n", ini->error);
-        else if (size != 1)
+        else if (names_size != 1)
             print("TEST 3 FAILED\n");
         else
             sir_free(ini, (void *)values);
@@ -375,5 +379,1371 @@ int main(int argc, char **argv)
         sir_free_ini(ini);
     }
 
+    // TEST 9 - JSON
+    {
+        ini = sir_load_from_file("test9.ini", 0, 0);
+
+        const char *expected_json =
+            "{\n"
+            "  \"global\": {\n"
+            "    \"path\": \"C:\\\\dir\\\\file\",\n"
+            "    \"tab\": \"a\\tb\"\n"
+            "  },\n"
+            "  \"empty\": {},\n"
+            "  \"\\\"quoted\\\"\": {\n"
+            "    \"key\": \"value\"\n"
+            "  }\n"
+            "}\n";
+
+        const char *expected_ndjson =
+            "{\"section\":\"global\",\"key\":\"path\","
+            "\"value\":\"C:\\\\dir\\\\file\"}\n"
+            "{\"section\":\"global\",\"key\":\"tab\",\"value\":\"a\\tb\"}\n"
+            "{\"section\":\"\\\"quoted\\\"\",\"key\":\"key\","
+            "\"value\":\"value\"}\n";
+
+        char output[512];
+        size_t size;
+
+        FILE *file = tmpfile();
+
+        sir_write_json(ini, file);
+        if (sir_has_error(ini)) print("TEST 9 FAILED: %s\n", ini->error);
+
+        rewind(file);
+        size = fread(output, 1, sizeof(output) - 1, file);
+        output[size] = '\0';
+
+        if (strcmp(output, expected_json)) print("TEST 9 FAILED\n");
+
+        fclose(file);
+
+        file = tmpfile();
+
+        sir_write_ndjson(ini, file);
+        if (sir_has_error(ini)) print("TEST 9 FAILED: %s\n", ini->error);
+
+        rewind(file);
+        size = fread(output, 1, sizeof(output) - 1, file);
+        output[size] = '\0';
+
+        if (strcmp(output, expected_ndjson)) print("TEST 9 FAILED\n");
+
+        fclose(file);
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 10 - Writer
+    {
+        FILE *file = tmpfile();
+
+        SirWriter writer = sir_writer_create(file, 0);
+
+        sir_writer_comment(writer, "Test 10: Writer");
+        sir_writer_key(writer, "name", "value");
+        sir_writer_section(writer, "numbers");
+        sir_writer_long(writer, "long", -70000000);
+        sir_writer_long(writer, "long_min", LONG_MIN);
+        sir_writer_unsigned_long(writer, "ulong", 2100000);
+        sir_writer_double(writer, "double", 3.14);
+        sir_writer_double(writer, "small_double", -0.001);
+        sir_writer_double(writer, "third", 1.0 / 3.0);
+        sir_writer_bool(writer, "bool", 1);
+        sir_writer_section(writer, "strings");
+        sir_writer_key(writer, "padded", "  hello  ");
+        sir_writer_key(writer, "empty", "");
+        sir_writer_key(writer, "caf\xC3\xA9", "br\xC3\xBBl\xC3\xA9");
+
+        if (sir_writer_has_error(writer))
+            print("TEST 10 FAILED: %s\n", writer->error);
+
+        // These should fail
+        sir_writer_key(writer, "comment", "a;b");
+        if (!sir_writer_has_error(writer)) print("TEST 10 FAILED\n");
+
+        writer->error = 0;
+
+        sir_writer_key(writer, "a=b", "c");
+        if (!sir_writer_has_error(writer)) print("TEST 10 FAILED\n");
+
+        writer->error = 0;
+
+        sir_writer_flush(writer);
+        if (sir_writer_has_error(writer))
+            print("TEST 10 FAILED: %s\n", writer->error);
+
+        sir_free_writer(writer);
+
+        const char *expected =
+            "; Test 10: Writer\n"
+            "name = value\n"
+            "\n"
+            "[numbers]\n"
+            "long = -70000000\n"
+            "long_min = -9223372036854775808\n"
+            "ulong = 2100000\n"
+            "double = 3.14\n"
+            "small_double = -0.001\n"
+            "third = 0.33333333333333331\n"
+            "bool = true\n"
+            "\n"
+            "[strings]\n"
+            "padded = \"  hello  \"\n"
+            "empty = \n"
+            "caf\xC3\xA9 = br\xC3\xBBl\xC3\xA9\n";
+
+        char *output = malloc(1024);
+        rewind(file);
+        size_t size = fread(output, 1, 1023, file);
+        output[size] = '\0';
+
+        fclose(file);
+
+        // long_min depends on the size of a long
+        if (sizeof(long) == 8 && strcmp(output, expected))
+            print("TEST 10 FAILED\n");
+
+        ini = sir_load_from_str(output, 0, "test10", 0);
+
+        if (sir_section_long(ini, "numbers", "long_min") != LONG_MIN)
+            print("TEST 10 FAILED\n");
+
+        if (sir_section_double(ini, "numbers", "third") != 1.0 / 3.0)
+            print("TEST 10 FAILED\n");
+
+        if (strcmp(sir_section_str(ini, "strings", "padded"), "  hello  "))
+            print("TEST 10 FAILED\n");
+
+        const char *utf8 = sir_section_str(ini, "strings", "caf\xC3\xA9");
+        if (!utf8 || strcmp(utf8, "br\xC3\xBBl\xC3\xA9"))
+            print("TEST 10 FAILED\n");
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 11 - Editing
+    {
+        ini = sir_load_from_file("test11.ini", SIR_OPTION_PRESERVE_SOURCE, 0);
+
+        sir_set(ini, SIR_GLOBAL_SECTION_NAME, "name", "new");
+        sir_set(ini, SIR_GLOBAL_SECTION_NAME, "quoted", "still quoted");
+        sir_set(ini, "graphics", "width", "1920");
+        sir_set(ini, "graphics", "width", "2560");
+        sir_set(ini, "graphics", "fullscreen", " yes ");
+        sir_delete(ini, "graphics", "height");
+        sir_set(ini, "network", "port", "8080");
+        sir_set(ini, "network", "host", "localhost");
+        sir_set(ini, "audio", "volume", "caf\xC3\xA9");
+        sir_set(ini, "network", "caf\xC3\xA9", "br\xC3\xBBl\xC3\xA9");
+        if (sir_has_error(ini)) print("TEST 11 FAILED: %s\n", ini->error);
+
+        if (strcmp(sir_section_str(ini, "graphics", "width"), "2560"))
+            print("TEST 11 FAILED\n");
+
+        sir_section_str(ini, "graphics", "height");
+        if (!sir_has_error(ini)) print("TEST 11 FAILED\n");
+
+        // These should fail
+        sir_set(ini, "audio", "volume", "a\nb");
+        if (!sir_has_error(ini)) print("TEST 11 FAILED\n");
+
+        sir_delete(ini, "audio", "this_key_wont_be_found");
+        if (!sir_has_error(ini)) print("TEST 11 FAILED\n");
+
+        sir_save(ini, "test11_output.ini");
+        if (sir_has_error(ini)) print("TEST 11 FAILED: %s\n", ini->error);
+
+        sir_free_ini(ini);
+
+        const char *expected = 
+            "; Test 11: Editing\n"
+            "name = new ; keep this comment\n"
+            "quoted = \"still quoted\"\n"
+            "\n"
+            "[ graphics ]\n"
+            "# window size\n"
+            "width = 2560\n"
+            "fullscreen = \" yes \"\n"
+            "\n"
+            "[ audio ]\n"
+            "volume = caf\xC3\xA9\n"
+            "\n"
+            "[network]\n"
+            "port = 8080\n"
+            "host = localhost\n"
+            "caf\xC3\xA9 = br\xC3\xBBl\xC3\xA9\n";
+
+        char output[512];
+        FILE *file = fopen("test11_output.ini", "rb");
+        size_t size = fread(output, 1, sizeof(output) - 1, file);
+        output[size] = '\0';
+        fclose(file);
+
+        if (strcmp(output, expected)) print("TEST 11 FAILED\n");
+
+        remove("test11_output.ini");
+    }
+
+    // TEST 12 - Mutable INI
+    {
+        ini = sir_load_from_file("test11.ini", 0, 0);
+
+        // Keys and sections added by sir_set() can be looked up straight away
+        sir_set(ini, "graphics", "width", "2560");
+        sir_set(ini, "network", "port", "8080");
+        sir_set(ini, "graphics", "vsync", "on");
+        sir_delete(ini, "audio", "volume");
+        if (sir_has_error(ini)) print("TEST 12 FAILED: %s\n", ini->error);
+
+        if (strcmp(sir_section_str(ini, "graphics", "width"), "2560") ||
+                strcmp(sir_section_str(ini, "graphics", "vsync"), "on") ||
+                strcmp(sir_str(ini, "port"), "8080"))
+            print("TEST 12 FAILED\n");
+
+        sir_section_str(ini, "audio", "volume");
+        if (!sir_has_error(ini)) print("TEST 12 FAILED\n");
+
+        SirIndex names_size;
+        const char **names = sir_section_key_names(ini, "graphics", 
+                &names_size);
+
+        if (names_size != 3 || strcmp(names[0], "width") || 
+                strcmp(names[1], "height") || strcmp(names[2], "vsync"))
+            print("TEST 12 FAILED\n");
+
+        sir_free(ini, (void *)names);
+
+        // Without SIR_OPTION_PRESERVE_SOURCE every key is written out
+        sir_save(ini, "test12_output.ini");
+        if (sir_has_error(ini)) print("TEST 12 FAILED: %s\n", ini->error);
+
+        sir_free_ini(ini);
+
+        const char *expected = 
+            "name = old\n"
+            "quoted = \"  spaced  \"\n"
+            "\n"
+            "[graphics]\n"
+            "width = 2560\n"
+            "height = 720\n"
+            "vsync = on\n"
+            "\n"
+            "[audio]\n"
+            "\n"
+            "[network]\n"
+            "port = 8080\n";
+
+        char output[512];
+        FILE *file = fopen("test12_output.ini", "rb");
+        size_t size = fread(output, 1, sizeof(output) - 1, file);
+        output[size] = '\0';
+        fclose(file);
+
+        if (strcmp(output, expected)) print("TEST 12 FAILED\n");
+
+        remove("test12_output.ini");
+
+        // Keys added after a new section are written at the end of their own
+        // section
+        ini = sir_load_from_file("test11.ini", SIR_OPTION_PRESERVE_SOURCE, 0);
+
+        sir_set(ini, "network", "port", "8080");
+        sir_set(ini, "graphics", "vsync", "on");
+        sir_set(ini, "graphics", "vsync", "off");
+        sir_set(ini, "network", "host", "localhost");
+        sir_set(ini, "graphics", "removed", "1");
+        sir_delete(ini, "graphics", "removed");
+        sir_set(ini, "audio", "volume", "6");
+        if (sir_has_error(ini)) print("TEST 12 FAILED: %s\n", ini->error);
+
+        sir_save(ini, "test12_output.ini");
+        if (sir_has_error(ini)) print("TEST 12 FAILED: %s\n", ini->error);
+
+        sir_free_ini(ini);
+
+        expected = 
+            "; Test 11: Editing\n"
+            "name = old ; keep this comment\n"
+            "quoted = \"  spaced  \"\n"
+            "\n"
+            "[ graphics ]\n"
+            "# window size\n"
+            "width = 1280\n"
+            "height = 720\n"
+            "vsync = off\n"
+            "\n"
+            "[ audio ]\n"
+            "volume = 6\n"
+            "\n"
+            "[network]\n"
+            "port = 8080\n"
+            "host = localhost\n";
+
+        file = fopen("test12_output.ini", "rb");
+        size = fread(output, 1, sizeof(output) - 1, file);
+        output[size] = '\0';
+        fclose(file);
+
+        if (strcmp(output, expected)) print("TEST 12 FAILED\n");
+
+        remove("test12_output.ini");
+
+        // Thousands of keys
+        ini = sir_load_from_file("test11.ini", 0, 0);
+
+        char key_name[32];
+        char value[32];
+
+        for (int i = 0; i < 10000; ++i)
+        {
+            sprintf(key_name, "key%d", i);
+            sprintf(value, "%d", i);
+            sir_set(ini, (i % 2) ? "odd" : "even", key_name, value);
+        }
+
+        for (int i = 0; i < 10000; i += 3)
+        {
+            sprintf(key_name, "key%d", i);
+            sprintf(value, "%d", -i);
+            sir_set(ini, (i % 2) ? "odd" : "even", key_name, value);
+        }
+
+        for (int i = 0; i < 10000; ++i)
+        {
+            sprintf(key_name, "key%d", i);
+
+            long expected_value = (i % 3) ? i : -i;
+
+            if (sir_section_long(ini, (i % 2) ? "odd" : "even", key_name) !=
+                    expected_value)
+            {
+                print("TEST 12 FAILED\n");
+                break;
+            }
+        }
+
+        names = sir_section_key_names(ini, "odd", &names_size);
+        if (names_size != 5000) print("TEST 12 FAILED\n");
+
+        sir_free(ini, (void *)names);
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 13 - Overlays
+    {
+        SirIni defaults = sir_load_from_file("test13_defaults.ini", 0, 0);
+        SirIni layers[] = {
+            sir_load_from_file("test13_site.ini", 0, 0),
+            0,
+            sir_load_from_file("test13_host.ini", 0, 0),
+        };
+
+        SirOverlay overlay = sir_overlay(defaults, layers, 3);
+
+        if (!overlay) print("TEST 13 FAILED\n");
+
+        if (strcmp(sir_overlay_str(overlay, "server", "port"), "8080") ||
+                strcmp(sir_overlay_str(overlay, "server", "workers"), "16") ||
+                strcmp(sir_overlay_str(overlay, "server", "name"), 
+                    "default") ||
+                strcmp(sir_overlay_str(overlay, "database", "host"), 
+                    "db.example.com") ||
+                strcmp(sir_overlay_str(overlay, SIR_GLOBAL_SECTION_NAME, 
+                        "log_level"), "debug"))
+            print("TEST 13 FAILED\n");
+
+        // Searching every section
+        if (strcmp(sir_overlay_str(overlay, 0, "workers"), "16") ||
+                strcmp(sir_overlay_str(overlay, 0, "name"), "default"))
+            print("TEST 13 FAILED\n");
+
+        if (sir_overlay_layer(overlay, "server", "port") != 3 ||
+                sir_overlay_layer(overlay, "server", "workers") != 1 ||
+                sir_overlay_layer(overlay, "server", "name") != 0)
+            print("TEST 13 FAILED\n");
+
+        // These should not be found
+        if (sir_overlay_str(overlay, "server", "host") ||
+                sir_overlay_str(overlay, "missing", "port") ||
+                sir_overlay_str(overlay, 0, "missing") ||
+                sir_overlay_layer(overlay, 0, "missing") != -1)
+            print("TEST 13 FAILED\n");
+
+        // Changed values are seen by the overlay
+        sir_set(layers[0], "server", "workers", "32");
+
+        if (strcmp(sir_overlay_str(overlay, "server", "workers"), "32"))
+            print("TEST 13 FAILED\n");
+
+        sir_free_overlay(overlay);
+
+        sir_free_ini(defaults);
+        sir_free_ini(layers[0]);
+        sir_free_ini(layers[2]);
+    }
+
+    // TEST 14 - Directories
+    {
+        SirDirectory dir = sir_load_directory("test14.d", "*.ini", 0, 0);
+
+        if (!dir || sir_has_error(dir->ini) || dir->files_count != 2) 
+            print("TEST 14 FAILED\n");
+
+        if (strcmp(sir_section_str(dir->ini, "server", "port"), "80") ||
+                strcmp(sir_section_str(dir->ini, "server", "workers"), "16") ||
+                strcmp(sir_section_str(dir->ini, "server", "name"), "site") ||
+                strcmp(sir_section_str(dir->ini, "cache", "size"), "64"))
+            print("TEST 14 FAILED\n");
+
+        // Sections and keys are in the order they first appear in
+        SirIndex names_size;
+        const char **names = sir_section_key_names(dir->ini, "server", 
+                &names_size);
+
+        if (names_size != 3 || strcmp(names[0], "port") || 
+                strcmp(names[1], "workers") || strcmp(names[2], "name"))
+            print("TEST 14 FAILED\n");
+
+        sir_free(dir->ini, (void *)names);
+
+        // Nothing has changed
+        if (sir_reload_directory(dir)) print("TEST 14 FAILED\n");
+
+        // Rewriting a file with the same contents doesn't parse it again
+        SirIni defaults = dir->files[0].ini;
+
+        FILE *file = fopen("test14.d/10-defaults.ini", "rb");
+        char contents[512];
+        size_t size = fread(contents, 1, sizeof(contents), file);
+        fclose(file);
+
+        file = fopen("test14.d/10-defaults.ini", "wb");
+        fwrite(contents, 1, size, file);
+        fclose(file);
+
+        if (sir_reload_directory(dir) || dir->files[0].ini != defaults) 
+            print("TEST 14 FAILED\n");
+
+        // Adding a file
+        file = fopen("test14.d/30-host.ini", "wb");
+        fputs("[server]\nport = 8080\n", file);
+        fclose(file);
+
+        if (!sir_reload_directory(dir) || dir->files_count != 3 ||
+                dir->files[0].ini != defaults ||
+                strcmp(sir_section_str(dir->ini, "server", "port"), "8080"))
+            print("TEST 14 FAILED\n");
+
+        // Removing it again
+        remove("test14.d/30-host.ini");
+
+        if (!sir_reload_directory(dir) || dir->files_count != 2 ||
+                strcmp(sir_section_str(dir->ini, "server", "port"), "80"))
+            print("TEST 14 FAILED\n");
+
+        sir_free_directory(dir);
+
+        // This should fail
+        dir = sir_load_directory("this_directory_doesnt_exist", 0, 0, 0);
+
+        if (!sir_has_error(dir->ini) || dir->files_count != 0)
+            print("TEST 14 FAILED\n");
+
+        sir_free_directory(dir);
+    }
+
+    // TEST 15 - Includes
+    {
+        ini = sir_load_from_file("test15.ini", SIR_OPTION_ENABLE_INCLUDES, 0);
+        if (sir_has_error(ini)) print("TEST 15 FAILED: %s\n", ini->error);
+
+        // Keys before a directive win over included keys, and included keys
+        // win over keys after it
+        if (strcmp(sir_section_str(ini, SIR_GLOBAL_SECTION_NAME, "name"), 
+                    "before") ||
+                strcmp(sir_section_str(ini, SIR_GLOBAL_SECTION_NAME, 
+                        "shared"), "yes") ||
+                strcmp(sir_section_str(ini, SIR_GLOBAL_SECTION_NAME, 
+                        "nested"), "1") ||
+                strcmp(sir_section_str(ini, "logging", "level"), "info") ||
+                strcmp(sir_section_str(ini, "server", "port"), "80") ||
+                strcmp(sir_section_str(ini, "server", "workers"), "8") ||
+                strcmp(sir_section_str(ini, "server", "timeout"), "30"))
+            print("TEST 15 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // With SIR_OPTION_OVERRIDE_DUPLICATE_KEYS the last key wins
+        ini = sir_load_from_file("test15.ini", SIR_OPTION_ENABLE_INCLUDES | 
+                SIR_OPTION_OVERRIDE_DUPLICATE_KEYS, 0);
+
+        if (strcmp(sir_section_str(ini, SIR_GLOBAL_SECTION_NAME, "name"), 
+                    "common") ||
+                strcmp(sir_section_str(ini, "server", "port"), "8080") ||
+                strcmp(sir_section_str(ini, "server", "workers"), "2"))
+            print("TEST 15 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // Without the option, directives are not treated specially
+        ini = sir_load_from_file("test15.ini", 0, 0);
+
+        sir_section_str(ini, "logging", "level");
+        if (!sir_has_error(ini)) print("TEST 15 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // Included files are only parsed once per cache
+        SirIncludeCache cache = sir_include_cache_create(0);
+
+        ini = sir_load_from_file_cached("test15.ini", 
+                SIR_OPTION_ENABLE_INCLUDES, cache, 0);
+        sir_free_ini(ini);
+
+        int files_count = cache->files_count;
+        SirIni common = cache->files[1].ini;
+
+        ini = sir_load_from_file_cached("test15.ini", 
+                SIR_OPTION_ENABLE_INCLUDES, cache, 0);
+
+        if (files_count != 4 || cache->files_count != files_count || 
+                cache->files[1].ini != common ||
+                strcmp(sir_section_str(ini, "logging", "level"), "info"))
+            print("TEST 15 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // With other options the included files are parsed again
+        ini = sir_load_from_file_cached("test15.ini", 
+                SIR_OPTION_ENABLE_INCLUDES | SIR_OPTION_OVERRIDE_DUPLICATE_KEYS,
+                cache, 0);
+
+        if (cache->files_count != 2 * files_count || 
+                cache->files[1].ini != common ||
+                cache->files[files_count + 1].ini == common ||
+                strcmp(sir_section_str(ini, "server", "port"), "8080"))
+            print("TEST 15 FAILED\n");
+
+        sir_free_ini(ini);
+        sir_free_include_cache(cache);
+
+        // These should fail, but still load the keys they can
+        ini = sir_load_from_file("test15.d/cycle_a.ini", 
+                SIR_OPTION_ENABLE_INCLUDES, 0);
+
+        if (!sir_has_error(ini) || strcmp(sir_str(ini, "b"), "2"))
+            print("TEST 15 FAILED\n");
+
+        sir_free_ini(ini);
+
+        char *str = malloc(64);
+        strcpy(str, "a = 1\n!include this_file_doesnt_exist.ini\n");
+        ini = sir_load_from_str(str, SIR_OPTION_ENABLE_INCLUDES, 0, 0);
+
+        if (!sir_has_error(ini) || strcmp(sir_str(ini, "a"), "1"))
+            print("TEST 15 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // A path that ends in a UTF-8 byte isn't trimmed
+        FILE *file = fopen("test15_caf\xC3\xA9", "wb");
+        fputs("b = 2\n", file);
+        fclose(file);
+
+        str = malloc(64);
+        strcpy(str, "!include test15_caf\xC3\xA9\n");
+        ini = sir_load_from_str(str, SIR_OPTION_ENABLE_INCLUDES, 0, 0);
+
+        if (sir_has_error(ini) || !sir_str(ini, "b") || 
+                strcmp(sir_str(ini, "b"), "2"))
+            print("TEST 15 FAILED\n");
+
+        sir_free_ini(ini);
+        remove("test15_caf\xC3\xA9");
+    }
+
+    // TEST 16 - Interpolation
+    {
+        const char *text =
+            "name = world\n"
+            "greeting = hello ${name}\n"
+            "bin = ${paths:root}/bin\n"
+            "literal = $${name}\n"
+            "[ paths ]\n"
+            "root = /opt/${global:name}\n"
+            "env_path = ${ENV:PATH}\n"
+            "loop_a = ${loop_b}\n"
+            "loop_b = ${loop_a}\n"
+            "missing = ${nope}\n";
+
+        char *str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, SIR_OPTION_ENABLE_INTERPOLATION, 0, 0);
+
+        const char *greeting = sir_str(ini, "greeting");
+
+        if (strcmp(greeting, "hello world") ||
+                strcmp(sir_str(ini, "bin"), "/opt/world/bin") ||
+                strcmp(sir_str(ini, "literal"), "${name}") ||
+                strcmp(sir_section_str(ini, "paths", "env_path"), 
+                    getenv("PATH")))
+            print("TEST 16 FAILED\n");
+
+        // Values are only expanded once
+        if (sir_str(ini, "greeting") != greeting)
+            print("TEST 16 FAILED\n");
+
+        if (sir_section_str(ini, "paths", "loop_a") || !sir_has_error(ini) ||
+                sir_section_str(ini, "paths", "missing") || 
+                !sir_has_error(ini))
+            print("TEST 16 FAILED\n");
+
+        // Changing a key expands the keys that use it again
+        sir_set(ini, SIR_GLOBAL_SECTION_NAME, "name", "there");
+
+        if (strcmp(sir_str(ini, "greeting"), "hello there") ||
+                strcmp(sir_str(ini, "bin"), "/opt/there/bin"))
+            print("TEST 16 FAILED\n");
+
+        sir_set(ini, "paths", "nope", "found");
+
+        if (strcmp(sir_section_str(ini, "paths", "missing"), "found"))
+            print("TEST 16 FAILED\n");
+
+        sir_delete(ini, SIR_GLOBAL_SECTION_NAME, "name");
+
+        if (sir_str(ini, "greeting") || !sir_has_error(ini))
+            print("TEST 16 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // Without the option, values are left alone
+        str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, 0, 0, 0);
+
+        if (strcmp(sir_str(ini, "greeting"), "hello ${name}"))
+            print("TEST 16 FAILED\n");
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 17 - Section Inheritance
+    {
+        ini = sir_load_from_file("test17.ini", 
+                SIR_OPTION_ENABLE_INHERITANCE, 0);
+
+        if (sir_has_error(ini) || ini->warnings_count ||
+                strcmp(sir_section_str(ini, "heavy", "hp"), "5") ||
+                strcmp(sir_section_str(ini, "heavy", "armor"), "none") ||
+                strcmp(sir_section_str(ini, "heavy", "weapon"), "cannon") ||
+                strcmp(sir_section_str(ini, "heavy", "speed"), "10") ||
+                strcmp(sir_section_str(ini, "soldier", "speed"), "12"))
+            print("TEST 17 FAILED\n");
+
+        sir_section_str(ini, "unit", "weapon");
+        if (!sir_has_error(ini)) print("TEST 17 FAILED\n");
+
+        // Edits to a parent show up in its children
+        sir_set(ini, "unit", "morale", "high");
+        sir_delete(ini, "heavy", "weapon");
+        sir_set(ini, "heavy", "hp", "20");
+
+        if (strcmp(sir_section_str(ini, "heavy", "morale"), "high") ||
+                strcmp(sir_section_str(ini, "heavy", "weapon"), "rifle") ||
+                strcmp(sir_section_str(ini, "heavy", "hp"), "20") ||
+                strcmp(sir_section_str(ini, "soldier", "hp"), "5"))
+            print("TEST 17 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // Without the option, the parent is part of the section name
+        ini = sir_load_from_file("test17.ini", SIR_OPTION_DISABLE_WARNINGS, 
+                0);
+
+        if (strcmp(sir_section_str(ini, "soldier : unit", "hp"), "5"))
+            print("TEST 17 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // These should fail
+        char *str = malloc(64);
+        strcpy(str, "[a : b]\nx = 1\n[b : a]\ny = 2\n");
+        ini = sir_load_from_str(str, SIR_OPTION_ENABLE_INHERITANCE, 0, 0);
+
+        if (!sir_has_error(ini)) print("TEST 17 FAILED\n");
+
+        sir_free_ini(ini);
+
+        str = malloc(64);
+        strcpy(str, "[a : nope]\nx = 1\n");
+        ini = sir_load_from_str(str, SIR_OPTION_ENABLE_INHERITANCE, 0, 0);
+
+        if (!sir_has_error(ini) || 
+                strcmp(sir_section_str(ini, "a", "x"), "1"))
+            print("TEST 17 FAILED\n");
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 18 - Columns
+    {
+        const char *text =
+            "[ a ]\nsize = 10\nname = x\n"
+            "[ b ]\nname = y\n"
+            "[ c ]\nsize = 2.5\n"
+            "[ d ]\nSIZE = big\n";
+
+        char *str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, SIR_OPTION_DISABLE_CASE_SENSITIVITY, 
+                0, 0);
+
+        SirColumn column;
+        SirIndex count = sir_column(ini, "size", &column);
+        const double *numbers = sir_column_numbers(ini, &column);
+
+        if (count != 3 || column.count != 3 ||
+                strcmp(ini->section_names[column.entries[0].section], "a") ||
+                strcmp(ini->section_names[column.entries[1].section], "c") ||
+                strcmp(ini->section_names[column.entries[2].section], "d") ||
+                strcmp(column.entries[2].value, "big") ||
+                column.entries[2].value_size != 3 ||
+                numbers[0] != 10 || numbers[1] != 2.5 || 
+                !isnan(numbers[2]))
+            print("TEST 18 FAILED\n");
+
+        sir_free_column(ini, &column);
+
+        // The index is rebuilt after keys are added or removed
+        sir_set(ini, "b", "size", "7");
+        sir_delete(ini, "a", "size");
+
+        if (sir_column(ini, "size", &column) != 3 ||
+                strcmp(ini->section_names[column.entries[2].section], "b") ||
+                strcmp(column.entries[2].value, "7"))
+            print("TEST 18 FAILED\n");
+
+        sir_free_column(ini, &column);
+
+        if (sir_column(ini, "nope", &column) != 0 || sir_has_error(ini))
+            print("TEST 18 FAILED\n");
+
+        sir_free_column(ini, &column);
+        sir_free_ini(ini);
+    }
+
+    // TEST 19 - Queries
+    {
+        const char *text =
+            "[ a ]\nplaceable = True\nhp = 5\npath = /Game/A\n"
+            "[ b ]\nplaceable = true\nhp = 12\npath = /Game/B\n"
+            "[ c ]\nplaceable = False\nhp = 7.5\npath = /Engine/C\n"
+            "[ d ]\nhp = big\nplaceable = True\n";
+
+        SirOptions options[] = { 0, SIR_OPTION_INDEX_VALUES };
+
+        for (int i = 0; i < 2; ++i)
+        {
+            char *str = malloc(strlen(text) + 1);
+            strcpy(str, text);
+            ini = sir_load_from_str(str, options[i], 0, 0);
+
+            SirColumn result;
+            SirQuery query = { SIR_QUERY_EQUAL, "placeable", "True", 0, 0 };
+
+            if (sir_query(ini, &query, &result) != 2 ||
+                    result.entries[0].section != 1 ||
+                    result.entries[1].section != 4 ||
+                    strcmp(result.entries[1].value, "True"))
+                print("TEST 19 FAILED\n");
+
+            sir_free_column(ini, &result);
+
+            query.type = SIR_QUERY_RANGE;
+            query.key_name = "hp";
+            query.min = 5;
+            query.max = 10;
+
+            if (sir_query(ini, &query, &result) != 2 ||
+                    result.entries[0].section != 1 ||
+                    result.entries[1].section != 3)
+                print("TEST 19 FAILED\n");
+
+            sir_free_column(ini, &result);
+
+            query.type = SIR_QUERY_PREFIX;
+            query.key_name = "path";
+            query.value = "/Game/";
+
+            if (sir_query(ini, &query, &result) != 2 ||
+                    result.entries[0].section != 1 ||
+                    result.entries[1].section != 2)
+                print("TEST 19 FAILED\n");
+
+            sir_free_column(ini, &result);
+
+            // Edits are seen by the next query
+            sir_set(ini, "c", "placeable", "True");
+
+            query.type = SIR_QUERY_EQUAL;
+            query.key_name = "placeable";
+            query.value = "True";
+
+            if (sir_query(ini, &query, &result) != 3 ||
+                    result.entries[1].section != 3)
+                print("TEST 19 FAILED\n");
+
+            sir_free_column(ini, &result);
+
+            query.key_name = "nope";
+
+            if (sir_query(ini, &query, &result) != 0 || sir_has_error(ini))
+                print("TEST 19 FAILED\n");
+
+            sir_free_column(ini, &result);
+            sir_free_ini(ini);
+        }
+    }
+
+    // TEST 20 - Find by Value
+    {
+        const char *text =
+            "armor = eItem_ArmorKevlar\n"
+            "[ a ]\nitem = eItem_ArmorKevlar\nother = x\n"
+            "[ b ]\nitem = eItem_ArmorTitan\nspare = eItem_ArmorKevlar\n";
+
+        char *str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, 0, 0, 0);
+
+        SirColumn result;
+
+        if (sir_find_by_value(ini, "eItem_ArmorKevlar", &result) != 3 ||
+                result.entries[0].section != 0 ||
+                result.entries[1].section != 1 ||
+                result.entries[2].section != 2 ||
+                strcmp(ini->key_names[result.entries[2].key], "spare"))
+            print("TEST 20 FAILED\n");
+
+        sir_free_column(ini, &result);
+
+        sir_set(ini, "a", "other", "eItem_ArmorTitan");
+
+        if (sir_find_by_value(ini, "eItem_ArmorTitan", &result) != 2 ||
+                result.entries[0].section != 1)
+            print("TEST 20 FAILED\n");
+
+        sir_free_column(ini, &result);
+
+        if (sir_find_by_value(ini, "nope", &result) != 0)
+            print("TEST 20 FAILED\n");
+
+        sir_free_column(ini, &result);
+        sir_free_ini(ini);
+    }
+
+    // TEST 21 - Binding to a Struct
+    {
+        typedef struct Config
+        {
+            long width;
+            unsigned long height;
+            double scale;
+            char fullscreen;
+            const char *title;
+            long unset;
+        }
+        Config;
+
+        const SirField fields[] = {
+            SIR_FIELD(Config, width, SIR_FIELD_LONG, "graphics", "width",
+                    1, 640, 7680, 0),
+            SIR_FIELD(Config, height, SIR_FIELD_UNSIGNED_LONG, "graphics", 
+                    "height", 1, 0, 0, 0),
+            SIR_FIELD(Config, scale, SIR_FIELD_DOUBLE, "graphics", "scale",
+                    0, 0, 0, "1.5"),
+            SIR_FIELD(Config, fullscreen, SIR_FIELD_BOOL, "graphics", 
+                    "fullscreen", 0, 0, 0, 0),
+            SIR_FIELD(Config, title, SIR_FIELD_STR, SIR_GLOBAL_SECTION_NAME, 
+                    "title", 0, 0, 0, "Untitled"),
+            SIR_FIELD(Config, unset, SIR_FIELD_LONG, "graphics", "unset",
+                    0, 0, 0, 0),
+        };
+
+        SirSchema schema = SIR_SCHEMA(fields);
+
+        const char *text = 
+            "title = Game\n"
+            "[ graphics ]\nwidth = 1920\nheight = 1080\n"
+            "fullscreen = true\nextra = ignored\n";
+
+        char *str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, 0, 0, 0);
+
+        Config config;
+        config.unset = 42;
+
+        if (!sir_bind(ini, schema, &config) || config.width != 1920 || 
+                config.height != 1080 || config.scale != 1.5 || 
+                config.fullscreen != 1 || strcmp(config.title, "Game") ||
+                config.unset != 42)
+            print("TEST 21 FAILED\n");
+
+        // Out of range, then missing a required key
+        sir_set(ini, "graphics", "width", "100");
+
+        if (sir_bind(ini, schema, &config) || !sir_has_error(ini) ||
+                config.width != 1920)
+            print("TEST 21 FAILED\n");
+
+        sir_set(ini, "graphics", "width", "800");
+        sir_delete(ini, "graphics", "height");
+
+        if (sir_bind(ini, schema, &config) || !sir_has_error(ini))
+            print("TEST 21 FAILED\n");
+
+        sir_set(ini, "graphics", "height", "not a number");
+
+        if (sir_bind(ini, schema, &config) || !sir_has_error(ini))
+            print("TEST 21 FAILED\n");
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 22 - Dialects
+    {
+        // Each combination of these options parses with its own first pass
+        const char *text = 
+            "# x = 1\n; semicolon\n[s]\nb : 2 = 3\na = 1 ; trailing\n";
+
+        for (int i = 0; i < 8; ++i)
+        {
+            SirOptions options = SIR_OPTION_DISABLE_WARNINGS;
+            if (i & 1) options |= SIR_OPTION_DISABLE_HASH_COMMENTS;
+            if (i & 2) options |= SIR_OPTION_DISABLE_COLON_ASSIGNMENT;
+            if (i & 4) options |= SIR_OPTION_DISABLE_COMMENT_ANYWHERE;
+
+            char *str = malloc(strlen(text) + 1);
+            strcpy(str, text);
+            ini = sir_load_from_str(str, options, 0, 0);
+
+            const char *a = sir_section_str(ini, "s", "a");
+            const char *b = sir_section_str(ini, "s", "b");
+            const char *x = sir_section_str(ini, "global", "# x");
+
+            if (!a || strcmp(a, (i & 4) ? "1 ; trailing" : "1"))
+                print("TEST 22 FAILED\n");
+
+            if ((i & 2) ? b != 0 : (!b || strcmp(b, "2 = 3")))
+                print("TEST 22 FAILED\n");
+
+            if (ini->section_count != 2 || (i & 1) != (x != 0))
+                print("TEST 22 FAILED\n");
+
+            sir_free_ini(ini);
+        }
+    }
+
+    // TEST 23 - Character Classes
+    {
+        SirDialect dialect;
+        sir_dialect_init(&dialect, SIR_OPTION_NONE);
+
+        // '!' comments, '|' assignments, '{name}' sections and '\'' quotes
+        dialect.classes['!'] = SIR_CHAR_COMMENT;
+        dialect.classes['|'] = SIR_CHAR_ASSIGNMENT;
+        dialect.classes['{'] = SIR_CHAR_SECTION_OPEN;
+        dialect.classes['}'] = SIR_CHAR_SECTION_CLOSE;
+        dialect.classes['\''] = SIR_CHAR_QUOTE;
+        dialect.classes[';'] = SIR_CHAR_NONE;
+        dialect.classes['='] = SIR_CHAR_NONE;
+        dialect.classes['['] = SIR_CHAR_NONE;
+        dialect.classes[']'] = SIR_CHAR_NONE;
+        dialect.classes['"'] = SIR_CHAR_NONE;
+
+        const char *text = 
+            "! comment\n{ s }\na=b | 1;2 ! comment\n"
+            "[c] | ' quoted '\nd | \"e\"\n";
+
+        char *str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str_dialect(str, SIR_OPTION_DISABLE_WARNINGS, 
+                &dialect, 0, 0);
+
+        const char *a = sir_section_str(ini, "s", "a=b");
+        const char *c = sir_section_str(ini, "s", "[c]");
+        const char *d = sir_section_str(ini, "s", "d");
+
+        if (sir_has_error(ini) || ini->section_count != 2 || 
+                !a || strcmp(a, "1;2") || !c || strcmp(c, " quoted ") ||
+                !d || strcmp(d, "\"e\""))
+            print("TEST 23 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // The default dialect follows the options
+        sir_dialect_init(&dialect, SIR_OPTION_DISABLE_HASH_COMMENTS | 
+                SIR_OPTION_DISABLE_COLON_ASSIGNMENT);
+
+        if (!(dialect.classes[';'] & SIR_CHAR_COMMENT) ||
+                dialect.classes['#'] || dialect.classes[':'] ||
+                !(dialect.classes['='] & SIR_CHAR_ASSIGNMENT) ||
+                !(dialect.classes['\t'] & SIR_CHAR_WHITESPACE))
+            print("TEST 23 FAILED\n");
+
+        // Files are loaded, and their includes parsed, with the dialect
+        sir_dialect_init(&dialect, SIR_OPTION_NONE);
+
+        ini = sir_load_from_file_dialect("test15.ini", 
+                SIR_OPTION_ENABLE_INCLUDES, &dialect, 0);
+
+        const char *level = sir_section_str(ini, "logging", "level");
+
+        if (sir_has_error(ini) || !level || strcmp(level, "info"))
+            print("TEST 23 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // Bytes above 0x7f aren't whitespace
+        const char *utf8 = "k = caf\xc3\xa9\n\xc3\xa9t\xc3\xa9 = 1\n";
+
+        str = malloc(strlen(utf8) + 1);
+        strcpy(str, utf8);
+        ini = sir_load_from_str(str, SIR_OPTION_DISABLE_WARNINGS, 0, 0);
+
+        const char *k = sir_section_str(ini, "global", "k");
+
+        if (!k || strcmp(k, "caf\xc3\xa9") || 
+                !sir_section_str(ini, "global", "\xc3\xa9t\xc3\xa9"))
+            print("TEST 23 FAILED\n");
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 24 - Escapes and Multi-line Values
+    {
+        ini = sir_load_from_file("test24.ini", SIR_OPTION_ENABLE_ESCAPES, 0);
+
+        const char *quote   = sir_section_str(ini, "escapes", "quote");
+        const char *hash    = sir_section_str(ini, "escapes", "hash");
+        const char *path    = sir_section_str(ini, "escapes", "path");
+        const char *list    = sir_section_str(ini, "escapes", "list");
+        const char *message = sir_section_str(ini, "multi", "message");
+        const char *inline_ = sir_section_str(ini, "multi", "inline");
+        const char *after   = sir_section_str(ini, "multi", "after");
+
+        if (sir_has_error(ini) || ini->warnings_count || 
+                !quote || strcmp(quote, "say \"hi\"\tthen leave") ||
+                !hash || strcmp(hash, "#1") ||
+                !path || strcmp(path, "C:\\dir\\file") ||
+                !list || strcmp(list, "one, two, three") ||
+                !message || 
+                strcmp(message, "Dear user,\n    # not a comment\n") ||
+                !inline_ || strcmp(inline_, "a \"quoted\" word") ||
+                !after || strcmp(after, "1"))
+            print("TEST 24 FAILED\n");
+
+        // Values that need escaping are escaped when saved
+        sir_set(ini, "multi", "after", "two\nlines; \"quoted\" \\");
+        sir_save(ini, "test24_output.ini");
+        sir_free_ini(ini);
+
+        ini = sir_load_from_file("test24_output.ini", 
+                SIR_OPTION_ENABLE_ESCAPES, 0);
+
+        quote   = sir_section_str(ini, "escapes", "quote");
+        message = sir_section_str(ini, "multi", "message");
+        after   = sir_section_str(ini, "multi", "after");
+
+        if (sir_has_error(ini) || 
+                !quote || strcmp(quote, "say \"hi\"\tthen leave") ||
+                !message || 
+                strcmp(message, "Dear user,\n    # not a comment\n") ||
+                !after || strcmp(after, "two\nlines; \"quoted\" \\"))
+            print("TEST 24 FAILED\n");
+
+        sir_free_ini(ini);
+        remove("test24_output.ini");
+
+        // Without the option '\' is an ordinary character, and the last 
+        // value doesn't need a newline after it
+        const char *text = "a = \\#1\nb = \"x\"";
+
+        char *str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, SIR_OPTION_DISABLE_WARNINGS, 0, 0);
+
+        const char *a = sir_section_str(ini, "global", "a");
+        const char *b = sir_section_str(ini, "global", "b");
+
+        if (ini->key_count != 2 || !a || strcmp(a, "\\") || 
+                !b || strcmp(b, "x"))
+            print("TEST 24 FAILED\n");
+
+        sir_free_ini(ini);
+
+        text = "a = 1";
+        str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, SIR_OPTION_ENABLE_ESCAPES, 0, 0);
+
+        a = sir_section_str(ini, "global", "a");
+
+        if (ini->key_count != 1 || !a || strcmp(a, "1"))
+            print("TEST 24 FAILED\n");
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 25 - UTF-8
+    {
+        // A byte order mark isn't part of the first key name
+        const char *text = "\xEF\xBB\xBF" "a = 1\n";
+
+        char *str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, SIR_OPTION_VALIDATE_UTF8, 0, 0);
+
+        const char *a = sir_section_str(ini, "global", "a");
+
+        if (sir_has_error(ini) || ini->warnings_count || !a || strcmp(a, "1"))
+            print("TEST 25 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // One warning for each invalid sequence, with its line and character
+        text = "name = caf\xC3\xA9 and plenty of plain ASCII text\n"
+            "bad = \xC3\x28\n"
+            "surrogate = \xED\xA0\x80\n"
+            "truncated = \xE2\x82";
+
+        str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, SIR_OPTION_VALIDATE_UTF8, "utf8", 0);
+
+        if (ini->warnings_count != 3 || 
+                strcmp(ini->warnings[0], 
+                    "utf8:2:7: warning: invalid UTF-8 sequence") ||
+                strcmp(ini->warnings[1], 
+                    "utf8:3:13: warning: invalid UTF-8 sequence") ||
+                strcmp(ini->warnings[2], 
+                    "utf8:4:13: warning: invalid UTF-8 sequence"))
+            print("TEST 25 FAILED\n");
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 26 - UTF-16LE Files
+    {
+        // "[s]\r\nname = café € \U0001D11E\r\n"
+        // "broken = \xD800!\r\nplain = some ASCII text\r\n"
+        const unsigned short units[] = {
+            0xFEFF, '[', 's', ']', '\r', '\n', 
+            'n', 'a', 'm', 'e', ' ', '=', ' ', 'c', 'a', 'f', 0x00E9, ' ', 
+            0x20AC, ' ', 0xD834, 0xDD1E, '\r', '\n',
+            'b', 'r', 'o', 'k', 'e', 'n', ' ', '=', ' ', 0xD800, '!', 
+            '\r', '\n',
+            'p', 'l', 'a', 'i', 'n', ' ', '=', ' ', 's', 'o', 'm', 'e', ' ', 
+            'A', 'S', 'C', 'I', 'I', ' ', 't', 'e', 'x', 't', '\r', '\n'
+        };
+
+        FILE *file = fopen("test26.ini", "wb");
+
+        for (size_t i = 0; i < sizeof(units) / sizeof(*units); ++i)
+        {
+            fputc(units[i] & 0xFF, file);
+            fputc(units[i] >> 8, file);
+        }
+
+        fclose(file);
+
+        ini = sir_load_from_file("test26.ini", SIR_OPTION_VALIDATE_UTF8, 0);
+
+        const char *name   = sir_section_str(ini, "s", "name");
+        const char *broken = sir_section_str(ini, "s", "broken");
+        const char *plain  = sir_section_str(ini, "s", "plain");
+
+        if (sir_has_error(ini) || ini->warnings_count || 
+                !name || strcmp(name, 
+                    "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9D\x84\x9E") ||
+                !broken || strcmp(broken, "\xEF\xBF\xBD!") ||
+                !plain || strcmp(plain, "some ASCII text"))
+            print("TEST 26 FAILED\n");
+
+        sir_free_ini(ini);
+        remove("test26.ini");
+    }
+
+    // TEST 27 - Unicode Case Folding
+    {
+        const char *text = 
+            "[\xC3\x84RGER]\n"                          // ÄRGER
+            "\xCE\xA3\xCE\x99\xCE\x93\xCE\x9C\xCE\x91 = 1\n"  // ΣΙΓΜΑ
+            "Stra\xC3\x9F" "e = 2\n"                    // Straße
+            "\xE2\x84\xAA" "elvin = 3\n";               // Kelvin sign
+
+        char *str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, SIR_OPTION_DISABLE_CASE_SENSITIVITY | 
+                SIR_OPTION_FOLD_UNICODE, 0, 0);
+
+        // ärger, σίγμα with a final sigma, STRASSE, kelvin
+        const char *sigma  = sir_section_str(ini, "\xC3\xA4rger", 
+                "\xCF\x83\xCE\xB9\xCE\xB3\xCE\xBC\xCE\xB1");
+        const char *final  = sir_section_str(ini, "\xC3\xA4rger", 
+                "\xCF\x82\xCE\xB9\xCE\xB3\xCE\xBC\xCE\xB1");
+        const char *strasse = sir_section_str(ini, "\xC3\xA4rger", 
+                "STRA\xC3\x9F" "E");
+        const char *kelvin = sir_section_str(ini, "\xC3\xA4rger", "KELVIN");
+
+        if (!sigma || strcmp(sigma, "1") || !final || strcmp(final, "1") ||
+                !strasse || strcmp(strasse, "2") || 
+                !kelvin || strcmp(kelvin, "3"))
+            print("TEST 27 FAILED\n");
+
+        // Full case folding isn't done, so 'ß' isn't 'ss'
+        if (sir_section_str(ini, "\xC3\xA4rger", "strasse"))
+            print("TEST 27 FAILED\n");
+
+        // Hashed lookups fold the same way
+        SirColumn column;
+        if (sir_column(ini, "\xCF\x83\xCE\xB9\xCE\xB3\xCE\xBC\xCE\xB1", 
+                    &column) != 1)
+            print("TEST 27 FAILED\n");
+
+        sir_free_column(ini, &column);
+        sir_free_ini(ini);
+
+        // Without the option only ASCII is folded
+        str = malloc(strlen(text) + 1);
+        strcpy(str, text);
+        ini = sir_load_from_str(str, SIR_OPTION_DISABLE_CASE_SENSITIVITY,
+                0, 0);
+
+        if (sir_section_str(ini, "\xC3\xA4rger", "KELVIN") || 
+                !sir_section_str(ini, "\xC3\x84rger", "STRA\xC3\x9F" "E"))
+            print("TEST 27 FAILED\n");
+
+        sir_free_ini(ini);
+    }
+
+    // TEST 28 - Large Files
+    //
+    // Only runs when SIR_TEST_LARGE_FILES is set to a size in MB, e.g. 5120,
+    // since it needs that much disk space and memory
+    if (getenv("SIR_TEST_LARGE_FILES"))
+    {
+        long long mb = atoll(getenv("SIR_TEST_LARGE_FILES"));
+        size_t padding_size = 1024 * 1024;
+        char *padding = malloc(padding_size);
+
+        // One key per MB, with comment lines in between
+        for (size_t i = 0; i < padding_size; i += 64)
+        {
+            memset(padding + i, ' ', 63);
+            padding[i] = ';';
+            padding[i + 63] = '\n';
+        }
+
+        FILE *file = fopen("test28.ini", "wb");
+
+        for (long long i = 0; i < mb; ++i)
+        {
+            fprintf(file, "k%lld = %lld\n", i, i);
+            fwrite(padding, 1, padding_size, file);
+        }
+
+        fputs("[end]\nlast = 1\n", file);
+        fclose(file);
+
+        ini = sir_load_from_file("test28.ini", 0, 0);
+
+        char middle[32];
+        snprintf(middle, sizeof(middle), "k%lld", mb / 2);
+
+        const char *value = sir_str(ini, middle);
+        const char *last  = sir_section_str(ini, "end", "last");
+
+        if (sir_has_error(ini) || ini->key_count != mb + 1 || 
+                !value || atoll(value) != mb / 2 || 
+                !last || strcmp(last, "1"))
+            print("TEST 28 FAILED\n");
+
+        sir_free_ini(ini);
+
+        // When built with -DSIR_INDEX=int, more than INT_MAX keys is an 
+        // error, not an overflow
+        if (sizeof(SirIndex) == sizeof(int) && mb > 2048)
+        {
+            memset(padding, '=', padding_size);
+
+            file = fopen("test28.ini", "wb");
+
+            for (long long i = 0; i < mb; ++i)
+                fwrite(padding, 1, padding_size, file);
+
+            fclose(file);
+
+            ini = sir_load_from_file("test28.ini", 0, 0);
+
+            if (!sir_has_error(ini) || ini->key_count)
+                print("TEST 28 FAILED\n");
+
+            sir_free_ini(ini);
+        }
+
+        free(padding);
+        remove("test28.ini");
+    }
+
+    // TEST 29 - sir grep with UTF-8
+    //
+    // Only runs when SIR_UTIL is set to the path of a built sir utility
+    if (getenv("SIR_UTIL"))
+    {
+        char command[1024];
+        snprintf(command, sizeof(command), "\"%s\" grep a test29.ini", 
+                getenv("SIR_UTIL"));
+
+        FILE *output = popen(command, "r");
+        char result[256];
+        size_t size = output ? fread(result, 1, sizeof(result) - 1, output) : 0;
+        result[size] = '\0';
+
+        // Bytes >= 0x80 aren't whitespace, and the byte order mark is skipped
+        if (!output || strcmp(result, 
+                    "test29.ini\tcaf\xC3\xA9\tname\tcaf\xC3\xA9\n"
+                    "test29.ini\tcaf\xC3\xA9\t\xC3\xA9t\xC3\xA9\t"
+                    "\xC3\xA0 la carte\n"))
+            print("TEST 29 FAILED\n");
+
+        if (output) pclose(output);
+    }
+
+    // TEST 30 - Trailing Name Without a Value
+    {
+        // A name with no assignment at the end of the data isn't a key, and
+        // used to be written past the end of the keys
+        const char *texts[] = { "x", "[s]\na = 1\nname", "a = 1\n[s]\nb" };
+
+        for (int i = 0; i < 3; ++i)
+        {
+            char *str = malloc(strlen(texts[i]) + 1);
+            strcpy(str, texts[i]);
+            ini = sir_load_from_str(str, SIR_OPTION_PRESERVE_SOURCE, 0, 0);
+
+            if (sir_has_error(ini) || ini->key_count != (i ? 1 : 0) ||
+                    (i && strcmp(sir_section_str(ini, i == 1 ? "s" : 0, "a"), 
+                                 "1")))
+                print("TEST 30 FAILED\n");
+
+            sir_free_ini(ini);
+        }
+    }
+
     return 0;
 }
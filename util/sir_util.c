@@ -3,6 +3,7 @@
 //
 // Author: Sebastian Jones (http://www.sebj.co.uk)
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,70 +11,2240 @@
 #define SIMPLE_INI_READER_IMPLEMENTATION
 #include "../simple_ini_reader.h"
 
+// Returns 1 if 'arg' is an option that is followed by an operand (e.g.
+// "-k key_name"), or 0 otherwise.
+int arg_takes_operand(const char *arg)
+{
+    if (arg[0] == '-' && arg[1] == '-')
+        return !strcmp(arg, "--format") || !strcmp(arg, "--serve") ||
+            !strcmp(arg, "--gen-header");
+
+    return arg[0] == '-' && strcmp(arg, "-0");
+}
+
 // Returns the first argument that doesn't start with '-' or "--", or
 // 0 if none is found
 char *arg_first_non_option(int argc, char **argv)
 {
     for (int i = 1; i < argc; ++i)
     {
-        if (argv[i][0] == '-')
+        if (argv[i][0] == '-')
+        {
+            if (arg_takes_operand(argv[i])) 
+                ++i;
+        }
+        else
+        {
+            return argv[i];
+        }
+    }
+
+    return 0;
+}
+
+// Returns the index of the first argument that matched 'arg', or -1
+// if not found.
+int arg_index(int argc, char **argv, char *arg)
+{
+    for (int i = 1; i < argc; ++i)
+        if (!strcmp(argv[i], arg))
+            return i;
+
+    return -1;
+}
+
+// Returns the operand of 'option' or 0 if the option is not found or
+// an operand is not specified.
+char *arg_operand(int argc, char **argv, char *option)
+{
+    int option_index = arg_index(argc, argv, option);
+    if (option_index == -1)
+        return 0;
+
+    int operand_index = option_index + 1;
+    if (operand_index >= argc)
+        return 0;
+
+    return argv[operand_index];
+}
+
+//
+// OUTPUT
+//
+// Everything written to Standard Output goes through a single large buffer
+// so that listing millions of keys costs a handful of fwrite() calls rather
+// than one printf() per line. Strings that are too big to be worth copying
+// are written straight from the INI data.
+//
+#ifndef OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#endif
+
+typedef enum OutputFlags
+{
+    OUTPUT_NUL_DELIMITED  = 0x1,
+    OUTPUT_LENGTH_PREFIX  = 0x2,
+}
+OutputFlags;
+
+static char   output_buffer[OUTPUT_BUFFER_SIZE];
+static size_t output_used  = 0;
+static int    output_flags = 0;
+
+// Writes the contents of the output buffer to Standard Output and flushes
+// it. Returns -1 if any write to Standard Output has failed, e.g. because the
+// disk is full or the pipe was closed, or 0 otherwise.
+int output_flush()
+{
+    if (output_used)
+        fwrite(output_buffer, 1, output_used, stdout);
+
+    output_used = 0;
+
+    int flushed = fflush(stdout) == 0;
+
+    return (flushed && !ferror(stdout)) ? 0 : -1;
+}
+
+// Appends 'size' bytes from 'data' to the output buffer
+void output_bytes(const char *data, size_t size)
+{
+    if (output_used + size > OUTPUT_BUFFER_SIZE)
+    {
+        output_flush();
+
+        if (size > OUTPUT_BUFFER_SIZE / 2)
+        {
+            fwrite(data, 1, size, stdout);
+            return;
+        }
+    }
+
+    memcpy(output_buffer + output_used, data, size);
+    output_used += size;
+}
+
+// Writes 'str' as a single record. By default records are terminated by a
+// newline; the '-0' option terminates them with '\0' instead, and the
+// '--length-prefixed' option writes the length of the record in decimal
+// followed by ':' before the record itself.
+void output_record(const char *str)
+{
+    size_t size = strlen(str);
+
+    if (output_flags & OUTPUT_LENGTH_PREFIX)
+    {
+        char digits[24];
+        int  n = sizeof(digits);
+        size_t s = size;
+
+        digits[--n] = ':';
+
+        do
+        {
+            digits[--n] = '0' + (s % 10);
+            s /= 10;
+        }
+        while (s);
+
+        output_bytes(digits + n, sizeof(digits) - n);
+    }
+
+    output_bytes(str, size);
+
+    output_bytes((output_flags & OUTPUT_NUL_DELIMITED) ? "\0" : "\n", 1);
+}
+
+// Prints a usage message to Standard Output
+void print_help()
+{
+    printf("\n\tsir [-s section_name] [-k key_name] [-0] [FILENAME]\n"
+            "\tsir --format json|ndjson [FILENAME]\n"
+            "\tsir grep [--keys] [--values] [-l] [-E] [-0] PATTERN FILE...\n"
+            "\tsir compile FILENAME -o IMAGE\n"
+            "\tsir --gen-header SCHEMA\n\n"
+            "\tParses INI data and prints the value of the specified\n"
+            "\tkey from the specified section. If 'FILENAME' is not\n"
+            "\tspecified, the program attempts to read the data from\n"
+            "\tStandard Input (pipes and redirection only).\n\n"
+            "\tOPTIONS\n\n"
+            "\t-s section_name\t\tLook only in the given section.\n"
+            "\t\t\t\tIf omitted, all sections are used.\n\n"
+            "\t-k key_name\t\tFind the value of this key only.\n"
+            "\t\t\t\tIf omitted, all values are listed.\n\n"
+            "\t--help\t\t\tDisplay this help screen.\n\n"
+            "\t--list-keys\t\tList key names. If used with the '-s'\n"
+            "\t\t\t\toption, lists the key names in that section.\n\n"
+            "\t--list-sections\t\tList section names.\n\n"
+            "\t--format FORMAT\t\tWrite the whole INI in FORMAT, which\n"
+            "\t\t\t\tis either 'json' or 'ndjson'.\n\n"
+            "\t-0\t\t\tTerminate each output record with '\\0'\n"
+            "\t\t\t\tinstead of a newline.\n\n"
+            "\t--length-prefixed\tPrefix each output record with its\n"
+            "\t\t\t\tlength in bytes followed by ':'.\n\n"
+            "\tgrep PATTERN FILE...\tPrint the file, section, name and\n"
+            "\t\t\t\tvalue of each key whose name or value\n"
+            "\t\t\t\tcontains PATTERN. '--keys' or\n"
+            "\t\t\t\t'--values' restrict the search, '-l'\n"
+            "\t\t\t\tprints matching filenames only and\n"
+            "\t\t\t\t'-E' treats PATTERN as a regular\n"
+            "\t\t\t\texpression.\n\n"
+            "\tcompile FILENAME -o IMAGE\tWrite a pre-indexed binary image\n"
+            "\t\t\t\tof FILENAME to IMAGE. When IMAGE is\n"
+            "\t\t\t\tgiven as the FILENAME only the '-k'\n"
+            "\t\t\t\toption is supported, but each query\n"
+            "\t\t\t\ttakes constant time.\n\n"
+            "\t--serve SOCKET FILE...\tKeep each FILE loaded and answer\n"
+            "\t\t\t\tqueries on the Unix domain socket\n"
+            "\t\t\t\tSOCKET (see README.md).\n\n"
+            "\t--gen-header SCHEMA\tPrint a C header with a struct for\n"
+            "\t\t\t\teach section of SCHEMA and a loader\n"
+            "\t\t\t\tthat fills them in from an INI\n"
+            "\t\t\t\t(see README.md).\n\n"
+          );
+}
+
+//
+// SERVER MODE
+//
+// 'sir --serve SOCKET FILE...' keeps every FILE parsed in memory and answers
+// queries over a Unix domain socket, so that scripts which make thousands
+// of queries don't pay for loading the INI each time. Each request is a
+// single line made of tab-separated fields:
+//
+//      get <TAB> key_name
+//      get <TAB> section_name <TAB> key_name
+//      keys [<TAB> section_name]
+//      values [<TAB> section_name]
+//      sections
+//
+// Files are searched in the order they were given on the command line. The
+// reply is either "OK n" followed by n lines of results, or "ERR message".
+// Newlines, tabs and backslashes in results are escaped as '\n', '\t' and
+// '\\'. Files are re-loaded when their modification time or size changes.
+//
+#ifdef __unix__
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef SERVE_MAX_REQUEST_SIZE
+#define SERVE_MAX_REQUEST_SIZE 4096
+#endif
+
+typedef struct ServedFile
+{
+    const char *filename;
+    SirIni ini;
+    struct stat st;
+}
+ServedFile;
+
+typedef struct ServeResponse
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+    unsigned long long lines;
+}
+ServeResponse;
+
+// Client sockets are non-blocking. Replies are queued in 'output' and sent 
+// as the client reads them, so a client that stops reading only stalls 
+// itself. 'closing' closes the connection once 'output' has been sent.
+typedef struct ServeClient
+{
+    int fd;
+    size_t used;
+    char request[SERVE_MAX_REQUEST_SIZE];
+    ServeResponse output;
+    size_t sent;
+    char closing;
+}
+ServeClient;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+void serve_handle_signal(int sig)
+{
+    (void)sig;
+    serve_stop = 1;
+}
+
+// Loads 'file->filename' if it hasn't been loaded yet or if it has changed
+// on disk since it was last loaded.
+void serve_refresh_file(ServedFile *file)
+{
+    struct stat st;
+
+    if (stat(file->filename, &st) == -1)
+        return;
+
+    if (file->ini && st.st_mtime == file->st.st_mtime &&
+            st.st_size == file->st.st_size && st.st_ino == file->st.st_ino)
+        return;
+
+    SirIni ini = sir_load_from_file(file->filename, 
+            SIR_OPTION_DISABLE_WARNINGS, 0);
+
+    if (!ini || sir_has_error(ini))
+    {
+        fprintf(stderr, "%s: %s\n", file->filename, 
+                ini ? ini->error : "Something went seriously wrong");
+        sir_free_ini(ini);
+        return;
+    }
+
+    sir_free_ini(file->ini);
+
+    file->ini = ini;
+    file->st = st;
+}
+
+void serve_append(ServeResponse *response, const char *data, size_t size)
+{
+    if (response->size + size > response->capacity)
+    {
+        while (response->size + size > response->capacity)
+            response->capacity = response->capacity ? 
+                response->capacity * 2 : 4096;
+
+        response->data = realloc(response->data, response->capacity);
+    }
+
+    memcpy(response->data + response->size, data, size);
+    response->size += size;
+}
+
+// Appends 'str' as a single line of the response, escaping any characters
+// that would break the line protocol.
+void serve_append_line(ServeResponse *response, const char *str)
+{
+    const char *start = str;
+
+    for (; *str; ++str)
+    {
+        const char *escape = 0;
+
+        if      (*str == '\n') escape = "\\n";
+        else if (*str == '\t') escape = "\\t";
+        else if (*str == '\\') escape = "\\\\";
+
+        if (escape)
+        {
+            serve_append(response, start, str - start);
+            serve_append(response, escape, 2);
+            start = str + 1;
+        }
+    }
+
+    serve_append(response, start, str - start);
+    serve_append(response, "\n", 1);
+
+    ++response->lines;
+}
+
+// Executes a single request and queues the reply on 'client'
+void serve_request(ServeClient *client, char *request, ServedFile *files, 
+        int files_count)
+{
+    static ServeResponse response;
+
+    char *fields[4];
+    int fields_count = 0;
+
+    fields[fields_count++] = request;
+
+    for (char *c = request; *c && fields_count < 4; ++c)
+    {
+        if (*c == '\t')
+        {
+            *c = '\0';
+            fields[fields_count++] = c + 1;
+        }
+    }
+
+    response.size  = 0;
+    response.lines = 0;
+
+    const char *error = 0;
+
+    if (!strcmp(fields[0], "get") && (fields_count == 2 || 
+                fields_count == 3))
+    {
+        const char *section = (fields_count == 3) ? fields[1] : 0;
+        const char *key     = fields[fields_count - 1];
+
+        error = "key not found";
+
+        for (int i = 0; i < files_count; ++i)
+        {
+            if (!files[i].ini) continue;
+
+            const char *value = sir_section_str(files[i].ini, section, key);
+
+            if (value)
+            {
+                serve_append_line(&response, value);
+                error = 0;
+                break;
+            }
+        }
+    }
+    else if ((!strcmp(fields[0], "keys") || !strcmp(fields[0], "values")) && 
+            fields_count <= 2)
+    {
+        char keys = !strcmp(fields[0], "keys");
+
+        for (int i = 0; i < files_count; ++i)
+        {
+            SirIni ini = files[i].ini;
+
+            if (!ini) continue;
+
+            if (fields_count == 2)
+            {
+                SirIndex size;
+                const char **array = keys ? 
+                    sir_section_key_names(ini, fields[1], &size) :
+                    sir_section_key_values(ini, fields[1], &size);
+
+                if (!array) continue;
+
+                for (SirIndex j = 0; j < size; ++j)
+                    serve_append_line(&response, array[j]);
+
+                sir_free(ini, (void *)array);
+            }
+            else
+            {
+                for (SirIndex j = 0; j < ini->key_count; ++j)
+                    serve_append_line(&response, keys ? 
+                            ini->key_names[j] : ini->key_values[j]);
+            }
+        }
+    }
+    else if (!strcmp(fields[0], "sections") && fields_count == 1)
+    {
+        for (int i = 0; i < files_count; ++i)
+        {
+            SirIni ini = files[i].ini;
+
+            if (!ini) continue;
+
+            for (SirIndex j = 0; j < ini->section_count; ++j)
+                if (strcmp(ini->section_names[j], SIR_GLOBAL_SECTION_NAME))
+                    serve_append_line(&response, ini->section_names[j]);
+        }
+    }
+    else
+    {
+        error = "unknown request";
+    }
+
+    char header[64];
+
+    if (error)
+    {
+        snprintf(header, sizeof(header), "ERR %s\n", error);
+        response.size = 0;
+    }
+    else
+    {
+        snprintf(header, sizeof(header), "OK %llu\n", response.lines);
+    }
+
+    serve_append(&client->output, header, strlen(header));
+    serve_append(&client->output, response.data, response.size);
+}
+
+// Sends as much of the queued output of 'client' as its socket takes without
+// blocking. Returns 0 if the connection should be closed.
+int serve_flush(ServeClient *client)
+{
+    while (client->sent < client->output.size)
+    {
+        ssize_t n = write(client->fd, client->output.data + client->sent,
+                client->output.size - client->sent);
+
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;
+
+        if (n == -1 && errno == EINTR) continue;
+
+        if (n <= 0) return 0;
+
+        client->sent += n;
+    }
+
+    client->output.size = 0;
+    client->sent = 0;
+
+    return !client->closing;
+}
+
+// Reads whatever is available from 'client' and answers every complete
+// request. Returns 0 if the connection should be closed.
+int serve_read(ServeClient *client, ServedFile *files, int files_count)
+{
+    ssize_t n = read(client->fd, client->request + client->used,
+            sizeof(client->request) - client->used);
+
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || 
+                errno == EINTR))
+        return 1;
+
+    if (n <= 0) return 0;
+
+    client->used += n;
+
+    char *start = client->request;
+    char *end   = client->request + client->used;
+    char *newline;
+
+    while ((newline = memchr(start, '\n', end - start)))
+    {
+        *newline = '\0';
+
+        if (newline > start && newline[-1] == '\r')
+            newline[-1] = '\0';
+
+        serve_request(client, start, files, files_count);
+
+        start = newline + 1;
+    }
+
+    client->used = end - start;
+    memmove(client->request, start, client->used);
+
+    if (client->used == sizeof(client->request))
+    {
+        const char *error = "ERR request too long\n";
+        serve_append(&client->output, error, strlen(error));
+        client->closing = 1;
+    }
+
+    return serve_flush(client);
+}
+
+void serve_close_client(ServeClient *client)
+{
+    close(client->fd);
+    free(client->output.data);
+    free(client);
+}
+
+int serve(const char *socket_path, char **filenames, int files_count)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%s: socket path is too long\n", socket_path);
+        return 1;
+    }
+
+    ServedFile *files = calloc(files_count, sizeof(*files));
+
+    for (int i = 0; i < files_count; ++i)
+    {
+        files[i].filename = filenames[i];
+        serve_refresh_file(&files[i]);
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listen_fd == -1)
+    {
+        fprintf(stderr, "%s\n", strerror(errno));
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    unlink(socket_path);
+
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+            listen(listen_fd, SOMAXCONN) == -1)
+    {
+        fprintf(stderr, "%s: %s\n", socket_path, strerror(errno));
+        close(listen_fd);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT,  serve_handle_signal);
+    signal(SIGTERM, serve_handle_signal);
+
+    // Index 0 of 'fds' is the listening socket, the rest are clients
+    int clients_count = 0;
+    int clients_size  = 16;
+    ServeClient **clients = malloc(sizeof(*clients) * clients_size);
+    struct pollfd *fds = malloc(sizeof(*fds) * (clients_size + 1));
+
+    while (!serve_stop)
+    {
+        fds[0].fd     = listen_fd;
+        fds[0].events = POLLIN;
+
+        // A client with queued output isn't read from until it has been
+        // sent, so a client that doesn't read can't make it grow forever
+        for (int i = 0; i < clients_count; ++i)
+        {
+            fds[i + 1].fd     = clients[i]->fd;
+            fds[i + 1].events = clients[i]->output.size ? POLLOUT : POLLIN;
+        }
+
+        if (poll(fds, clients_count + 1, -1) == -1)
+        {
+            if (errno == EINTR) continue;
+
+            fprintf(stderr, "%s\n", strerror(errno));
+            break;
+        }
+
+        // Files are checked for changes once per wakeup, not per request
+        for (int i = 0; i < clients_count; ++i)
+        {
+            if (fds[i + 1].revents & POLLIN)
+            {
+                for (int j = 0; j < files_count; ++j)
+                    serve_refresh_file(&files[j]);
+
+                break;
+            }
+        }
+
+        for (int i = clients_count - 1; i >= 0; --i)
+        {
+            short revents = fds[i + 1].revents;
+
+            if (!revents) continue;
+
+            int open = (revents & POLLOUT) ? serve_flush(clients[i]) :
+                serve_read(clients[i], files, files_count);
+
+            if (!open)
+            {
+                serve_close_client(clients[i]);
+                clients[i] = clients[--clients_count];
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(listen_fd, 0, 0);
+
+            if (fd == -1) continue;
+
+            if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1)
+            {
+                close(fd);
+                continue;
+            }
+
+            if (clients_count == clients_size)
+            {
+                clients_size *= 2;
+                clients = realloc(clients, sizeof(*clients) * clients_size);
+                fds = realloc(fds, sizeof(*fds) * (clients_size + 1));
+            }
+
+            clients[clients_count] = calloc(1, sizeof(**clients));
+
+            if (!clients[clients_count])
+            {
+                close(fd);
+                continue;
+            }
+
+            clients[clients_count]->fd = fd;
+            ++clients_count;
+        }
+    }
+
+    for (int i = 0; i < clients_count; ++i)
+        serve_close_client(clients[i]);
+
+    for (int i = 0; i < files_count; ++i)
+        sir_free_ini(files[i].ini);
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    free(clients);
+    free(fds);
+    free(files);
+
+    return 0;
+}
+
+#endif
+
+//
+// GREP
+//
+// 'sir grep PATTERN FILE...' finds the keys whose name or value contains
+// PATTERN. Rather than loading every file, the raw text of each file is
+// searched for PATTERN and only the lines containing a match are parsed,
+// which is enough to report the section, key name and value. Each match is
+// printed as a record made of the tab-separated filename, section name, key
+// name and value.
+//
+#ifdef __unix__
+#include <regex.h>
+#endif
+
+typedef enum GrepFlags
+{
+    GREP_KEYS       = 0x1,
+    GREP_VALUES     = 0x2,
+    GREP_FILES_ONLY = 0x4,
+    GREP_REGEX      = 0x8,
+    GREP_EVERY_LINE = 0x10,
+}
+GrepFlags;
+
+typedef struct GrepPattern
+{
+    const char *literal;
+    size_t size;
+#ifdef __unix__
+    regex_t regex;
+#endif
+    int flags;
+}
+GrepPattern;
+
+// Returns a pointer to the first match of 'pattern' in the 'size' bytes at
+// 'str', or 0 if there isn't one. 'str' must be followed by a '\0'. The
+// length of the match is stored in 'match_size_ret'.
+const char *grep_find(GrepPattern *pattern, const char *str, size_t size,
+        size_t *match_size_ret)
+{
+#ifdef __unix__
+    if (pattern->flags & GREP_REGEX)
+    {
+        regmatch_t match;
+
+        match.rm_so = 0;
+        match.rm_eo = size;
+
+        if (regexec(&pattern->regex, str, 1, &match, REG_STARTEND))
+            return 0;
+
+        *match_size_ret = match.rm_eo - match.rm_so;
+        return str + match.rm_so;
+    }
+#endif
+
+    *match_size_ret = pattern->size;
+
+    if (pattern->size == 0)
+        return str;
+
+    // memchr() is usually vectorized, so use it to skip to the candidates
+    const char *end = str + size - pattern->size + 1;
+    const char first = pattern->literal[0];
+
+    while (str < end)
+    {
+        str = memchr(str, first, end - str);
+
+        if (!str)
+            return 0;
+
+        if (!memcmp(str, pattern->literal, pattern->size))
+            return str;
+
+        ++str;
+    }
+
+    return 0;
+}
+
+// Returns 1 if 'pattern' matches somewhere in 'str'
+int grep_matches(GrepPattern *pattern, const char *str, size_t size)
+{
+    size_t match_size;
+
+    if (size < pattern->size && !(pattern->flags & GREP_REGEX))
+        return 0;
+
+    return grep_find(pattern, str, size, &match_size) != 0;
+}
+
+// Trims whitespace from both ends of the span [*start, *end)
+void grep_trim(const char **start, const char **end)
+{
+    while (*start < *end && (unsigned char)**start <= ' ') ++*start;
+    while (*end > *start && (unsigned char)(*end)[-1] <= ' ') --*end;
+}
+
+// Searches 'data' for 'pattern', printing each matching key. Returns the
+// number of matches.
+int grep_data(GrepPattern *pattern, const char *filename, 
+        const char *data, size_t size)
+{
+    // A UTF-8 byte order mark is skipped, as sir_load_from_str() does
+    if (size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+    {
+        data += 3;
+        size -= 3;
+    }
+
+    const char *end = data + size;
+
+    // The most recent section header before 'scanned'
+    const char *section     = SIR_GLOBAL_SECTION_NAME;
+    size_t      section_len = strlen(section);
+    const char *scanned     = data;
+
+    const char *str = data;
+    int matches = 0;
+
+    while (str < end)
+    {
+        size_t match_size;
+        const char *match = (pattern->flags & GREP_EVERY_LINE) ? str : 
+            grep_find(pattern, str, end - str, &match_size);
+
+        if (!match)
+            break;
+
+        const char *line_start = match;
+        while (line_start > data && line_start[-1] != '\n') --line_start;
+
+        const char *line_end = memchr(match, '\n', end - match);
+        if (!line_end) line_end = end;
+
+        str = line_end + 1;
+
+        // Find the section this line belongs to by looking for headers 
+        // between the last line we checked and this one
+        const char *bracket;
+        while ((bracket = memchr(scanned, SIR__SECTION_NAME_OPEN_CHAR, 
+                        line_start - scanned)))
+        {
+            const char *c = bracket;
+            while (c > data && c[-1] != '\n' && 
+                    (unsigned char)c[-1] <= ' ')
+                --c;
+
+            scanned = bracket + 1;
+
+            if (c > data && c[-1] != '\n')
+                continue;
+
+            const char *name_end = bracket + 1;
+            while (name_end < line_start && *name_end != '\n' &&
+                    *name_end != SIR__SECTION_NAME_CLOSE_CHAR)
+                ++name_end;
+
+            section = bracket + 1;
+            grep_trim(&section, &name_end);
+            section_len = name_end - section;
+        }
+
+        scanned = line_start;
+
+        // Parse the line in the same way as sir_load_from_str()
+        const char *key = line_start;
+        while (key < line_end && (unsigned char)*key <= ' ') ++key;
+
+        if (key == line_end || *key == SIR__SECTION_NAME_OPEN_CHAR ||
+                sir__is_comment_char(0, *key) || 
+                *key == SIR_COMMENT_CHAR_ALT)
+            continue;
+
+        const char *comment = key;
+        while (comment < line_end && *comment != SIR_COMMENT_CHAR &&
+                *comment != SIR_COMMENT_CHAR_ALT)
+            ++comment;
+
+        const char *key_end = key;
+        while (key_end < comment && *key_end != SIR_KEY_ASSIGNMENT_CHAR &&
+                *key_end != SIR_KEY_ASSIGNMENT_CHAR_ALT)
+            ++key_end;
+
+        if (key_end == comment)
+            continue;
+
+        const char *value     = key_end + 1;
+        const char *value_end = comment;
+
+        grep_trim(&key, &key_end);
+        grep_trim(&value, &value_end);
+
+        const char *quote = memchr(value, '\"', value_end - value);
+        if (quote)
+        {
+            value = quote + 1;
+            quote = memchr(value, '\"', value_end - value);
+            if (quote) value_end = quote;
+        }
+
+        if (!((pattern->flags & GREP_KEYS) && 
+                    grep_matches(pattern, key, key_end - key)) &&
+                !((pattern->flags & GREP_VALUES) &&
+                    grep_matches(pattern, value, value_end - value)))
+            continue;
+
+        ++matches;
+
+        if (pattern->flags & GREP_FILES_ONLY)
+        {
+            output_record(filename);
+            break;
+        }
+
+        output_bytes(filename, strlen(filename));
+        output_bytes("\t", 1);
+        output_bytes(section, section_len);
+        output_bytes("\t", 1);
+        output_bytes(key, key_end - key);
+        output_bytes("\t", 1);
+        output_bytes(value, value_end - value);
+        output_bytes((output_flags & OUTPUT_NUL_DELIMITED) ? "\0" : "\n", 1);
+    }
+
+    return matches;
+}
+
+// Entry point for 'sir grep'. 'argv' starts at the argument after "grep".
+// Returns 0 if anything matched, 1 if nothing matched or 2 on error, in the
+// same way as grep(1).
+int grep(int argc, char **argv)
+{
+    GrepPattern pattern;
+    memset(&pattern, 0, sizeof(pattern));
+
+    int i;
+    for (i = 0; i < argc && argv[i][0] == '-'; ++i)
+    {
+        if      (!strcmp(argv[i], "--keys"))   pattern.flags |= GREP_KEYS;
+        else if (!strcmp(argv[i], "--values")) pattern.flags |= GREP_VALUES;
+        else if (!strcmp(argv[i], "-l"))       pattern.flags |= GREP_FILES_ONLY;
+        else if (!strcmp(argv[i], "-E"))       pattern.flags |= GREP_REGEX;
+        else if (!strcmp(argv[i], "-0")) output_flags |= OUTPUT_NUL_DELIMITED;
+        else if (!strcmp(argv[i], "--")) { ++i; break; }
+        else
+        {
+            fprintf(stderr, "grep: unknown option '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (i >= argc)
+    {
+        print_help();
+        return 2;
+    }
+
+    if (!(pattern.flags & (GREP_KEYS | GREP_VALUES)))
+        pattern.flags |= GREP_KEYS | GREP_VALUES;
+
+    pattern.literal = argv[i++];
+    pattern.size    = strlen(pattern.literal);
+
+    // Anchors can't be matched against the raw text, because keys and
+    // values are surrounded by other characters, so every line becomes a
+    // candidate that is parsed and then matched
+    if ((pattern.flags & GREP_REGEX) && strpbrk(pattern.literal, "^$"))
+        pattern.flags |= GREP_EVERY_LINE;
+
+    if (pattern.flags & GREP_REGEX)
+    {
+#ifdef __unix__
+        int error = regcomp(&pattern.regex, pattern.literal, 
+                REG_EXTENDED | REG_NEWLINE);
+
+        if (error)
+        {
+            char msg[256];
+            regerror(error, &pattern.regex, msg, sizeof(msg));
+            fprintf(stderr, "grep: %s\n", msg);
+            return 2;
+        }
+#else
+        fprintf(stderr, "grep: -E is only supported on Unix systems\n");
+        return 2;
+#endif
+    }
+
+    int matches = 0;
+    int result  = 1;
+
+    // The buffer is reused for every file
+    char  *data      = 0;
+    size_t data_size = 0;
+
+    for (; i < argc; ++i)
+    {
+        FILE *file = fopen(argv[i], "rb");
+
+        if (!file)
+        {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            result = 2;
+            continue;
+        }
+
+        size_t size = 0;
+
+        for (;;)
+        {
+            if (size + 1 >= data_size)
+            {
+                data_size = data_size ? data_size * 2 : (1 << 16);
+                data = realloc(data, data_size);
+            }
+
+            size_t n = fread(data + size, 1, data_size - size - 1, file);
+
+            if (n == 0) break;
+
+            size += n;
+        }
+
+        if (ferror(file))
+        {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            result = 2;
+        }
+
+        fclose(file);
+
+        data[size] = '\0';
+
+        matches += grep_data(&pattern, argv[i], data, size);
+    }
+
+    if (output_flush())
+    {
+        fprintf(stderr, "%s\n", strerror(errno));
+        result = 2;
+    }
+
+    free(data);
+
+#ifdef __unix__
+    if (pattern.flags & GREP_REGEX)
+        regfree(&pattern.regex);
+#endif
+
+    if (result == 1 && matches) result = 0;
+
+    return result;
+}
+
+//
+// COMPILED IMAGES
+//
+// 'sir compile in.ini -o out.sirb' writes a pre-indexed binary image of an
+// INI. When sir is given an image instead of an INI it recognises it by its
+// magic bytes and answers '-k' queries by reading a few hash table slots and
+// strings, without reading the rest of the file. All integers are stored
+// little-endian. The layout is:
+//
+//      header      "SIRB", version, section count, key count, table size
+//                  and the offsets of the tables below (SIRB_HEADER_SIZE)
+//      sections    section_count * (u64 name offset, u32 name length, u32 0)
+//      keys        key_count * (u32 section index, u32 name length, 
+//                  u32 value length, u32 0, u64 name offset, u64 value offset)
+//      key table   table_size * (u32 hash, u32 key index + 1) slots indexed
+//                  by the hash of the key name, holding the first key with
+//                  each name
+//      section key table_size * (u32 hash, u32 key index + 1) slots indexed
+//      table       by the hash of the section name and key name
+//      strings     '\0' terminated names and values
+//
+#ifdef __unix__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define SIRB_MAGIC          "SIRB"
+#define SIRB_VERSION        1
+#define SIRB_HEADER_SIZE    64
+#define SIRB_SECTION_SIZE   16
+#define SIRB_KEY_SIZE       32
+#define SIRB_SLOT_SIZE      8
+#define SIRB_U32_MAX        0xFFFFFFFFULL
+
+typedef struct SirbHeader
+{
+    unsigned long version;
+    unsigned long section_count;
+    unsigned long key_count;
+    unsigned long table_size;
+    unsigned long long sections_offset;
+    unsigned long long keys_offset;
+    unsigned long long key_table_offset;
+    unsigned long long section_key_table_offset;
+}
+SirbHeader;
+
+typedef struct SirbKey
+{
+    unsigned long section_index;
+    unsigned long name_size;
+    unsigned long value_size;
+    unsigned long long name_offset;
+    unsigned long long value_offset;
+}
+SirbKey;
+
+// An image being queried. On Unix the whole image is mapped, so a query is a
+// few memory reads; elsewhere, or if mapping fails, it's read through 'file'
+// with 64-bit seeks.
+typedef struct SirbImage
+{
+    FILE *file;
+    const unsigned char *data;
+    unsigned long long size;
+}
+SirbImage;
+
+void sirb_put_u32(unsigned char *p, unsigned long v)
+{
+    for (int i = 0; i < 4; ++i) p[i] = (v >> (i * 8)) & 0xff;
+}
+
+void sirb_put_u64(unsigned char *p, unsigned long long v)
+{
+    for (int i = 0; i < 8; ++i) p[i] = (v >> (i * 8)) & 0xff;
+}
+
+unsigned long sirb_get_u32(const unsigned char *p)
+{
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) | 
+        ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+unsigned long long sirb_get_u64(const unsigned char *p)
+{
+    return (unsigned long long)sirb_get_u32(p) | 
+        ((unsigned long long)sirb_get_u32(p + 4) << 32);
+}
+
+// 32-bit FNV-1a, continuing from 'hash'
+unsigned long sirb_hash(unsigned long hash, const char *str, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= (unsigned char)str[i];
+        hash = (hash * 16777619UL) & 0xffffffffUL;
+    }
+
+    return hash;
+}
+
+#define SIRB_HASH_INIT 2166136261UL
+
+unsigned long sirb_section_key_hash(const char *section, size_t section_size,
+        const char *key, size_t key_size)
+{
+    unsigned long hash = sirb_hash(SIRB_HASH_INIT, section, section_size);
+    hash = sirb_hash(hash, "", 1);
+    return sirb_hash(hash, key, key_size);
+}
+
+// Inserts 'key_index' into the hash table 'slots' unless an equal key is
+// already present. 'key_section' is used to compare section names, or is 0
+// if only key names should be compared.
+void sirb_insert(unsigned char *slots, unsigned long table_size, 
+        unsigned long hash, unsigned long key_index, SirIni ini, 
+        const SirIndex *key_section)
+{
+    unsigned long slot = hash & (table_size - 1);
+
+    for (;;)
+    {
+        unsigned char *p = slots + slot * SIRB_SLOT_SIZE;
+        unsigned long index = sirb_get_u32(p + 4);
+
+        if (!index)
+        {
+            sirb_put_u32(p, hash);
+            sirb_put_u32(p + 4, key_index + 1);
+            return;
+        }
+
+        --index;
+
+        if (sirb_get_u32(p) == hash &&
+                !strcmp(ini->key_names[index], ini->key_names[key_index]) &&
+                (!key_section || 
+                 key_section[index] == key_section[key_index]))
+            return;
+
+        slot = (slot + 1) & (table_size - 1);
+    }
+}
+
+// Returns the number of slots in each hash table of an image of 'ini'
+unsigned long long sirb_table_size(SirIni ini)
+{
+    unsigned long long table_size = 8;
+
+    while (table_size < (unsigned long long)ini->key_count * 2) 
+        table_size *= 2;
+
+    return table_size;
+}
+
+// Returns why 'ini' can't be compiled, or 0 if it can. Counts, lengths and 
+// table slots are stored in 32 bits, so anything bigger would be truncated.
+const char *sirb_check(SirIni ini)
+{
+    if ((unsigned long long)ini->section_count > SIRB_U32_MAX)
+        return "too many sections for a compiled image";
+
+    // Key indices are stored + 1 in the table slots, and there are at least
+    // twice as many slots as keys
+    if (sirb_table_size(ini) > SIRB_U32_MAX)
+        return "too many keys for a compiled image";
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+        if (strlen(ini->section_names[i]) > SIRB_U32_MAX)
+            return "a section name is too long for a compiled image";
+
+    for (SirIndex i = 0; i < ini->key_count; ++i)
+    {
+        if (strlen(ini->key_names[i]) > SIRB_U32_MAX)
+            return "a key name is too long for a compiled image";
+
+        if (strlen(ini->key_values[i]) > SIRB_U32_MAX)
+            return "a value is too long for a compiled image";
+    }
+
+    return 0;
+}
+
+// Writes a compiled image of 'ini', which must have passed sirb_check(), to
+// 'file'. Returns 0 on success, or -1 with errno set.
+int sirb_write(SirIni ini, FILE *file)
+{
+    unsigned long table_size = (unsigned long)sirb_table_size(ini);
+
+    // Work out which section each key belongs to
+    SirIndex *key_section = malloc(sizeof(*key_section) * (ini->key_count + 1));
+
+    if (!key_section)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+        for (SirIndex j = 0; j < ini->sections[i].ranges_count; ++j)
+            for (SirIndex k = ini->sections[i].ranges[j].start; 
+                    k < ini->sections[i].ranges[j].end; ++k)
+                key_section[k] = i;
+
+    unsigned long long sections_offset = SIRB_HEADER_SIZE;
+    unsigned long long keys_offset = sections_offset + 
+        (unsigned long long)ini->section_count * SIRB_SECTION_SIZE;
+    unsigned long long key_table_offset = keys_offset +
+        (unsigned long long)ini->key_count * SIRB_KEY_SIZE;
+    unsigned long long section_key_table_offset = key_table_offset +
+        (unsigned long long)table_size * SIRB_SLOT_SIZE;
+    unsigned long long strings_offset = section_key_table_offset +
+        (unsigned long long)table_size * SIRB_SLOT_SIZE;
+
+    size_t tables_size = (size_t)strings_offset;
+    unsigned char *tables = (tables_size == strings_offset) ? 
+        calloc(1, tables_size) : 0;
+
+    if (!tables)
+    {
+        free(key_section);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy(tables, SIRB_MAGIC, 4);
+    sirb_put_u32(tables + 4,  SIRB_VERSION);
+    sirb_put_u32(tables + 8,  ini->section_count);
+    sirb_put_u32(tables + 12, ini->key_count);
+    sirb_put_u32(tables + 16, table_size);
+    sirb_put_u64(tables + 24, sections_offset);
+    sirb_put_u64(tables + 32, keys_offset);
+    sirb_put_u64(tables + 40, key_table_offset);
+    sirb_put_u64(tables + 48, section_key_table_offset);
+
+    unsigned long long offset = strings_offset;
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+    {
+        unsigned char *p = tables + sections_offset + 
+            (size_t)i * SIRB_SECTION_SIZE;
+        size_t size = strlen(ini->section_names[i]);
+
+        sirb_put_u64(p, offset);
+        sirb_put_u32(p + 8, size);
+
+        offset += size + 1;
+    }
+
+    for (SirIndex i = 0; i < ini->key_count; ++i)
+    {
+        unsigned char *p = tables + keys_offset + (size_t)i * SIRB_KEY_SIZE;
+        size_t name_size  = strlen(ini->key_names[i]);
+        size_t value_size = strlen(ini->key_values[i]);
+
+        sirb_put_u32(p, key_section[i]);
+        sirb_put_u32(p + 4, name_size);
+        sirb_put_u32(p + 8, value_size);
+        sirb_put_u64(p + 16, offset);
+        sirb_put_u64(p + 24, offset + name_size + 1);
+
+        offset += name_size + value_size + 2;
+
+        const char *section = ini->section_names[key_section[i]];
+
+        sirb_insert(tables + key_table_offset, table_size, 
+                sirb_hash(SIRB_HASH_INIT, ini->key_names[i], name_size),
+                i, ini, 0);
+
+        sirb_insert(tables + section_key_table_offset, table_size,
+                sirb_section_key_hash(section, strlen(section), 
+                    ini->key_names[i], name_size), 
+                i, ini, key_section);
+    }
+
+    fwrite(tables, 1, tables_size, file);
+
+    for (SirIndex i = 0; i < ini->section_count; ++i)
+        fwrite(ini->section_names[i], 1, strlen(ini->section_names[i]) + 1, 
+                file);
+
+    for (SirIndex i = 0; i < ini->key_count; ++i)
+    {
+        fwrite(ini->key_names[i], 1, strlen(ini->key_names[i]) + 1, file);
+        fwrite(ini->key_values[i], 1, strlen(ini->key_values[i]) + 1, file);
+    }
+
+    free(tables);
+    free(key_section);
+
+    return ferror(file) ? -1 : 0;
+}
+
+// Returns 1 if 'filename' starts with SIRB_MAGIC
+int sirb_is_image(const char *filename)
+{
+    char magic[4];
+    FILE *file = fopen(filename, "rb");
+
+    if (!file) return 0;
+
+    int is_image = fread(magic, 1, 4, file) == 4 && 
+        !memcmp(magic, SIRB_MAGIC, 4);
+
+    fclose(file);
+
+    return is_image;
+}
+
+// Opens the image 'filename' for queries. Returns 0 on success.
+int sirb_open(SirbImage *image, const char *filename)
+{
+    memset(image, 0, sizeof(*image));
+
+    image->file = fopen(filename, "rb");
+
+    if (!image->file) return -1;
+
+#ifdef __unix__
+    struct stat st;
+
+    if (fstat(fileno(image->file), &st) == 0 && st.st_size > 0)
+    {
+        void *data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, 
+                fileno(image->file), 0);
+
+        if (data != MAP_FAILED)
+        {
+            image->data = data;
+            image->size = (unsigned long long)st.st_size;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+void sirb_close(SirbImage *image)
+{
+#ifdef __unix__
+    if (image->data) munmap((void *)image->data, (size_t)image->size);
+#endif
+
+    if (image->file) fclose(image->file);
+}
+
+// Seeks to 'offset', which may be past 2GB even where a long is 32 bits
+int sirb_seek(FILE *file, unsigned long long offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(file, (__int64)offset, SEEK_SET);
+#elif defined(__unix__) || defined(__APPLE__)
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#else
+    if (offset > LONG_MAX) return -1;
+    return fseek(file, (long)offset, SEEK_SET);
+#endif
+}
+
+// Returns the 'size' bytes at 'offset' in a mapped image, or 0 if they're 
+// out of bounds
+const unsigned char *sirb_at(SirbImage *image, unsigned long long offset, 
+        size_t size)
+{
+    if (offset > image->size || size > image->size - offset) return 0;
+
+    return image->data + offset;
+}
+
+// Reads 'size' bytes at 'offset' into 'buffer'. Returns 0 on success.
+int sirb_read(SirbImage *image, unsigned long long offset, void *buffer, 
+        size_t size)
+{
+    if (image->data)
+    {
+        const unsigned char *p = sirb_at(image, offset, size);
+
+        if (!p) return -1;
+
+        memcpy(buffer, p, size);
+        return 0;
+    }
+
+    if (sirb_seek(image->file, offset) != 0) return -1;
+
+    return fread(buffer, 1, size, image->file) == size ? 0 : -1;
+}
+
+// Reads the string of 'size' bytes at 'offset' and compares it to 'str'
+int sirb_string_equal(SirbImage *image, unsigned long long offset, 
+        size_t size, const char *str)
+{
+    if (strlen(str) != size) return 0;
+
+    if (image->data)
+    {
+        const unsigned char *p = sirb_at(image, offset, size);
+        return p && !memcmp(p, str, size);
+    }
+
+    char buffer[256];
+
+    while (size)
+    {
+        size_t n = size < sizeof(buffer) ? size : sizeof(buffer);
+
+        if (sirb_read(image, offset, buffer, n) || memcmp(buffer, str, n))
+            return 0;
+
+        offset += n;
+        size   -= n;
+        str    += n;
+    }
+
+    return 1;
+}
+
+// Finds the value of 'key_name' in the compiled image, optionally
+// restricted to 'section_name', and writes it with output_record(). Returns 
+// 0 on success.
+int sirb_query(SirbImage *image, const char *section_name, 
+        const char *key_name)
+{
+    unsigned char buffer[SIRB_HEADER_SIZE];
+    SirbHeader header;
+
+    if (sirb_read(image, 0, buffer, SIRB_HEADER_SIZE)) 
+        return -1;
+
+    header.version                  = sirb_get_u32(buffer + 4);
+    header.section_count            = sirb_get_u32(buffer + 8);
+    header.key_count                = sirb_get_u32(buffer + 12);
+    header.table_size               = sirb_get_u32(buffer + 16);
+    header.sections_offset          = sirb_get_u64(buffer + 24);
+    header.keys_offset              = sirb_get_u64(buffer + 32);
+    header.key_table_offset         = sirb_get_u64(buffer + 40);
+    header.section_key_table_offset = sirb_get_u64(buffer + 48);
+
+    if (header.version != SIRB_VERSION)
+    {
+        fprintf(stderr, "unsupported compiled image version %lu\n", 
+                header.version);
+        return -1;
+    }
+
+    size_t key_size = strlen(key_name);
+    unsigned long hash;
+    unsigned long long table_offset;
+
+    if (section_name)
+    {
+        hash = sirb_section_key_hash(section_name, strlen(section_name), 
+                key_name, key_size);
+        table_offset = header.section_key_table_offset;
+    }
+    else
+    {
+        hash = sirb_hash(SIRB_HASH_INIT, key_name, key_size);
+        table_offset = header.key_table_offset;
+    }
+
+    unsigned long slot = hash & (header.table_size - 1);
+
+    for (unsigned long probes = 0; probes < header.table_size; ++probes)
+    {
+        unsigned char p[SIRB_KEY_SIZE];
+
+        if (sirb_read(image, table_offset + (unsigned long long)slot * 
+                    SIRB_SLOT_SIZE, p, SIRB_SLOT_SIZE))
+            return -1;
+
+        unsigned long index = sirb_get_u32(p + 4);
+
+        if (!index) break;
+
+        slot = (slot + 1) & (header.table_size - 1);
+
+        if (sirb_get_u32(p) != hash) continue;
+
+        if (sirb_read(image, header.keys_offset + 
+                    (unsigned long long)(index - 1) * SIRB_KEY_SIZE, 
+                    p, SIRB_KEY_SIZE))
+            return -1;
+
+        SirbKey key;
+        key.section_index = sirb_get_u32(p);
+        key.name_size     = sirb_get_u32(p + 4);
+        key.value_size    = sirb_get_u32(p + 8);
+        key.name_offset   = sirb_get_u64(p + 16);
+        key.value_offset  = sirb_get_u64(p + 24);
+
+        if (!sirb_string_equal(image, key.name_offset, key.name_size, 
+                    key_name))
+            continue;
+
+        if (section_name)
+        {
+            if (sirb_read(image, header.sections_offset + 
+                        (unsigned long long)key.section_index * 
+                        SIRB_SECTION_SIZE, p, SIRB_SECTION_SIZE))
+                return -1;
+
+            if (!sirb_string_equal(image, sirb_get_u64(p), 
+                        sirb_get_u32(p + 8), section_name))
+                continue;
+        }
+
+        char *value = malloc(key.value_size + 1);
+
+        if (sirb_read(image, key.value_offset, value, key.value_size))
+        {
+            free(value);
+            return -1;
+        }
+
+        value[key.value_size] = '\0';
+        output_record(value);
+        free(value);
+
+        return 0;
+    }
+
+    if (section_name)
+        fprintf(stderr, "key '%s' not found in section '%s'\n", key_name, 
+                section_name);
+    else
+        fprintf(stderr, "key '%s' not found\n", key_name);
+
+    return -1;
+}
+
+// Entry point for 'sir compile'. 'argv' starts at the argument after
+// "compile".
+int sirb_compile(int argc, char **argv)
+{
+    const char *input  = 0;
+    const char *output = 0;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            output = argv[++i];
+        else if (argv[i][0] != '-' && !input)
+            input = argv[i];
+    }
+
+    if (!input || !output)
+    {
+        print_help();
+        return 1;
+    }
+
+    SirIni ini = sir_load_from_file(input, SIR_OPTION_DISABLE_WARNINGS, 0);
+
+    if (!ini)
+    {
+        fprintf(stderr, "Something went seriously wrong\n");
+        return 1;
+    }
+
+    if (sir_has_error(ini))
+    {
+        fprintf(stderr, "%s\n", ini->error);
+        sir_free_ini(ini);
+        return 1;
+    }
+
+    const char *error = sirb_check(ini);
+
+    if (error)
+    {
+        fprintf(stderr, "%s: %s\n", input, error);
+        sir_free_ini(ini);
+        return 1;
+    }
+
+    FILE *file = fopen(output, "wb");
+
+    if (!file)
+    {
+        fprintf(stderr, "%s: %s\n", output, strerror(errno));
+        sir_free_ini(ini);
+        return 1;
+    }
+
+    int result = sirb_write(ini, file);
+
+    if (fclose(file) || result)
+    {
+        fprintf(stderr, "%s: %s\n", output, strerror(errno));
+        result = 1;
+    }
+
+    sir_free_ini(ini);
+
+    return result;
+}
+
+//
+// HEADER GENERATION
+//
+// 'sir --gen-header schema.ini' writes a C header to Standard Output with a
+// struct for each section of the schema and a loader that fills it in from a
+// SirIni. Each key of the schema describes a field:
+//
+//      key_name = TYPE [required] [DEFAULT]
+//
+// where TYPE is one of 'str', 'long', 'unsigned_long', 'double' or 'bool'.
+// The structs are named after the schema file, so 'game.ini' produces a
+// struct 'game' with the global keys and a member 'game_graphics graphics'
+// for the section [graphics], and the loader
+//
+//      const char *game_load(SirIni ini, game *out);
+//
+// which returns 0 on success or a message describing the first bad key. The
+// loader visits each key of the INI once and finds its field with a switch
+// over the FNV-1a hash of the section and key names, which is worked out
+// here, so names are only compared to confirm a match.
+//
+typedef struct GenField
+{
+    const char *section_name;
+    const char *key_name;
+    const char *type;
+    const char *default_value;
+    char *member;
+    SirIndex section_index;
+    int required;
+    unsigned long hash;
+}
+GenField;
+
+static const char *gen_types[] = 
+{ 
+    "str", "long", "unsigned_long", "double", "bool" 
+};
+
+static const char *gen_c_types[] = 
+{ 
+    "const char *", "long ", "unsigned long ", "double ", "char " 
+};
+
+static const char *gen_type_names[] = 
+{ 
+    "string", "long", "unsigned long", "double", "bool" 
+};
+
+static const char *gen_keywords[] =
+{
+    "auto", "break", "case", "char", "const", "continue", "default", "do",
+    "double", "else", "enum", "extern", "float", "for", "goto", "if", 
+    "inline", "int", "long", "register", "restrict", "return", "short", 
+    "signed", "sizeof", "static", "struct", "switch", "typedef", "union", 
+    "unsigned", "void", "volatile", "while"
+};
+
+// Returns 'str' as a C identifier in memory allocated with malloc:
+// characters that can't be used are replaced with '_', a leading digit is
+// prefixed with '_' and keywords are suffixed with '_'
+char *gen_identifier(const char *str, size_t size)
+{
+    char *identifier = malloc(size + 3);
+    if (!identifier) return 0;
+
+    char *p = identifier;
+
+    if (!size || (str[0] >= '0' && str[0] <= '9'))
+        *p++ = '_';
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        char c = str[i];
+        int valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '_';
+        *p++ = valid ? c : '_';
+    }
+
+    *p = '\0';
+
+    int keywords_count = sizeof(gen_keywords) / sizeof(*gen_keywords);
+
+    for (int i = 0; i < keywords_count; ++i)
+    {
+        if (!strcmp(identifier, gen_keywords[i]))
         {
-            if (argv[i][1] != '-') 
-                ++i;
+            strcat(identifier, "_");
+            break;
         }
+    }
+
+    return identifier;
+}
+
+// Writes 'str' escaped for use in a C string literal
+void gen_escaped(const char *str)
+{
+    for (const unsigned char *p = (const unsigned char *)str; *p; ++p)
+    {
+        if (*p == '"' || *p == '\\')
+            printf("\\%c", *p);
+        else if (*p < ' ' || *p >= 0x7f)
+            printf("\\%03o", *p);
         else
-        {
-            return argv[i];
-        }
+            putchar(*p);
+    }
+}
+
+// Writes 'str' as a C string literal
+void gen_string(const char *str)
+{
+    putchar('"');
+    gen_escaped(str);
+    putchar('"');
+}
+
+// Writes a C string literal naming the field followed by 'message'
+void gen_message(GenField *field, const char *message)
+{
+    printf("\"'");
+    gen_escaped(field->key_name);
+    printf("' in section '");
+    gen_escaped(field->section_name);
+    printf("' %s\"", message);
+}
+
+// Returns 1 if 'value' can be converted to 'type' by the loader
+int gen_valid_value(const char *type, const char *value)
+{
+    char *end;
+    errno = 0;
+
+    if (!strcmp(type, "long"))
+        strtol(value, &end, 0);
+    else if (!strcmp(type, "unsigned_long"))
+        strtoul(value, &end, 0);
+    else if (!strcmp(type, "double"))
+        strtod(value, &end);
+    else if (!strcmp(type, "bool"))
+        return !strcmp(value, "true") || !strcmp(value, "false");
+    else
+        return 1;
+
+    return !errno && end != value && !*end;
+}
+
+// Splits the value of a schema key into its type, whether it's required and
+// its default. Returns 0 if the type isn't known.
+int gen_parse_field(char *value, GenField *field)
+{
+    char *p = value;
+
+    while (*p == ' ' || *p == '\t') ++p;
+    field->type = p;
+    while (*p && *p != ' ' && *p != '\t') ++p;
+    if (*p) *p++ = '\0';
+    while (*p == ' ' || *p == '\t') ++p;
+
+    if (!strncmp(p, "required", 8) && (!p[8] || p[8] == ' ' || p[8] == '\t'))
+    {
+        field->required = 1;
+        p += 8;
+        while (*p == ' ' || *p == '\t') ++p;
     }
 
+    field->default_value = *p ? p : 0;
+
+    int types_count = sizeof(gen_types) / sizeof(*gen_types);
+
+    for (int i = 0; i < types_count; ++i)
+        if (!strcmp(field->type, gen_types[i]))
+            return 1;
+
     return 0;
 }
 
-// Returns the index of the first argument that matched 'arg', or -1
-// if not found.
-int arg_index(int argc, char **argv, char *arg)
+int gen_type_index(const char *type)
 {
-    for (int i = 1; i < argc; ++i)
-        if (!strcmp(argv[i], arg))
+    int types_count = sizeof(gen_types) / sizeof(*gen_types);
+
+    for (int i = 0; i < types_count; ++i)
+        if (!strcmp(type, gen_types[i]))
             return i;
 
-    return -1;
+    return 0;
 }
 
-// Returns the operand of 'option' or 0 if the option is not found or
-// an operand is not specified.
-char *arg_operand(int argc, char **argv, char *option)
+// Returns 1 if any field belongs to the section 'section_index'
+int gen_section_has_fields(GenField *fields, int fields_count, 
+        SirIndex section_index)
 {
-    int option_index = arg_index(argc, argv, option);
-    if (option_index == -1)
-        return 0;
+    for (int i = 0; i < fields_count; ++i)
+        if (fields[i].section_index == section_index)
+            return 1;
 
-    int operand_index = option_index + 1;
-    if (operand_index >= argc)
-        return 0;
+    return 0;
+}
 
-    return argv[operand_index];
+// Writes the path of the field's member from the top-level struct, e.g.
+// "graphics.width"
+void gen_member_path(GenField *field, char **section_members)
+{
+    if (field->section_index)
+        printf("%s.", section_members[field->section_index]);
+
+    printf("%s", field->member);
 }
 
-// Prints a usage message to Standard Output
-void print_help()
+void gen_write(const char *prefix, SirIni schema, GenField *fields, 
+        int fields_count, char **section_members)
 {
-    printf("\n\tsir [-s section_name] [-k key_name] [FILENAME]\n\n"
-            "\tParses INI data and prints the value of the specified\n"
-            "\tkey from the specified section. If 'FILENAME' is not\n"
-            "\tspecified, the program attempts to read the data from\n"
-            "\tStandard Input (pipes and redirection only).\n\n"
-            "\tOPTIONS\n\n"
-            "\t-s section_name\t\tLook only in the given section.\n"
-            "\t\t\t\tIf omitted, all sections are used.\n\n"
-            "\t-k key_name\t\tFind the value of this key only.\n"
-            "\t\t\t\tIf omitted, all values are listed.\n\n"
-            "\t--help\t\t\tDisplay this help screen.\n\n"
-            "\t--list-keys\t\tList key names. If used with the '-s'\n"
-            "\t\t\t\toption, lists the key names in that section.\n\n"
-            "\t--list-sections\t\tList section names.\n\n"
-          );
+    char *guard = gen_identifier(prefix, strlen(prefix));
+
+    for (char *p = guard; *p; ++p)
+        if (*p >= 'a' && *p <= 'z') *p -= 'a' - 'A';
+
+    printf("// Generated by 'sir --gen-header'. Do not edit.\n\n"
+            "#ifndef %s_GENERATED_H\n#define %s_GENERATED_H\n\n"
+            "#include <errno.h>\n#include <stdlib.h>\n#include <string.h>\n\n"
+            "#include \"simple_ini_reader.h\"\n\n", guard, guard);
+
+    free(guard);
+
+    // One struct per section, then the top-level struct
+
+    for (SirIndex i = 1; i < schema->section_count; ++i)
+    {
+        if (!gen_section_has_fields(fields, fields_count, i)) continue;
+
+        printf("typedef struct %s_%s\n{\n", prefix, section_members[i]);
+
+        for (int j = 0; j < fields_count; ++j)
+        {
+            if (fields[j].section_index != i) continue;
+
+            printf("    %s%s;\n", gen_c_types[gen_type_index(fields[j].type)],
+                    fields[j].member);
+        }
+
+        printf("}\n%s_%s;\n\n", prefix, section_members[i]);
+    }
+
+    printf("typedef struct %s\n{\n", prefix);
+
+    for (int j = 0; j < fields_count; ++j)
+    {
+        if (fields[j].section_index) continue;
+
+        printf("    %s%s;\n", gen_c_types[gen_type_index(fields[j].type)],
+                fields[j].member);
+    }
+
+    for (SirIndex i = 1; i < schema->section_count; ++i)
+    {
+        if (!gen_section_has_fields(fields, fields_count, i)) continue;
+
+        printf("    %s_%s %s;\n", prefix, section_members[i], 
+                section_members[i]);
+    }
+
+    printf("}\n%s;\n\n", prefix);
+
+    // Hashing and conversion helpers, leaving out the conversions no field 
+    // uses so that the header compiles cleanly with -Wunused-function
+
+    char used[sizeof(gen_types) / sizeof(*gen_types)] = { 0 };
+
+    for (int j = 0; j < fields_count; ++j)
+        used[gen_type_index(fields[j].type)] = 1;
+
+    printf("// 32-bit FNV-1a, continuing from 'hash'\n"
+            "static unsigned long %s__hash(unsigned long hash, "
+            "const char *str)\n"
+            "{\n"
+            "    for (; *str; ++str)\n"
+            "    {\n"
+            "        hash ^= (unsigned char)*str;\n"
+            "        hash = (hash * 16777619UL) & 0xffffffffUL;\n"
+            "    }\n\n"
+            "    return hash;\n"
+            "}\n\n", prefix);
+
+    if (used[1])
+        printf("static int %s__long(const char *str, long *out)\n"
+                "{\n"
+                "    char *end;\n"
+                "    errno = 0;\n"
+                "    *out = strtol(str, &end, 0);\n"
+                "    return !errno && end != str && !*end;\n"
+                "}\n\n", prefix);
+
+    if (used[2])
+        printf("static int %s__unsigned_long(const char *str, "
+                "unsigned long *out)\n"
+                "{\n"
+                "    char *end;\n"
+                "    errno = 0;\n"
+                "    *out = strtoul(str, &end, 0);\n"
+                "    return !errno && end != str && !*end;\n"
+                "}\n\n", prefix);
+
+    if (used[3])
+        printf("static int %s__double(const char *str, double *out)\n"
+                "{\n"
+                "    char *end;\n"
+                "    errno = 0;\n"
+                "    *out = strtod(str, &end);\n"
+                "    return !errno && end != str && !*end;\n"
+                "}\n\n", prefix);
+
+    if (used[4])
+        printf("static int %s__bool(const char *str, char *out)\n"
+                "{\n"
+                "    *out = !strcmp(str, \"true\");\n"
+                "    return *out || !strcmp(str, \"false\");\n"
+                "}\n\n", prefix);
+
+    if (used[0])
+        printf("static int %s__str(const char *str, const char **out)\n"
+                "{\n"
+                "    *out = str;\n"
+                "    return 1;\n"
+                "}\n\n", prefix);
+
+    // The loader
+
+    printf("// Fills in 'out' from 'ini'. Keys that are missing get their "
+            "default, or\n// are left zeroed. Strings point into 'ini'. "
+            "Returns 0 on success, or a\n// message describing the first key "
+            "that couldn't be converted or that is\n// required but "
+            "missing.\n"
+            "static const char *%s_load(SirIni ini, %s *out)\n"
+            "{\n"
+            "    unsigned char seen[%d] = { 0 };\n\n"
+            "    memset(out, 0, sizeof(*out));\n\n", 
+            prefix, prefix, fields_count ? fields_count : 1);
+
+    for (int j = 0; j < fields_count; ++j)
+    {
+        if (!fields[j].default_value) continue;
+
+        printf("    %s__%s(", prefix, fields[j].type);
+        gen_string(fields[j].default_value);
+        printf(", &out->");
+        gen_member_path(&fields[j], section_members);
+        printf(");\n");
+    }
+
+    printf("\n"
+            "    for (SirIndex i = 0; i < ini->section_count; ++i)\n"
+            "    {\n"
+            "        const char *section_name = ini->section_names[i];\n"
+            "        unsigned long section_hash = %s__hash(2166136261UL, "
+            "section_name);\n"
+            "        section_hash = (section_hash * 16777619UL) & "
+            "0xffffffffUL;\n\n"
+            "        SirSection *section = &ini->sections[i];\n\n"
+            "        for (SirIndex r = 0; r < section->ranges_count; ++r)\n"
+            "        {\n"
+            "            SirSectionRange *range = &section->ranges[r];\n\n"
+            "            for (SirIndex k = range->start; k < range->end; ++k)\n"
+            "            {\n"
+            "                const char *key_name = ini->key_names[k];\n"
+            "                if (!key_name) continue;\n\n"
+            "                const char *value = ini->key_values[k];\n"
+            "                if (ini->options & "
+            "SIR_OPTION_ENABLE_INTERPOLATION)\n"
+            "                    value = sir_section_str(ini, section_name, "
+            "key_name);\n"
+            "                if (!value) value = \"\";\n\n"
+            "                switch (%s__hash(section_hash, key_name))\n"
+            "                {\n", prefix, prefix);
+
+    for (int j = 0; j < fields_count; ++j)
+    {
+        char message[64];
+        snprintf(message, sizeof(message), "is not a valid %s", 
+                gen_type_names[gen_type_index(fields[j].type)]);
+
+        printf("%s                    case 0x%08lxUL:\n"
+                "                        if (strcmp(key_name, ", 
+                j ? "\n" : "", fields[j].hash);
+        gen_string(fields[j].key_name);
+        printf(") ||\n"
+                "                                strcmp(section_name, ");
+        gen_string(fields[j].section_name);
+        printf("))\n"
+                "                            break;\n"
+                "                        if (!%s__%s(value, &out->", 
+                prefix, fields[j].type);
+        gen_member_path(&fields[j], section_members);
+        printf("))\n"
+                "                            return ");
+        gen_message(&fields[j], message);
+        printf(";\n"
+                "                        seen[%d] = 1;\n"
+                "                        break;\n", j);
+    }
+
+    printf("                }\n"
+            "            }\n"
+            "        }\n"
+            "    }\n\n");
+
+    int required_count = 0;
+
+    for (int j = 0; j < fields_count; ++j)
+    {
+        if (!fields[j].required) continue;
+
+        ++required_count;
+        printf("    if (!seen[%d])\n        return ", j);
+        gen_message(&fields[j], "is required");
+        printf(";\n");
+    }
+
+    if (!required_count)
+        printf("    (void)seen;\n");
+
+    printf("\n    return 0;\n}\n\n#endif\n");
+}
+
+// Entry point for 'sir --gen-header'
+int gen_header(const char *filename)
+{
+    SirIni schema = sir_load_from_file(filename, 
+            SIR_OPTION_DISABLE_WARNINGS, 0);
+
+    if (!schema)
+    {
+        fprintf(stderr, "Something went seriously wrong\n");
+        return 1;
+    }
+
+    if (sir_has_error(schema))
+    {
+        fprintf(stderr, "%s\n", schema->error);
+        sir_free_ini(schema);
+        return 1;
+    }
+
+    // The structs are named after the file, without its directory or 
+    // extension
+
+    const char *base = filename;
+
+    for (const char *p = filename; *p; ++p)
+        if (*p == '/' || *p == '\\') base = p + 1;
+
+    const char *extension = strrchr(base, '.');
+    size_t base_size = extension && extension != base ? 
+        (size_t)(extension - base) : strlen(base);
+
+    char *prefix = gen_identifier(base, base_size);
+    GenField *fields = calloc(schema->key_count + 1, sizeof(*fields));
+    char **section_members = calloc(schema->section_count, 
+            sizeof(*section_members));
+    int fields_count = 0;
+    int result = 0;
+
+    if (!prefix || !fields || !section_members)
+    {
+        fprintf(stderr, "Out of memory\n");
+        result = 1;
+        goto done;
+    }
+
+    for (SirIndex i = 0; i < schema->section_count && !result; ++i)
+    {
+        const char *section_name = schema->section_names[i];
+
+        section_members[i] = gen_identifier(section_name, 
+                strlen(section_name));
+
+        for (SirIndex j = 1; j < i; ++j)
+        {
+            if (!strcmp(section_members[i], section_members[j]))
+            {
+                fprintf(stderr, "%s: sections '%s' and '%s' have the same "
+                        "C name\n", filename, schema->section_names[j], 
+                        section_name);
+                result = 1;
+            }
+        }
+
+        SirSection *section = &schema->sections[i];
+
+        for (SirIndex r = 0; r < section->ranges_count && !result; ++r)
+        {
+            for (SirIndex k = section->ranges[r].start; 
+                    k < section->ranges[r].end && !result; ++k)
+            {
+                if (!schema->key_names[k]) continue;
+
+                GenField *field = &fields[fields_count];
+                field->section_name = section_name;
+                field->key_name = schema->key_names[k];
+                field->section_index = i;
+                field->member = gen_identifier(field->key_name, 
+                        strlen(field->key_name));
+                field->hash = sirb_section_key_hash(section_name, 
+                        strlen(section_name), field->key_name, 
+                        strlen(field->key_name));
+                ++fields_count;
+
+                // The value points into the schema's data, which is ours
+                char *value = (char *)schema->key_values[k];
+                if (!gen_parse_field(value ? value : "", field))
+                {
+                    fprintf(stderr, "%s: '%s' in section '%s' has unknown "
+                            "type '%s'\n", filename, field->key_name, 
+                            section_name, field->type);
+                    result = 1;
+                    break;
+                }
+
+                if (field->default_value && 
+                        !gen_valid_value(field->type, field->default_value))
+                {
+                    fprintf(stderr, "%s: default of '%s' in section '%s' is "
+                            "not a valid %s\n", filename, field->key_name,
+                            section_name, field->type);
+                    result = 1;
+                    break;
+                }
+
+                for (int f = 0; f < fields_count - 1; ++f)
+                {
+                    const char *other = 0;
+
+                    if (fields[f].hash == field->hash)
+                        other = "has the same hash as";
+                    else if (fields[f].section_index == i && 
+                            !strcmp(fields[f].member, field->member))
+                        other = "has the same C name as";
+                    else
+                        continue;
+
+                    fprintf(stderr, "%s: '%s' in section '%s' %s '%s' in "
+                            "section '%s'\n", filename, field->key_name,
+                            section_name, other, fields[f].key_name,
+                            fields[f].section_name);
+                    result = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Global keys and sections with keys are both members of the top-level
+    // struct
+    for (int j = 0; j < fields_count && !result; ++j)
+    {
+        if (fields[j].section_index) continue;
+
+        for (SirIndex i = 1; i < schema->section_count; ++i)
+        {
+            if (!gen_section_has_fields(fields, fields_count, i) ||
+                    strcmp(fields[j].member, section_members[i]))
+                continue;
+
+            fprintf(stderr, "%s: global key '%s' and section '%s' have the "
+                    "same C name\n", filename, fields[j].key_name, 
+                    schema->section_names[i]);
+            result = 1;
+            break;
+        }
+    }
+
+    if (!result && !fields_count)
+    {
+        fprintf(stderr, "%s: the schema has no keys\n", filename);
+        result = 1;
+    }
+
+    if (!result)
+    {
+        gen_write(prefix, schema, fields, fields_count, section_members);
+
+        if (fflush(stdout))
+        {
+            fprintf(stderr, "%s\n", strerror(errno));
+            result = 1;
+        }
+    }
+
+done:
+    for (int i = 0; i < fields_count; ++i)
+        free(fields[i].member);
+
+    if (section_members)
+        for (SirIndex i = 0; i < schema->section_count; ++i)
+            free(section_members[i]);
+
+    free(section_members);
+    free(fields);
+    free(prefix);
+    sir_free_ini(schema);
+
+    return result;
 }
 
 #define arg_exists(argc, argv, arg) arg_index(argc, argv, arg) != -1
@@ -86,11 +2257,102 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (argc > 1 && !strcmp(argv[1], "grep"))
+        return grep(argc - 2, argv + 2);
+
+    if (argc > 1 && !strcmp(argv[1], "compile"))
+        return sirb_compile(argc - 2, argv + 2);
+
+    if (arg_exists(argc, argv, "--gen-header"))
+    {
+        char *schema_filename = arg_operand(argc, argv, "--gen-header");
+
+        if (!schema_filename)
+        {
+            print_help();
+            return 1;
+        }
+
+        return gen_header(schema_filename);
+    }
+
+    if (arg_exists(argc, argv, "--serve"))
+    {
+        char *socket_path = arg_operand(argc, argv, "--serve");
+
+        // Every non-option argument after the socket path is a file
+        char **filenames = malloc(sizeof(*filenames) * argc);
+        int files_count = 0;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            if (argv[i] == socket_path)
+                continue;
+            else if (argv[i][0] == '-' && arg_takes_operand(argv[i]))
+                ++i;
+            else if (argv[i][0] != '-')
+                filenames[files_count++] = argv[i];
+        }
+
+        if (!socket_path || !files_count)
+        {
+            print_help();
+            return 1;
+        }
+
+#ifdef __unix__
+        return serve(socket_path, filenames, files_count);
+#else
+        fprintf(stderr, "--serve is only supported on Unix systems\n");
+        return 1;
+#endif
+    }
+
+    if (arg_exists(argc, argv, "-0"))
+        output_flags |= OUTPUT_NUL_DELIMITED;
+
+    if (arg_exists(argc, argv, "--length-prefixed"))
+        output_flags |= OUTPUT_LENGTH_PREFIX;
+
     // Parse INI
 
     SirIni ini = 0;
 
     char *filename = arg_first_non_option(argc, argv);
+
+    // Compiled images are queried directly rather than parsed
+    if (filename && sirb_is_image(filename))
+    {
+        char *key = arg_operand(argc, argv, "-k");
+
+        if (!key)
+        {
+            fprintf(stderr, "%s: only '-k' is supported for compiled "
+                    "images\n", filename);
+            return 1;
+        }
+
+        SirbImage image;
+
+        if (sirb_open(&image, filename))
+        {
+            fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+            return 1;
+        }
+
+        int result = sirb_query(&image, arg_operand(argc, argv, "-s"), key);
+
+        sirb_close(&image);
+
+        if (output_flush())
+        {
+            fprintf(stderr, "%s\n", strerror(errno));
+            return 1;
+        }
+
+        return result ? 1 : 0;
+    }
+
     if (filename)
     {
         ini = sir_load_from_file(filename, 0, 0);
@@ -140,28 +2402,51 @@ int main(int argc, char **argv)
 
     // Do action specified by args
     char *section = arg_operand(argc, argv, "-s");
+    char *format  = arg_operand(argc, argv, "--format");
+
+    if (format)
+    {
+        if (!strcmp(format, "json"))
+        {
+            sir_write_json(ini, stdout);
+        }
+        else if (!strcmp(format, "ndjson"))
+        {
+            sir_write_ndjson(ini, stdout);
+        }
+        else
+        {
+            fprintf(stderr, "unknown format '%s'\n", format);
+            return 1;
+        }
 
-    if (arg_exists(argc, argv, "--list-sections"))
+        if (sir_has_error(ini))
+        {
+            fprintf(stderr, "%s\n", ini->error);
+            return 1;
+        }
+    }
+    else if (arg_exists(argc, argv, "--list-sections"))
     {
-        for (int i = 0; i < ini->section_count; ++i)
+        for (SirIndex i = 0; i < ini->section_count; ++i)
             if (strcmp(ini->section_names[i], SIR_GLOBAL_SECTION_NAME))
-                printf("%s\n", ini->section_names[i]);
+                output_record(ini->section_names[i]);
     }
     else if (arg_exists(argc, argv, "--list-keys"))
     {
         if (section)
         {
-            int names_size;
+            SirIndex names_size;
             const char **names = sir_section_key_names(ini, section, 
                     &names_size);
 
-            for (int i = 0; i < names_size; ++i)
-                printf("%s\n", names[i]);
+            for (SirIndex i = 0; i < names_size; ++i)
+                output_record(names[i]);
         }
         else
         {
-            for (int i = 0; i < ini->key_count; ++i)
-                printf("%s\n", ini->key_names[i]);
+            for (SirIndex i = 0; i < ini->key_count; ++i)
+                output_record(ini->key_names[i]);
         }
     }
     else
@@ -176,28 +2461,36 @@ int main(int argc, char **argv)
                 return 1;
             }
 
-            printf("%s\n", value);
+            output_record(value);
         }
         else
         {
             if (section)
             {
-                int values_size;
+                SirIndex values_size;
                 const char **values = sir_section_key_values(ini, 
                         section, &values_size);
 
-                for (int i = 0; i < values_size; ++i)
-                    printf("%s\n", values[i]);
+                for (SirIndex i = 0; i < values_size; ++i)
+                    output_record(values[i]);
             }
             else
             {
-                for (int i = 0; i < ini->key_count; ++i)
-                    printf("%s\n", ini->key_values[i]);
+                for (SirIndex i = 0; i < ini->key_count; ++i)
+                    output_record(ini->key_values[i]);
             }
         }
     }
 
+    int flush_result = output_flush();
+
     sir_free_ini(ini);
 
+    if (flush_result)
+    {
+        fprintf(stderr, "%s\n", strerror(errno));
+        return 1;
+    }
+
     return 0;
 }